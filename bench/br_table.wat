@@ -0,0 +1,46 @@
+;; state machine dispatching with br_table over eight states n times, expected result of run(100000): 483254958
+;; exported function: run
+
+(module
+  (func (export "run") (param $n i32) (result i32)
+    (local $state i32)
+    (local $acc i32)
+    (block $done
+      (loop $steps
+        (br_if $done (i32.eqz (local.get $n)))
+        (block $next
+          (block $s7
+            (block $s6
+              (block $s5
+                (block $s4
+                  (block $s3
+                    (block $s2
+                      (block $s1
+                        (block $s0
+                          (br_table $s0 $s1 $s2 $s3 $s4 $s5 $s6 $s7 $s0 (local.get $state)))
+                        (local.set $acc (i32.add (local.get $acc) (i32.const 1)))
+                        (local.set $state (i32.const 3))
+                        (br $next))
+                      (local.set $acc (i32.xor (local.get $acc) (i32.const 0x55)))
+                      (local.set $state (i32.const 6))
+                      (br $next))
+                    (local.set $acc (i32.mul (local.get $acc) (i32.const 3)))
+                    (local.set $state (i32.const 0))
+                    (br $next))
+                  (local.set $acc (i32.sub (local.get $acc) (i32.const 7)))
+                  (local.set $state (i32.const 5))
+                  (br $next))
+                (local.set $acc (i32.rotl (local.get $acc) (i32.const 1)))
+                (local.set $state (i32.const 2))
+                (br $next))
+              (local.set $acc (i32.add (local.get $acc) (local.get $n)))
+              (local.set $state (i32.const 7))
+              (br $next))
+            (local.set $acc (i32.shr_u (local.get $acc) (i32.const 1)))
+            (local.set $state (i32.const 4))
+            (br $next))
+          (local.set $acc (i32.xor (local.get $acc) (local.get $state)))
+          (local.set $state (i32.and (i32.add (local.get $acc) (local.get $n)) (i32.const 7))))
+        (local.set $n (i32.sub (local.get $n) (i32.const 1)))
+        (br $steps)))
+    (local.get $acc)))
@@ -0,0 +1,24 @@
+;; n indirect calls through a table of four functions, expected result of run(100000): 3353636840
+;; exported function: run
+
+(module
+  (type $step (func (param i32) (result i32)))
+  (table 4 funcref)
+  (elem (i32.const 0) $add $xor $mul $rot)
+
+  (func $add (param $x i32) (result i32) (i32.add (local.get $x) (i32.const 0x9E3779B9)))
+  (func $xor (param $x i32) (result i32) (i32.xor (local.get $x) (i32.shr_u (local.get $x) (i32.const 7))))
+  (func $mul (param $x i32) (result i32) (i32.mul (local.get $x) (i32.const 0x01000193)))
+  (func $rot (param $x i32) (result i32) (i32.rotl (local.get $x) (i32.const 13)))
+
+  (func (export "run") (param $n i32) (result i32)
+    (local $x i32)
+    (local.set $x (i32.const 1))
+    (block $done
+      (loop $calls
+        (br_if $done (i32.eqz (local.get $n)))
+        (local.set $x
+          (call_indirect (type $step) (local.get $x) (i32.and (i32.add (local.get $n) (local.get $x)) (i32.const 3))))
+        (local.set $n (i32.sub (local.get $n) (i32.const 1)))
+        (br $calls)))
+    (local.get $x)))
@@ -0,0 +1,37 @@
+;; bitwise CRC-32 (IEEE, reflected) over n bytes of a generated buffer, expected result of run(16384): 98792759
+;; exported function: run
+
+(module
+  (memory 1)
+
+  (func (export "run") (param $n i32) (result i32)
+    (local $i i32)
+    (local $bit i32)
+    (local $crc i32)
+    ;; buffer contents: byte i = i * 31 + 7
+    (local.set $i (i32.const 0))
+    (block $fill_done
+      (loop $fill
+        (br_if $fill_done (i32.ge_u (local.get $i) (local.get $n)))
+        (i32.store8 (local.get $i) (i32.add (i32.mul (local.get $i) (i32.const 31)) (i32.const 7)))
+        (local.set $i (i32.add (local.get $i) (i32.const 1)))
+        (br $fill)))
+
+    (local.set $crc (i32.const -1))
+    (local.set $i (i32.const 0))
+    (block $done
+      (loop $bytes
+        (br_if $done (i32.ge_u (local.get $i) (local.get $n)))
+        (local.set $crc (i32.xor (local.get $crc) (i32.load8_u (local.get $i))))
+        (local.set $bit (i32.const 8))
+        (loop $bits
+          ;; crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1))
+          (local.set $crc
+            (i32.xor
+              (i32.shr_u (local.get $crc) (i32.const 1))
+              (i32.and (i32.const 0xEDB88320) (i32.sub (i32.const 0) (i32.and (local.get $crc) (i32.const 1))))))
+          (local.set $bit (i32.sub (local.get $bit) (i32.const 1)))
+          (br_if $bits (local.get $bit)))
+        (local.set $i (i32.add (local.get $i) (i32.const 1)))
+        (br $bytes)))
+    (i32.xor (local.get $crc) (i32.const -1))))
@@ -0,0 +1,73 @@
+;; n x n f64 matrix multiply c = a * b with a[i][j] = i + j and b[i][j] = i - j, returns the sum of c,
+;; expected result of run(64): 89456640.0
+;; exported function: run
+
+(module
+  (memory 4)
+
+  ;; matrices are stored row-major: a at 0, b at n * n * 8, c at 2 * n * n * 8
+  (func $addr (param $base i32) (param $n i32) (param $i i32) (param $j i32) (result i32)
+    (i32.add (local.get $base)
+      (i32.shl (i32.add (i32.mul (local.get $i) (local.get $n)) (local.get $j)) (i32.const 3))))
+
+  (func (export "run") (param $n i32) (result f64)
+    (local $i i32)
+    (local $j i32)
+    (local $k i32)
+    (local $b i32)
+    (local $c i32)
+    (local $pa i32)
+    (local $pb i32)
+    (local $row i32)
+    (local $acc f64)
+    (local $sum f64)
+    (local.set $b (i32.shl (i32.mul (local.get $n) (local.get $n)) (i32.const 3)))
+    (local.set $c (i32.shl (local.get $b) (i32.const 1)))
+    (local.set $row (i32.shl (local.get $n) (i32.const 3)))
+
+    (local.set $i (i32.const 0))
+    (block $init_done
+      (loop $init_i
+        (br_if $init_done (i32.ge_u (local.get $i) (local.get $n)))
+        (local.set $j (i32.const 0))
+        (block $init_j_done
+          (loop $init_j
+            (br_if $init_j_done (i32.ge_u (local.get $j) (local.get $n)))
+            (f64.store (call $addr (i32.const 0) (local.get $n) (local.get $i) (local.get $j))
+              (f64.convert_i32_s (i32.add (local.get $i) (local.get $j))))
+            (f64.store (call $addr (local.get $b) (local.get $n) (local.get $i) (local.get $j))
+              (f64.convert_i32_s (i32.sub (local.get $i) (local.get $j))))
+            (local.set $j (i32.add (local.get $j) (i32.const 1)))
+            (br $init_j)))
+        (local.set $i (i32.add (local.get $i) (i32.const 1)))
+        (br $init_i)))
+
+    (local.set $i (i32.const 0))
+    (block $i_done
+      (loop $i_loop
+        (br_if $i_done (i32.ge_u (local.get $i) (local.get $n)))
+        (local.set $j (i32.const 0))
+        (block $j_done
+          (loop $j_loop
+            (br_if $j_done (i32.ge_u (local.get $j) (local.get $n)))
+            (local.set $acc (f64.const 0))
+            ;; pa walks along row i of a, pb down column j of b
+            (local.set $pa (call $addr (i32.const 0) (local.get $n) (local.get $i) (i32.const 0)))
+            (local.set $pb (call $addr (local.get $b) (local.get $n) (i32.const 0) (local.get $j)))
+            (local.set $k (local.get $n))
+            (block $k_done
+              (loop $k_loop
+                (br_if $k_done (i32.eqz (local.get $k)))
+                (local.set $acc
+                  (f64.add (local.get $acc) (f64.mul (f64.load (local.get $pa)) (f64.load (local.get $pb)))))
+                (local.set $pa (i32.add (local.get $pa) (i32.const 8)))
+                (local.set $pb (i32.add (local.get $pb) (local.get $row)))
+                (local.set $k (i32.sub (local.get $k) (i32.const 1)))
+                (br $k_loop)))
+            (f64.store (call $addr (local.get $c) (local.get $n) (local.get $i) (local.get $j)) (local.get $acc))
+            (local.set $sum (f64.add (local.get $sum) (local.get $acc)))
+            (local.set $j (i32.add (local.get $j) (i32.const 1)))
+            (br $j_loop)))
+        (local.set $i (i32.add (local.get $i) (i32.const 1)))
+        (br $i_loop)))
+    (local.get $sum)))
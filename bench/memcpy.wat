@@ -0,0 +1,47 @@
+;; copies a 16 KiB block back and forth n times with 8 byte loads and stores, returns a checksum of the block,
+;; expected result of run(64): 5489076113220374894
+;; exported function: run
+
+(module
+  (memory 1)
+
+  ;; copies length bytes (a multiple of 8) from src to dst
+  (func $copy (param $dst i32) (param $src i32) (param $length i32)
+    (local $end i32)
+    (local.set $end (i32.add (local.get $src) (local.get $length)))
+    (block $done
+      (loop $words
+        (br_if $done (i32.ge_u (local.get $src) (local.get $end)))
+        (i64.store (local.get $dst) (i64.load (local.get $src)))
+        (local.set $dst (i32.add (local.get $dst) (i32.const 8)))
+        (local.set $src (i32.add (local.get $src) (i32.const 8)))
+        (br $words))))
+
+  (func (export "run") (param $n i32) (result i64)
+    (local $i i32)
+    (local $sum i64)
+    (local.set $i (i32.const 0))
+    (block $fill_done
+      (loop $fill
+        (br_if $fill_done (i32.ge_u (local.get $i) (i32.const 16384)))
+        (i64.store (local.get $i) (i64.extend_i32_u (i32.mul (local.get $i) (i32.const 2654435761))))
+        (local.set $i (i32.add (local.get $i) (i32.const 8)))
+        (br $fill)))
+
+    (local.set $i (local.get $n))
+    (block $done
+      (loop $rounds
+        (br_if $done (i32.eqz (local.get $i)))
+        (call $copy (i32.const 16384) (i32.const 0) (i32.const 16384))
+        (call $copy (i32.const 0) (i32.const 16384) (i32.const 16384))
+        (local.set $i (i32.sub (local.get $i) (i32.const 1)))
+        (br $rounds)))
+
+    (local.set $i (i32.const 0))
+    (block $sum_done
+      (loop $sum_loop
+        (br_if $sum_done (i32.ge_u (local.get $i) (i32.const 32768)))
+        (local.set $sum (i64.add (i64.rotl (local.get $sum) (i64.const 5)) (i64.load (local.get $i))))
+        (local.set $i (i32.add (local.get $i) (i32.const 8)))
+        (br $sum_loop)))
+    (local.get $sum)))
@@ -0,0 +1,38 @@
+;; sieve of Eratosthenes over n bytes of memory, counts the primes below n, expected result of run(100000): 9592
+;; exported function: run
+
+(module
+  (memory 2)
+
+  (func (export "run") (param $n i32) (result i32)
+    (local $i i32)
+    (local $j i32)
+    (local $count i32)
+    ;; all numbers from 2 are candidates
+    (local.set $i (i32.const 0))
+    (block $clear_done
+      (loop $clear
+        (br_if $clear_done (i32.ge_u (local.get $i) (local.get $n)))
+        (i32.store8 (local.get $i) (i32.const 1))
+        (local.set $i (i32.add (local.get $i) (i32.const 1)))
+        (br $clear)))
+    (local.set $i (i32.const 2))
+    (block $done
+      (loop $outer
+        (br_if $done (i32.ge_u (local.get $i) (local.get $n)))
+        (if (i32.load8_u (local.get $i))
+          (then
+            (local.set $count (i32.add (local.get $count) (i32.const 1)))
+            ;; marking starts at i * i, which must not overflow
+            (local.set $j (i32.mul (local.get $i) (local.get $i)))
+            (if (i32.gt_u (local.get $i) (i32.div_u (local.get $n) (local.get $i)))
+              (then (local.set $j (local.get $n))))
+            (block $mark_done
+              (loop $mark
+                (br_if $mark_done (i32.ge_u (local.get $j) (local.get $n)))
+                (i32.store8 (local.get $j) (i32.const 0))
+                (local.set $j (i32.add (local.get $j) (local.get $i)))
+                (br $mark)))))
+        (local.set $i (i32.add (local.get $i) (i32.const 1)))
+        (br $outer)))
+    (local.get $count)))
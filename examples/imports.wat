@@ -0,0 +1,27 @@
+;; Imported functions come first in the function index space: $double is function 1, not 0.
+(module
+  (type $consume (func (param i32)))
+  (type $unary (func (param i32) (result i32)))
+  (import "env" "log" (func $log (type $consume)))
+  (table 2 funcref)
+  (elem (i32.const 0) $double $call_log)
+  (func $double (type $unary)
+    local.get 0
+    i32.const 2
+    i32.mul)
+  (func $call_log (type $unary)
+    local.get 0
+    call $log
+    local.get 0)
+  (func $call_double (type $unary)
+    local.get 0
+    call $double)
+  (func $indirect_double (type $unary)
+    local.get 0
+    i32.const 0
+    call_indirect (type $unary))
+  (export "double" (func $double))
+  (export "call_log" (func $call_log))
+  (export "call_double" (func $call_double))
+  (export "indirect_double" (func $indirect_double))
+  (export "log" (func $log)))
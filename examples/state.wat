@@ -0,0 +1,29 @@
+;; Instance state for the pool and snapshot tests. The start function changes the global and the memory, so an
+;; initialized instance differs from the initial values in the module; "write" and "grow" change them again.
+(module
+  (memory 1 4)
+  (global $g (mut i32) (i32.const 1))
+  (table 2 funcref)
+  (elem (i32.const 1) $get)
+  (data (i32.const 16) "hello")
+  (func $init
+    i32.const 100
+    global.set $g
+    i32.const 32
+    i32.const 42
+    i32.store)
+  (func $get (export "get") (result i32)
+    global.get $g
+    i32.const 32
+    i32.load
+    i32.add)
+  (func (export "write") (param i32)
+    local.get 0
+    global.set $g
+    i32.const 16
+    local.get 0
+    i32.store)
+  (func (export "grow") (result i32)
+    i32.const 1
+    memory.grow)
+  (start $init))
@@ -0,0 +1,26 @@
+;; Traps at known places for the batch test: "nested" traps in $fail (function 0) at pc 1 and "load" (function 2) at
+;; pc 1, "indirect" (function 4) calls $fail through table element 0, element 1 is uninitialized and the table ends
+;; before element 2. The global of "count" survives the traps.
+(module
+  (memory 1)
+  (table 2 funcref)
+  (elem (i32.const 0) $fail)
+  (global $count (mut i32) (i32.const 0))
+  (func $fail
+    nop
+    unreachable)
+  (func (export "nested") (param i32) (result i32)
+    local.get 0
+    call $fail)
+  (func (export "load") (result i32)
+    i32.const 65536
+    i32.load)
+  (func (export "count") (result i32)
+    global.get $count
+    i32.const 1
+    i32.add
+    global.set $count
+    global.get $count)
+  (func (export "indirect") (param i32)
+    local.get 0
+    call_indirect))
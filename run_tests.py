@@ -21,6 +21,11 @@ skip_suites = [
     'names',
 ]
 
+# assert_invalid and assert_malformed modules the interpreter accepts although it should not, as (suite, line). They
+# are reported as warnings instead of failures, a listed module which is rejected is reported as a failure so the list
+# does not go stale.
+known_invalid_failures = set()
+
 
 class bcolors:
     HEADER = '\033[95m'
@@ -45,13 +50,18 @@ counts = {
 }
 
 
-def invoke_test(test_binary, module, fn, args):
+def invoke_args(test_binary, module, fn, args):
     runner_args = [test_binary]
     runner_args += ["-p", module]
     runner_args += ["-f", fn]
 
     for arg in args:
         runner_args += ["-a", arg['type'] + ":" + arg['value']]
+    return runner_args
+
+
+def invoke_test(test_binary, module, fn, args):
+    runner_args = invoke_args(test_binary, module, fn, args)
 
     try:
         result = subprocess.run(runner_args, stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=1)
@@ -63,6 +73,49 @@ def invoke_test(test_binary, module, fn, args):
         return runner_args, "invocation timed out", True
 
 
+def batch_token(s):
+    # tokens of batch scripts are whitespace separated, anything else is escaped as %XX
+    return ''.join(c if c.isascii() and c.isprintable() and not c.isspace() and c != '%'
+                   else ''.join('%%%02X' % b for b in c.encode('utf-8')) for c in s)
+
+
+def batch_expected(command):
+    if len(command['expected']) == 0:
+        return 'void'
+    expected = command['expected'][0]
+    if command['type'] != 'assert_return' or expected['value'].startswith('nan:'):
+        return expected['type'] + ':nan'
+    return expected['type'] + ':' + expected['value']
+
+
+def invalid_test(test_binary, module):
+    """Parses the module in a process of its own, the test passes if it is rejected."""
+    runner_args = [test_binary, "-p", module, "-f", "_start"]
+    try:
+        result = subprocess.run(runner_args, stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=1)
+        output = result.stderr.decode('utf-8').rstrip("\r\n\t ")
+        rejected = output.startswith("error parsing file")
+        return runner_args, output if rejected or output.startswith("Error opening") else "loaded", not rejected
+    except subprocess.TimeoutExpired as e:
+        return runner_args, "parsing timed out", True
+
+
+def run_batch(test_binary, script, timeout):
+    """Runs the script in one process, returns the output per script line, which is incomplete if the process died."""
+    results = {}
+    try:
+        result = subprocess.run([test_binary, "-b", "-"], input='\n'.join(script).encode('utf-8'),
+                                stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=timeout)
+        output = result.stdout
+    except subprocess.TimeoutExpired as e:
+        output = e.stdout or b''
+    for line in output.decode('utf-8', 'replace').splitlines():
+        number, sep, rest = line.partition(': ')
+        if sep and number.isdigit():
+            results[int(number)] = rest
+    return results
+
+
 def stringify_call(fn, args):
     return fn + '(' + ', '.join([arg['type'] + ':' + arg['value'] for arg in args]) + ')'
 
@@ -82,8 +135,10 @@ def check_result(actual, command):
     if command['type'] == 'assert_return':
         if len(command['expected']) == 0:
             return actual == 'void'
-        return actual == (command['expected'][0]['type'] + ':' + command['expected'][0]['value'])
-    if command['type'] == 'assert_return_arithmetic_nan' or command['type'] == 'assert_return_canonical_nan':
+        if not command['expected'][0]['value'].startswith('nan:'):
+            return actual == (command['expected'][0]['type'] + ':' + command['expected'][0]['value'])
+    if command['type'] == 'assert_return_arithmetic_nan' or command['type'] == 'assert_return_canonical_nan' or \
+            command['type'] == 'assert_return':
         t = actual.split(":")[0]
         v = int(actual.split(":")[1])
         if t == 'f32':
@@ -96,10 +151,14 @@ def check_result(actual, command):
 
 
 def run_suite(name, test_suite, test_binaries):
+    """Runs all assertions of the suite in one batch process (see src/batch.h), assertions which did not get a result
+    because the process crashed or timed out are run in a process of their own."""
     global counts
 
     source_filename = test_suite['source_filename']
     current_module = None
+    script = []
+    assertions = []  # (script line, command, module)
 
     for command in test_suite['commands']:
         line = command['line']
@@ -107,6 +166,7 @@ def run_suite(name, test_suite, test_binaries):
 
         if command['type'] == 'module':
             current_module = command['filename']
+            script.append("module " + batch_token(test_binaries + current_module))
             continue
 
         counts['total'] += 1
@@ -121,23 +181,10 @@ def run_suite(name, test_suite, test_binaries):
             'type'] == 'assert_return_arithmetic_nan':
             action = command['action']
             if action['type'] == 'invoke':
-                run_cmd, result, failed = invoke_test(test_binary, test_binaries + current_module, action['field'],
-                                                      action['args'])
-
-                if not check_result(result, command):
-                    failed = True
-
-                if failed:
-                    counts['failed'] += 1
-                    prefix = PREFIX_FAIL
-                else:
-                    counts['successful'] += 1
-                    prefix = PREFIX_OK
-
-                if failed or (not failed and not hide_successes):
-                    print(prefix + " " + line_str + stringify_call(action['field'],
-                                                                   action['args']) + ": expected=" + stringify_result(
-                        command) + ", actual=" + result + ". Command: \"" + " ".join(run_cmd) + "\"")
+                script.append(" ".join(["assert_return", batch_token(action['field'])]
+                                       + [arg['type'] + ':' + arg['value'] for arg in action['args']]
+                                       + ["=", batch_expected(command)]))
+                assertions.append((len(script), command, current_module))
             else:
                 if not hide_warnings:
                     print(PREFIX_WARN + " " + line_str + "Skipping test with action type " + action[
@@ -146,11 +193,84 @@ def run_suite(name, test_suite, test_binaries):
 
             continue
 
+        if command['type'] == 'assert_invalid' or command['type'] == 'assert_malformed':
+            # malformed text modules cannot be checked without a text parser
+            if command.get('module_type', 'binary') == 'binary':
+                script.append(command['type'] + " " + batch_token(test_binaries + command['filename']))
+                assertions.append((len(script), command, command['filename']))
+            else:
+                if not hide_warnings:
+                    print(PREFIX_WARN + " " + line_str + "Skipping " + command['type'] + " of a text module")
+                counts['skipped'] += 1
+            continue
+
         if not hide_warnings:
             print(PREFIX_WARN + " " + line_str + "Skipping test with command type " + command[
                 'type'] + " (" + command.__str__() + ")" + bcolors.ENDC)
         counts['skipped'] += 1
 
+    results = run_batch(test_binary, script, 1 + len(script) / 100) if assertions else {}
+
+    for script_line, command, module in assertions:
+        line_str = source_filename + ':' + str(command['line']) + ': '
+
+        if command['type'] == 'assert_invalid' or command['type'] == 'assert_malformed':
+            run_invalid_assertion(name, command, test_binaries + module, results.get(script_line), line_str)
+            continue
+
+        action = command['action']
+        run_cmd = invoke_args(test_binary, test_binaries + module, action['field'], action['args'])
+
+        if script_line in results:
+            status, _, result = results[script_line].partition(' ')
+            failed = status != 'ok'
+            if status == 'error':
+                result = 'error: ' + result
+        else:
+            run_cmd, result, failed = invoke_test(test_binary, test_binaries + module, action['field'],
+                                                  action['args'])
+            if not check_result(result, command):
+                failed = True
+
+        if failed:
+            counts['failed'] += 1
+            prefix = PREFIX_FAIL
+        else:
+            counts['successful'] += 1
+            prefix = PREFIX_OK
+
+        if failed or (not failed and not hide_successes):
+            print(prefix + " " + line_str + stringify_call(action['field'],
+                                                           action['args']) + ": expected=" + stringify_result(
+                command) + ", actual=" + result + ". Command: \"" + " ".join(run_cmd) + "\"")
+
+
+def run_invalid_assertion(name, command, module, batch_result, line_str):
+    if batch_result is not None:
+        run_cmd = [test_binary, "-b", "-"]
+        failed = batch_result != 'ok'
+        result = "rejected" if not failed else batch_result
+    else:
+        run_cmd, result, failed = invalid_test(test_binary, module)
+
+    known = (name, command['line']) in known_invalid_failures
+    if failed and known:
+        counts['skipped'] += 1
+        if not hide_warnings:
+            print(PREFIX_WARN + " " + line_str + "Known failure of " + command['type'] + " " + module)
+        return
+    if known:
+        failed = True
+        result += " (listed in known_invalid_failures)"
+
+    if failed:
+        counts['failed'] += 1
+    else:
+        counts['successful'] += 1
+    if failed or not hide_successes:
+        print((PREFIX_FAIL if failed else PREFIX_OK) + " " + line_str + command['type'] + " " + module + ": expected="
+              + command.get('text', 'rejected') + ", actual=" + result + ". Command: \"" + " ".join(run_cmd) + "\"")
+
 
 def main():
     included_modules = []
@@ -0,0 +1,68 @@
+#include <stdlib.h>
+
+#include "arena.h"
+#include "exception.h"
+
+arena_t *create_arena() {
+    arena_t *arena = calloc(1, sizeof(arena_t));
+    if (arena == NULL) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VECTOR_EXCEPTION, "calloc failed");
+    }
+    return arena;
+}
+
+void free_arena(arena_t *arena) {
+    if (arena == NULL) {
+        return;
+    }
+    arena_chunk_t *chunk = arena->chunks;
+    while (chunk != NULL) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+void arena_merge(arena_t *dst, arena_t *src) {
+    // the chunks of src go behind the newest chunk of dst, which keeps bump allocating
+    arena_chunk_t **tail = dst->chunks != NULL ? &dst->chunks->next : &dst->chunks;
+    arena_chunk_t *rest = *tail;
+    *tail = src->chunks;
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = rest;
+    if (dst->chunks == src->chunks) {
+        dst->pos = src->pos;
+        dst->end = src->end;
+    }
+    src->chunks = NULL;
+    free_arena(src);
+}
+
+/* Slow path of arena_alloc, size is already aligned. */
+void *arena_alloc_chunk(arena_t *arena, size_t size) {
+    // large allocations get a chunk of their own, so the free space of the current chunk is not lost
+    bool own_chunk = size > ARENA_CHUNK_SIZE / 4;
+    size_t data_size = own_chunk ? size : ARENA_CHUNK_SIZE;
+    if (data_size > SIZE_MAX - sizeof(arena_chunk_t)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VECTOR_EXCEPTION, "arena allocation of %zu bytes failed", size);
+    }
+    arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + data_size);
+    if (chunk == NULL) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VECTOR_EXCEPTION, "arena allocation of %zu bytes failed", size);
+    }
+    byte *data = (byte *) chunk->data;
+
+    if (own_chunk && arena->chunks != NULL) {
+        chunk->next = arena->chunks->next;
+        arena->chunks->next = chunk;
+        return data;
+    }
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->pos = data + size;
+    arena->end = data + data_size;
+    return data;
+}
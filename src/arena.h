@@ -0,0 +1,49 @@
+#ifndef WASM_INTERPRETER_ARENA_H
+#define WASM_INTERPRETER_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "value.h"
+
+/*
+ * Bump allocator for data which lives exactly as long as its owner (e.g. a module): allocations cannot be freed or
+ * resized individually, free_arena releases all of them at once. An arena must not be used by several threads at the
+ * same time, threads allocate from their own arena and merge it into the owner's one afterwards.
+ */
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+#define ARENA_CHUNK_SIZE ((size_t) 64 * 1024)
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    max_align_t data[];
+} arena_chunk_t;
+
+typedef struct arena {
+    arena_chunk_t *chunks;
+    byte *pos; /* Free space in the newest chunk. */
+    byte *end;
+} arena_t;
+
+arena_t *create_arena();
+
+void free_arena(arena_t *arena);
+
+/* Moves all allocations of src into dst and frees src. */
+void arena_merge(arena_t *dst, arena_t *src);
+
+void *arena_alloc_chunk(arena_t *arena, size_t size);
+
+/* Returns size bytes, aligned for any type and not initialized. */
+static inline SILENCE_UNUSED void *arena_alloc(arena_t *arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    if ((size_t) (arena->end - arena->pos) < size) {
+        return arena_alloc_chunk(arena, size);
+    }
+    void *ptr = arena->pos;
+    arena->pos += size;
+    return ptr;
+}
+
+#endif // WASM_INTERPRETER_ARENA_H
@@ -0,0 +1,294 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+
+#include "batch.h"
+#include "interpreter.h"
+
+#define BATCH_MAX_TOKENS 256
+
+typedef struct batch_state {
+    FILE *out;
+    const parse_options_t *options;
+    module_t *module;
+    eval_state_t *instance; /* NULL if there is no module or it failed to load. */
+    vec_parameter_value_t *parameters;
+    u32 passed;
+    u32 failed;
+} batch_state_t;
+
+bool parse_value(const char *str, parameter_value_t *param) {
+    const char *value_str = strchr(str, ':');
+    if (value_str == NULL) {
+        return false;
+    }
+    size_t type_length = value_str++ - str;
+    if (type_length == 3 && strncmp(str, "i32", 3) == 0) {
+        param->type = VALTYPE_I32;
+        param->val.i32 = (i32) strtoul(value_str, NULL, 10);
+    } else if (type_length == 3 && strncmp(str, "i64", 3) == 0) {
+        param->type = VALTYPE_I64;
+        param->val.i64 = (i64) strtoul(value_str, NULL, 10);
+    } else if (type_length == 3 && strncmp(str, "f32", 3) == 0) {
+        param->type = VALTYPE_F32;
+        param->val.i32 = strtoul(value_str, NULL, 10);
+    } else if (type_length == 3 && strncmp(str, "f64", 3) == 0) {
+        param->type = VALTYPE_F64;
+        param->val.i64 = strtoul(value_str, NULL, 10);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void print_return_value(FILE *file, const return_value_t *ret) {
+    if (ret->is_void) {
+        fprintf(file, "void");
+        return;
+    }
+    switch (ret->type) {
+        case VALTYPE_I32:
+            fprintf(file, "i32:%u", ret->val.i32);
+            break;
+        case VALTYPE_I64:
+            fprintf(file, "i64:%lu", ret->val.i64);
+            break;
+        case VALTYPE_F32:
+            fprintf(file, "f32:%u", ret->val.i32);
+            break;
+        case VALTYPE_F64:
+            fprintf(file, "f64:%lu", ret->val.i64);
+            break;
+        default:
+            fprintf(file, "unknown");
+    }
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = (char) tolower((unsigned char) c);
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+/* Splits line in place into whitespace separated tokens and decodes their %XX escapes, -1 if there are too many. */
+static int split_tokens(char *line, char **tokens) {
+    int count = 0;
+    char *pos = line;
+    while (true) {
+        while (isspace((unsigned char) *pos)) {
+            pos++;
+        }
+        if (*pos == '\0') {
+            return count;
+        }
+        if (count == BATCH_MAX_TOKENS) {
+            return -1;
+        }
+        tokens[count++] = pos;
+
+        char *out = pos;
+        while (*pos != '\0' && !isspace((unsigned char) *pos)) {
+            int high, low;
+            if (pos[0] == '%' && (high = hex_digit(pos[1])) >= 0 && (low = hex_digit(pos[2])) >= 0) {
+                *out++ = (char) (high << 4 | low);
+                pos += 3;
+            } else {
+                *out++ = *pos++;
+            }
+        }
+        bool end = *pos == '\0';
+        *out = '\0';
+        if (end) {
+            return count;
+        }
+        pos++;
+    }
+}
+
+static void unload_module(batch_state_t *state) {
+    if (state->instance != NULL) {
+        free_interpreter(state->instance);
+        state->instance = NULL;
+    }
+    if (state->module != NULL) {
+        free_module(state->module);
+        state->module = NULL;
+    }
+}
+
+static const char *load_module(batch_state_t *state, const char *path) {
+    unload_module(state);
+
+    FILE *input = fopen(path, "r");
+    if (input == NULL) {
+        return strerror(errno);
+    }
+    exception_t ex = parse(input, state->options, &state->module);
+    fclose(input);
+    if (ex != NO_EXCEPTION) {
+        state->module = NULL;
+        return exception_code_to_string(ex);
+    }
+    ex = instantiate(state->module, &state->instance);
+    if (ex != NO_EXCEPTION) {
+        state->instance = NULL;
+        return exception_code_to_string(ex);
+    }
+    return NULL;
+}
+
+/* Checks a result against an expectation written as for assert_return. */
+static bool matches(const char *expected, const return_value_t *ret) {
+    if (strcmp(expected, "void") == 0) {
+        return ret->is_void;
+    }
+    if (ret->is_void) {
+        return false;
+    }
+    if (strcmp(expected, "f32:nan") == 0) {
+        return ret->type == VALTYPE_F32 && isnan(ret->val.f32);
+    }
+    if (strcmp(expected, "f64:nan") == 0) {
+        return ret->type == VALTYPE_F64 && isnan(ret->val.f64);
+    }
+    parameter_value_t value;
+    if (!parse_value(expected, &value) || value.type != ret->type) {
+        return false;
+    }
+    if (ret->type == VALTYPE_I32 || ret->type == VALTYPE_F32) {
+        return (u32) value.val.i32 == (u32) ret->val.i32;
+    }
+    return (u64) value.val.i64 == (u64) ret->val.i64;
+}
+
+/* Runs one command, prints its result and returns whether it succeeded. */
+static bool run_command(batch_state_t *state, u32 line, char **tokens, int count) {
+    const char *command = tokens[0];
+    if (strcmp(command, "module") == 0) {
+        if (count != 2) {
+            fprintf(state->out, "%u: error usage: module <path>\n", line);
+            return false;
+        }
+        const char *error = load_module(state, tokens[1]);
+        if (error != NULL) {
+            fprintf(state->out, "%u: error %s\n", line, error);
+            return false;
+        }
+        fprintf(state->out, "%u: ok\n", line);
+        return true;
+    }
+
+    // the module of an assertion is only parsed, the current module stays loaded
+    if (strcmp(command, "assert_invalid") == 0 || strcmp(command, "assert_malformed") == 0) {
+        if (count != 2) {
+            fprintf(state->out, "%u: error usage: %s <path>\n", line, command);
+            return false;
+        }
+        FILE *input = fopen(tokens[1], "r");
+        if (input == NULL) {
+            fprintf(state->out, "%u: error %s\n", line, strerror(errno));
+            return false;
+        }
+        module_t *module;
+        exception_t ex = parse(input, state->options, &module);
+        fclose(input);
+        if (ex == NO_EXCEPTION) {
+            free_module(module);
+            fprintf(state->out, "%u: fail loaded\n", line);
+            return false;
+        }
+        fprintf(state->out, "%u: ok\n", line);
+        return true;
+    }
+
+    bool is_assert = strcmp(command, "assert_return") == 0;
+    if (!is_assert && strcmp(command, "invoke") != 0) {
+        fprintf(state->out, "%u: error unknown command %s\n", line, command);
+        return false;
+    }
+    if (count < 2) {
+        fprintf(state->out, "%u: error usage: %s <name> [type:value]...\n", line, command);
+        return false;
+    }
+    const char *expected = NULL;
+    int args_end = count;
+    if (is_assert) {
+        if (count < 4 || strcmp(tokens[count - 2], "=") != 0) {
+            fprintf(state->out, "%u: error usage: assert_return <name> [type:value]... = <result>\n", line);
+            return false;
+        }
+        expected = tokens[count - 1];
+        args_end = count - 2;
+    }
+
+    vec_parameter_value_resize(state->parameters, 0);
+    for (int i = 2; i < args_end; i++) {
+        parameter_value_t param;
+        if (!parse_value(tokens[i], &param)) {
+            fprintf(state->out, "%u: error unknown parameter type %s\n", line, tokens[i]);
+            return false;
+        }
+        vec_parameter_value_add(state->parameters, param);
+    }
+    if (state->instance == NULL) {
+        fprintf(state->out, "%u: error no module\n", line);
+        return false;
+    }
+
+    return_value_t ret;
+    exception_t ex = interpret_function(state->instance, tokens[1], state->parameters, &ret);
+    if (ex != NO_EXCEPTION) {
+        char error[256];
+        fprintf(state->out, "%u: error %s\n", line, format_trap(&state->instance->trap, ex, error, sizeof(error)));
+        return false;
+    }
+    bool ok = !is_assert || matches(expected, &ret);
+    fprintf(state->out, "%u: %s", line, !is_assert ? "" : ok ? "ok" : "fail ");
+    if (!is_assert || !ok) {
+        print_return_value(state->out, &ret);
+    }
+    fputc('\n', state->out);
+    return ok;
+}
+
+int run_batch(FILE *script, FILE *out, const parse_options_t *options) {
+    batch_state_t state = {
+            .out = out,
+            .options = options,
+            .parameters = vec_parameter_value_create(),
+    };
+
+    char *line = NULL;
+    size_t capacity = 0;
+    char *tokens[BATCH_MAX_TOKENS];
+    for (u32 line_number = 1; getline(&line, &capacity, script) != -1; line_number++) {
+        int count = split_tokens(line, tokens);
+        if (count == 0 || tokens[0][0] == '#') {
+            continue;
+        }
+        bool ok;
+        if (count < 0) {
+            fprintf(out, "%u: error more than %d tokens\n", line_number, BATCH_MAX_TOKENS);
+            ok = false;
+        } else {
+            ok = run_command(&state, line_number, tokens, count);
+        }
+        // results are flushed per command, so a caller sees all of them if a later call never returns
+        fflush(out);
+        if (ok) {
+            state.passed++;
+        } else {
+            state.failed++;
+        }
+    }
+    fprintf(out, "passed %u failed %u\n", state.passed, state.failed);
+
+    free(line);
+    unload_module(&state);
+    vec_parameter_value_free(state.parameters);
+    return (int) state.failed;
+}
@@ -0,0 +1,35 @@
+#ifndef WASM_INTERPRETER_BATCH_H
+#define WASM_INTERPRETER_BATCH_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "eval_types.h"
+#include "parser.h"
+
+/*
+ * Batch mode runs a whole script of calls in one process, modules stay loaded between the calls. A script has one
+ * command per line, tokens are separated by whitespace and may contain %XX escapes (e.g. %20 for a space in an
+ * export name). Empty lines and lines starting with # are ignored.
+ *
+ *   module <path>                                    parses and instantiates the module, following calls use it
+ *   invoke <name> [type:value]...                    calls an export and prints its result
+ *   assert_return <name> [type:value]... = <result>  calls an export and compares its result
+ *   assert_invalid <path>                            expects parsing (including validation) of the module to fail
+ *   assert_malformed <path>                          the same, for modules which do not even decode
+ *
+ * Values are written as for -a (the bits of floats as unsigned decimal), results as printed by invoke: void or
+ * type:value, where f32:nan and f64:nan match any NaN. One line is printed per command: "<line>: <result>" for invoke,
+ * "<line>: ok" for loaded modules and passed assertions, "<line>: fail <actual>" for failed ones ("fail loaded" for
+ * an accepted invalid module) and "<line>: error <message>" if the module or the call failed. A summary follows at the
+ * end, the result is the number of failed commands. The results are written to out.
+ */
+int run_batch(FILE *script, FILE *out, const parse_options_t *options);
+
+/* Parses type:value into param, false if the type is unknown. */
+bool parse_value(const char *str, parameter_value_t *param);
+
+/* Prints a result as type:value (or void) as main and invoke do. */
+void print_return_value(FILE *file, const return_value_t *ret);
+
+#endif // WASM_INTERPRETER_BATCH_H
@@ -0,0 +1,417 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "interpreter.h"
+#include "executor.h"
+
+/*
+ * Runs the benchmark modules in bench/ and reports the time per call, the executed instructions per second and the
+ * spread over repeated runs as JSON on stdout. With a baseline (the JSON of an earlier run) every benchmark is compared
+ * to it: changes within the threshold or within twice the relative standard deviation count as noise, slower
+ * benchmarks make the exit status non-zero.
+ *
+ * Every benchmark module exports run(i32), which is called with the argument below and has to return the expected
+ * result (see the comments in the .wat files), so a broken interpreter does not report fast but wrong numbers.
+ *
+ * With -j the calls are also run as jobs of the executor with 1, 2, 4, ... up to the given number of workers, which
+ * shows how the throughput scales with the workers.
+ */
+#ifndef WASM_BENCH_DIR
+#define WASM_BENCH_DIR "bench"
+#endif
+
+typedef struct benchmark {
+    const char *name; /* Module <name>.wasm in the benchmark directory. */
+    i32 arg;
+    valtype_t result_type;
+    u64 result_bits;
+} benchmark_t;
+
+static const benchmark_t benchmarks[] = {
+        {"fib",           25,     VALTYPE_I32, 75025},
+        {"sieve",         100000, VALTYPE_I32, 9592},
+        {"matmul",        64,     VALTYPE_F64, 4725775742971936768ULL},
+        {"crc32",         16384,  VALTYPE_I32, 98792759},
+        {"memcpy",        64,     VALTYPE_I64, 5489076113220374894ULL},
+        {"call_indirect", 100000, VALTYPE_I32, 3353636840ULL},
+        {"br_table",      100000, VALTYPE_I32, 483254958},
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+#define MAX_WORKERS 1024
+#define MAX_SCALING_STEPS 12 /* Doubling the workers from 1 to MAX_WORKERS. */
+
+typedef struct bench_options {
+    const char *dir;
+    u32 runs;
+    double min_run_seconds; /* Calls per run are doubled until a run takes at least this long. */
+    const char *baseline; /* Contents of the baseline JSON, NULL without one. */
+    double threshold_percent;
+    u32 workers; /* Maximum number of executor workers, 1 skips the scaling measurement. */
+} bench_options_t;
+
+typedef struct scaling_step {
+    u32 workers;
+    double calls_per_second;
+} scaling_step_t;
+
+typedef struct bench_result {
+    u64 instructions; /* Per call. */
+    u32 calls_per_run;
+    double mean; /* ns per call */
+    double min;
+    double max;
+    double stddev;
+    scaling_step_t scaling[MAX_SCALING_STEPS];
+    u32 scaling_steps;
+} bench_result_t;
+
+char *prg_name;
+
+void usage() {
+    fprintf(stderr, "Usage: %s [-d benchmark dir] [-r runs] [-m min ms per run] [-b baseline.json]\n"
+                    "       [-T threshold percent] [-j max workers] [benchmark]...\n", prg_name);
+    exit(EXIT_FAILURE);
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static bool result_matches(const benchmark_t *benchmark, const return_value_t *ret) {
+    if (ret->is_void || ret->type != benchmark->result_type) {
+        return false;
+    }
+    if (ret->type == VALTYPE_I32 || ret->type == VALTYPE_F32) {
+        return (u32) ret->val.i32 == benchmark->result_bits;
+    }
+    return (u64) ret->val.i64 == benchmark->result_bits;
+}
+
+/* Times calls calls, false if one of them failed. */
+static bool time_calls(eval_state_t *instance, vec_parameter_value_t *parameters, u32 calls, double *seconds) {
+    return_value_t ret;
+    double start = now_seconds();
+    for (u32 i = 0; i < calls; i++) {
+        if (interpret_function(instance, "run", parameters, &ret) != NO_EXCEPTION) {
+            return false;
+        }
+    }
+    *seconds = now_seconds() - start;
+    return true;
+}
+
+/* Runs one batch of count calls on workers executor threads, returns an error message or NULL. */
+static const char *time_jobs(const benchmark_t *benchmark, instance_pool_t *pool, vec_parameter_value_t *parameters,
+                             job_t *jobs, u32 count, u32 workers, double *calls_per_second) {
+    executor_t *executor;
+    exception_t ex = create_executor(workers, &executor);
+    if (ex != NO_EXCEPTION) {
+        return exception_code_to_string(ex);
+    }
+    for (u32 i = 0; i < count; i++) {
+        jobs[i] = (job_t) {.pool = pool, .func_name = "run", .parameters = parameters};
+    }
+    // the first batch acquires the instances of the workers, only the second one is timed
+    executor_stats_t stats;
+    executor_run(executor, jobs, workers, &stats);
+    executor_run(executor, jobs, count, &stats);
+    free_executor(executor);
+
+    for (u32 i = 0; i < count; i++) {
+        if (jobs[i].exception != NO_EXCEPTION) {
+            return exception_code_to_string(jobs[i].exception);
+        }
+        if (!result_matches(benchmark, &jobs[i].result)) {
+            return "wrong result";
+        }
+    }
+    *calls_per_second = stats.jobs_per_second;
+    return NULL;
+}
+
+/*
+ * Times the calls on the executor with 1, 2, 4, ... up to options->workers workers. Every worker gets about as many
+ * calls as a run of the single threaded measurement, so the throughput stays comparable.
+ */
+static const char *measure_scaling(const benchmark_t *benchmark, const module_t *module,
+                                   const bench_options_t *options, vec_parameter_value_t *parameters,
+                                   bench_result_t *result) {
+    instance_pool_t *pool;
+    exception_t ex = create_instance_pool(module, &pool);
+    if (ex != NO_EXCEPTION) {
+        return exception_code_to_string(ex);
+    }
+    u32 calls = result->calls_per_run < UINT32_MAX / options->workers ? result->calls_per_run
+                                                                      : UINT32_MAX / options->workers;
+    job_t *jobs = calloc((size_t) calls * options->workers, sizeof(job_t));
+
+    const char *error = NULL;
+    for (u32 workers = 1; error == NULL && result->scaling_steps < MAX_SCALING_STEPS;) {
+        scaling_step_t *step = &result->scaling[result->scaling_steps++];
+        step->workers = workers;
+        error = time_jobs(benchmark, pool, parameters, jobs, calls * workers, workers, &step->calls_per_second);
+        if (workers == options->workers) {
+            break;
+        }
+        workers = workers * 2 < options->workers ? workers * 2 : options->workers;
+    }
+
+    free(jobs);
+    free_instance_pool(pool);
+    return error;
+}
+
+/* Returns an error message or NULL. */
+static const char *run_benchmark(const benchmark_t *benchmark, const bench_options_t *options, bench_result_t *result) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.wasm", options->dir, benchmark->name);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return strerror(errno);
+    }
+    module_t *module;
+    exception_t ex = parse(file, NULL, &module);
+    fclose(file);
+    if (ex != NO_EXCEPTION) {
+        return exception_code_to_string(ex);
+    }
+    eval_state_t *instance;
+    ex = instantiate(module, &instance);
+    if (ex != NO_EXCEPTION) {
+        free_module(module);
+        return exception_code_to_string(ex);
+    }
+
+    const char *error = NULL;
+    vec_parameter_value_t *parameters = vec_parameter_value_create();
+    vec_parameter_value_add(parameters, (parameter_value_t) {.type = VALTYPE_I32, .val.i32 = benchmark->arg});
+    double *samples = calloc(options->runs, sizeof(double));
+
+    // the counting call also warms up the instance and checks the result
+    return_value_t ret;
+    ex = interpret_function_counting(instance, "run", parameters, &ret, &result->instructions);
+    if (ex != NO_EXCEPTION) {
+        error = exception_code_to_string(ex);
+    } else if (!result_matches(benchmark, &ret)) {
+        error = "wrong result";
+    }
+
+    double seconds = 0;
+    result->calls_per_run = 1;
+    while (error == NULL && time_calls(instance, parameters, result->calls_per_run, &seconds)
+           && seconds < options->min_run_seconds && result->calls_per_run < UINT32_MAX / 2) {
+        result->calls_per_run *= 2;
+    }
+    for (u32 i = 0; error == NULL && i < options->runs; i++) {
+        if (!time_calls(instance, parameters, result->calls_per_run, &seconds)) {
+            error = "call failed";
+        }
+        samples[i] = seconds * 1e9 / result->calls_per_run;
+    }
+
+    if (error == NULL) {
+        double sum = 0;
+        result->min = INFINITY;
+        result->max = 0;
+        for (u32 i = 0; i < options->runs; i++) {
+            sum += samples[i];
+            result->min = fmin(result->min, samples[i]);
+            result->max = fmax(result->max, samples[i]);
+        }
+        result->mean = sum / options->runs;
+        double squares = 0;
+        for (u32 i = 0; i < options->runs; i++) {
+            squares += (samples[i] - result->mean) * (samples[i] - result->mean);
+        }
+        result->stddev = options->runs > 1 ? sqrt(squares / (options->runs - 1)) : 0;
+    }
+    if (error == NULL && options->workers > 1) {
+        error = measure_scaling(benchmark, module, options, parameters, result);
+    }
+
+    free(samples);
+    vec_parameter_value_free(parameters);
+    free_interpreter(instance);
+    free_module(module);
+    return error;
+}
+
+/* Finds the mean ns per call of the benchmark in a baseline written by this program. */
+static bool baseline_mean(const char *baseline, const char *name, double *mean) {
+    char key[256];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    const char *entry = strstr(baseline, key);
+    if (entry == NULL) {
+        return false;
+    }
+    // the mean belongs to this benchmark only if it comes before the next one
+    const char *next = strstr(entry + strlen(key), "\"name\": ");
+    const char *value = strstr(entry, "\"mean\": ");
+    if (value == NULL || (next != NULL && value > next)) {
+        return false;
+    }
+    *mean = strtod(value + strlen("\"mean\": "), NULL);
+    return *mean > 0;
+}
+
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    size_t length = 0, capacity = 4096;
+    char *contents = malloc(capacity);
+    size_t n;
+    while (contents != NULL && (n = fread(contents + length, 1, capacity - length - 1, file)) > 0) {
+        length += n;
+        if (capacity - length == 1) {
+            capacity *= 2;
+            char *grown = realloc(contents, capacity);
+            if (grown == NULL) {
+                free(contents);
+            }
+            contents = grown;
+        }
+    }
+    fclose(file);
+    if (contents != NULL) {
+        contents[length] = '\0';
+    }
+    return contents;
+}
+
+/* Prints the comparison with the baseline, returns whether the benchmark got slower. */
+static bool print_comparison(const bench_options_t *options, const benchmark_t *benchmark,
+                             const bench_result_t *result) {
+    double base;
+    if (!baseline_mean(options->baseline, benchmark->name, &base)) {
+        printf(",\n      \"baseline\": null");
+        return false;
+    }
+    double change = (result->mean - base) / base * 100;
+    double noise = fmax(options->threshold_percent, 2 * result->stddev / result->mean * 100);
+    const char *verdict = change > noise ? "slower" : change < -noise ? "faster" : "unchanged";
+    printf(",\n      \"baseline\": {\"ns_per_call\": %.3f, \"change_percent\": %.2f, \"verdict\": \"%s\"}", base, change,
+           verdict);
+    fprintf(stderr, "  %+.2f%% against the baseline (%s)\n", change, verdict);
+    return change > noise;
+}
+
+int main(int argc, char *argv[]) {
+    prg_name = argv[0];
+
+    bench_options_t options = {
+            .dir = WASM_BENCH_DIR,
+            .runs = 10,
+            .min_run_seconds = 0.1,
+            .baseline = NULL,
+            .threshold_percent = 5,
+            .workers = 1,
+    };
+    const char *baseline_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:r:m:b:T:j:")) != -1) {
+        switch (opt) {
+            case 'd':
+                options.dir = optarg;
+                break;
+            case 'r':
+                options.runs = strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                options.min_run_seconds = strtod(optarg, NULL) / 1000;
+                break;
+            case 'b':
+                baseline_path = optarg;
+                break;
+            case 'T':
+                options.threshold_percent = strtod(optarg, NULL);
+                break;
+            case 'j':
+                options.workers = strtoul(optarg, NULL, 10);
+                break;
+            default: /* '?' */
+                usage();
+        }
+    }
+    if (options.runs == 0 || options.workers == 0 || options.workers > MAX_WORKERS) {
+        usage();
+    }
+    if (baseline_path != NULL && (options.baseline = read_file(baseline_path)) == NULL) {
+        fprintf(stderr, "Error reading baseline %s: %s\n", baseline_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    for (int i = optind; i < argc; i++) {
+        bool known = false;
+        for (u32 j = 0; j < NUM_BENCHMARKS; j++) {
+            known |= strcmp(argv[i], benchmarks[j].name) == 0;
+        }
+        if (!known) {
+            fprintf(stderr, "Unknown benchmark %s\n", argv[i]);
+            usage();
+        }
+    }
+
+    u32 failed = 0, slower = 0;
+    bool first = true;
+    printf("{\n  \"runs\": %u,\n  \"benchmarks\": [", options.runs);
+    for (u32 i = 0; i < NUM_BENCHMARKS; i++) {
+        const benchmark_t *benchmark = &benchmarks[i];
+        bool selected = optind == argc;
+        for (int j = optind; j < argc; j++) {
+            selected |= strcmp(argv[j], benchmark->name) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+
+        bench_result_t result = {0};
+        const char *error = run_benchmark(benchmark, &options, &result);
+        printf("%s\n    {\n      \"name\": \"%s\",\n      \"arg\": %d", first ? "" : ",", benchmark->name, benchmark->arg);
+        first = false;
+        if (error != NULL) {
+            fprintf(stderr, "%s: %s\n", benchmark->name, error);
+            printf(",\n      \"error\": \"%s\"\n    }", error);
+            failed++;
+            continue;
+        }
+
+        double instructions_per_second = result.instructions / (result.mean / 1e9);
+        fprintf(stderr, "%s: %.1f ns/call +- %.2f%%, %.1f M instructions/s\n", benchmark->name, result.mean,
+                result.stddev / result.mean * 100, instructions_per_second / 1e6);
+        printf(",\n      \"calls_per_run\": %u,\n      \"instructions_per_call\": %lu,\n"
+               "      \"ns_per_call\": {\"mean\": %.3f, \"min\": %.3f, \"max\": %.3f, \"stddev\": %.3f, "
+               "\"rsd_percent\": %.3f},\n      \"instructions_per_second\": %.0f", result.calls_per_run,
+               result.instructions, result.mean, result.min, result.max, result.stddev,
+               result.stddev / result.mean * 100, instructions_per_second);
+        if (result.scaling_steps > 0) {
+            printf(",\n      \"scaling\": [");
+            for (u32 j = 0; j < result.scaling_steps; j++) {
+                const scaling_step_t *step = &result.scaling[j];
+                double speedup = step->calls_per_second / result.scaling[0].calls_per_second;
+                fprintf(stderr, "  %u workers: %.1f calls/s, %.2fx\n", step->workers, step->calls_per_second, speedup);
+                printf("%s{\"workers\": %u, \"calls_per_second\": %.1f, \"speedup\": %.3f}", j == 0 ? "" : ", ",
+                       step->workers, step->calls_per_second, speedup);
+            }
+            printf("]");
+        }
+        if (options.baseline != NULL && print_comparison(&options, benchmark, &result)) {
+            slower++;
+        }
+        printf("\n    }");
+    }
+    printf("\n  ],\n  \"failed\": %u,\n  \"slower\": %u\n}\n", failed, slower);
+
+    free((char *) options.baseline);
+    return failed == 0 && slower == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -4,72 +4,68 @@
 #include "interpreter.h"
 #include "stack.h"
 #include "strings.h"
+#include "parser.h"
 
 void eval_call(eval_state_t *eval_state, func_t *func) {
-    functype_t *ft = vec_functype_getp(eval_state->module->types, func->type);
-
-    frame_t *current = vec_frame_push(eval_state->frames, (frame_t) {
-            .instrs = func->expression.instructions,
-            .arity = vec_valtype_length(ft->t2),
-            .context = FUNCTION_CONTEXT,
-            .result_type = vec_valtype_get_or(ft->t2, 0, VALTYPE_UNKNOWN),
-    });
+    if (!atomic_load_explicit(&func->decoded, memory_order_acquire)) {
+        decode_lazy_func(eval_state->module, func);
+    }
 
-    current->locals = vec_local_entry_create();
+    functype_t *ft = vec_functype_getp(eval_state->module->types, func->type);
+    opd_stack_t *opd_stack = eval_state->opd_stack;
 
-    // Prepare locals
-    vec_valtype_iterator_t param_it = vec_valtype_iterator(ft->t1, IT_BACKWARDS);
-    while (vec_valtype_has_next(&param_it)) {
-        valtype_t type = vec_valtype_next(&param_it);
-        val_t val;
-        pop_generic_assert_type(eval_state->opd_stack, type, &val);
-        vec_local_entry_set(current->locals, vec_valtype_get_iterator_index(&param_it), (local_entry_t) {
-                .val = val,
-                .valtype = type,
-        });
+    // the arguments already on the operand stack become the first locals
+    stack_entry_t *locals = opd_stack->top - vec_valtype_length(ft->t1);
+    if ((u64) (opd_stack->limit - opd_stack->top) < (u64) func->num_locals + func->max_stack_height) {
+        THROW_EXCEPTION(EXCEPTION_INTERPRETER_CALL_STACK_EXHAUSTED);
     }
+
     vec_locals_iterator_t locals_it = vec_locals_iterator(func->locals, IT_FORWARDS);
     while (vec_locals_has_next(&locals_it)) {
-        locals_t locals = vec_locals_next(&locals_it);
-        for (u32 i = 0; i < locals.n; i++) {
-            vec_local_entry_add(current->locals, (local_entry_t) {
-                    .val = {0},
-                    .valtype = locals.t,
-            });
+        locals_t *run = vec_locals_nextp(&locals_it);
+        for (u32 i = 0; i < run->n; i++) {
+            push_generic(opd_stack, run->t, (val_t) {0});
         }
     }
 
-    push_marker_func(eval_state->opd_stack);
+    // overflowing the call stack faults on its guard page
+    instruction_t *code = vec_instruction_getp(func->code, 0);
+    frame_t *current = push_frame(eval_state->frames);
+    *current = (frame_t) {
+            .ip = code,
+            .code = code,
+            .stack_base = stack_height(opd_stack),
+            .locals = locals,
+    };
+    eval_state->locals = locals;
 }
 
-void clean_to_func_marker(eval_state_t *eval_state) {
-    frame_t *frame = peek_func_frame(eval_state->frames);
-    bool has_result = frame->arity > 0 ? true : false;
-    val_t val = {0};
-
-    if (has_result) {
-        pop_generic_assert_type(eval_state->opd_stack, frame->result_type, &val);
-    }
-
-    while (!pop_marker_func(eval_state->opd_stack));
-
-    if (has_result) {
-        push_generic(eval_state->opd_stack, frame->result_type, val);
+bool find_func_by_code(const module_t *module, const instruction_t *code, funcidx *idx) {
+    for (u32 i = 0; module->funcs != NULL && i < vec_func_length(module->funcs); i++) {
+        func_t *func = vec_func_getp(module->funcs, i);
+        // another thread may be decoding the function right now
+        if (atomic_load_explicit(&func->decoded, memory_order_acquire) && vec_instruction_length(func->code) > 0
+            && vec_instruction_getp(func->code, 0) == code) {
+            *idx = module->imported_funcs + i;
+            return true;
+        }
     }
+    return false;
 }
 
-void clean_to_label(eval_state_t *eval_state) {
-    frame_t *frame = vec_frame_peekp(eval_state->frames);
-    bool has_result = frame->arity > 0 ? true : false;
-    val_t val = {0};
-
-    if (has_result) {
-        pop_generic_assert_type(eval_state->opd_stack, frame->result_type, &val);
+bool functype_equals(functype_t *a, functype_t *b) {
+    if (vec_valtype_length(a->t1) != vec_valtype_length(b->t1) || vec_valtype_length(a->t2) != vec_valtype_length(b->t2)) {
+        return false;
     }
-
-    while (!pop_marker_label(eval_state->opd_stack));
-
-    if (has_result) {
-        push_generic(eval_state->opd_stack, frame->result_type, val);
+    for (u32 i = 0; i < vec_valtype_length(a->t1); i++) {
+        if (vec_valtype_get(a->t1, i) != vec_valtype_get(b->t1, i)) {
+            return false;
+        }
+    }
+    for (u32 i = 0; i < vec_valtype_length(a->t2); i++) {
+        if (vec_valtype_get(a->t2, i) != vec_valtype_get(b->t2, i)) {
+            return false;
+        }
     }
+    return true;
 }
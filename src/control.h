@@ -5,10 +5,11 @@
 #include "type.h"
 #include "module.h"
 
-void clean_to_func_marker(eval_state_t *eval_state);
+void eval_call(eval_state_t *eval_state, func_t *func);
 
-void clean_to_label(eval_state_t *eval_state);
+/* Finds the function whose lowered code starts at code, scans all functions so it is meant for reports. */
+bool find_func_by_code(const module_t *module, const instruction_t *code, funcidx *idx);
 
-void eval_call(eval_state_t *eval_state, func_t *func);
+bool functype_equals(functype_t *a, functype_t *b);
 
 #endif //WASM_INTERPRETER_CONTROL_H
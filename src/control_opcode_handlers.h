@@ -4,39 +4,30 @@
 #include "handler.h"
 #include "stack.h"
 
-static void eval_br(eval_state_t *eval_state, instruction_t *instr) {
-    labelidx labelidx = instr->labelidx;
-    frame_t *frame = vec_frame_getp(eval_state->frames, vec_frame_length(eval_state->frames) - labelidx - 1);
-    bool has_result = frame->arity > 0 ? true : false;
-    val_t val = {0};
-    valtype_t result_type = frame->result_type;
-
-    if (has_result) {
-        pop_generic_assert_type(eval_state->opd_stack, frame->result_type, &val);
-    }
+static void eval_br(eval_state_t *eval_state, insn_branch_t *branch, instruction_t **ip) {
+    frame_t *frame = current_frame(eval_state->frames);
+    unwind(eval_state->opd_stack, frame->stack_base + branch->height, branch->arity);
+    *ip = frame->code + branch->target;
+}
 
-    for (int32_t lbl_idx = labelidx; lbl_idx >= 0; lbl_idx--) {
-        while (!pop_marker_label_or_func(eval_state->opd_stack));
-        frame_t *current = vec_frame_peekp(eval_state->frames);
-
-        /* if we are in a loop and this is the outer level (lbl_idx = 0),
-           we want to jump back to the start (ip=0) and push the label again for
-            the next iteration, but we do not want to remove the frame */
-        if (lbl_idx == 0 && current->context == LOOP_CONTEXT) {
-            push_marker_label(eval_state->opd_stack);
-            current->ip = 0;
-        } else {
-            vec_frame_pop(eval_state->frames);
-        }
-    }
+/* The caller continues at ip after the return, a trap before the callee runs is located at the call. */
+static void call_func(eval_state_t *eval_state, func_t *func, instruction_t **ip) {
+    eval_call(eval_state, func);
+    *ip = current_frame(eval_state->frames)->ip;
+}
 
-    if (has_result) {
-        push_generic(eval_state->opd_stack, result_type, val);
+/* Function of a validated funcidx, imported functions cannot be called as imports are not linked. */
+static func_t *get_callee(eval_state_t *eval_state, funcidx idx) {
+    const module_t *module = eval_state->module;
+    if (idx < module->imported_funcs) {
+        THROW_EXCEPTION(EXCEPTION_INTERPRETER_INVALID_IMPORT);
     }
+    return vec_func_getp(module->funcs, idx - module->imported_funcs);
 }
 
 OP_HANDLER(OP_CALL) {
-    eval_call(eval_state, vec_func_getp(eval_state->module->funcs, instr->funcidx));
+    current_frame(eval_state->frames)->ip = *ip;
+    call_func(eval_state, get_callee(eval_state, instr->funcidx), ip);
 }
 
 OP_HANDLER(OP_NOP) {
@@ -47,98 +38,69 @@ OP_HANDLER(OP_UNREACHABLE) {
     THROW_EXCEPTION(EXCEPTION_INTERPRETER_REACHED_OP_UNREACHABLE);
 }
 
-OP_HANDLER(OP_BLOCK) {
-    u32 arity = instr->block.resulttype.empty ? 0 : 1;
-    push_marker_label(eval_state->opd_stack);
-    vec_frame_push(eval_state->frames, (frame_t) {
-            .instrs = instr->block.instructions,
-            .arity = arity,
-            .context = CONTROL_CONTEXT,
-            .result_type = instr->block.resulttype.type,
-    });
-}
+OP_HANDLER(OP_IF) {
+    i32 val = pop_i32(eval_state->opd_stack);
 
-OP_HANDLER(OP_BR) {
-    eval_br(eval_state, instr);
+    if (val == 0) {
+        *ip = current_frame(eval_state->frames)->code + instr->target;
+    }
 }
 
-OP_HANDLER(OP_BR_IF) {
-    i32 val = pop_i32(eval_state->opd_stack);
+OP_HANDLER(OP_ELSE) {
+    *ip = current_frame(eval_state->frames)->code + instr->target;
+}
 
-    if (val != 0) {
-        eval_br(eval_state, instr);
-    }
+OP_HANDLER(OP_BR) {
+    eval_br(eval_state, &instr->branch, ip);
 }
 
-OP_HANDLER(OP_IF) {
-    u32 arity = instr->if_block.resulttype.empty ? 0 : 1;
+OP_HANDLER(OP_BR_IF) {
     i32 val = pop_i32(eval_state->opd_stack);
-    push_marker_label(eval_state->opd_stack);
 
     if (val != 0) {
-        vec_frame_push(eval_state->frames, (frame_t) {
-                .instrs = instr->if_block.ifpath,
-                .arity = arity,
-                .context = CONTROL_CONTEXT,
-                .result_type = instr->if_block.resulttype.type,
-        });
-    } else if (instr->if_block.elsepath != NULL) {
-        vec_frame_push(eval_state->frames, (frame_t) {
-                .instrs = instr->if_block.elsepath,
-                .arity = arity,
-                .context = CONTROL_CONTEXT,
-                .result_type = instr->if_block.resulttype.type,
-        });
+        eval_br(eval_state, &instr->branch, ip);
     }
 }
 
-OP_HANDLER(OP_LOOP) {
-    u32 arity = instr->block.resulttype.empty ? 0 : 1;
-    push_marker_label(eval_state->opd_stack);
-    vec_frame_push(eval_state->frames, (frame_t) {
-            .instrs = instr->block.instructions,
-            .arity = arity,
-            .context = LOOP_CONTEXT,
-            .result_type = instr->block.resulttype.type,
-    });
-}
-
 OP_HANDLER(OP_RETURN) {
-    clean_to_func_marker(eval_state);
-
-    while (!vec_frame_empty(eval_state->frames)) {
-        frame_t frame = vec_frame_pop(eval_state->frames);
-        context_t context = frame.context;
-        if (context == FUNCTION_CONTEXT) {
-            break;
-        }
-    }
+    frame_t *frame = current_frame(eval_state->frames);
+    // drops the locals as well, the arguments were pushed by the caller
+    unwind(eval_state->opd_stack, frame->locals - eval_state->opd_stack->base, instr->branch.arity);
+    pop_frame(eval_state->frames);
+
+    // NULL once the outermost frame returns, which ends the dispatch loop
+    frame_t *caller = current_frame(eval_state->frames);
+    *ip = caller != NULL ? caller->ip : NULL;
+    eval_state->locals = caller != NULL ? caller->locals : NULL;
 }
 
 OP_HANDLER(OP_BR_TABLE) {
-    i32 index = pop_i32(eval_state->opd_stack);
-    vec_labelidx_t *labels = instr->table.labels;
-
-    if (index < vec_labelidx_length(labels)) {
-        instr->labelidx = vec_labelidx_get(labels, index);
-        eval_br(eval_state, instr);
-    } else {
-        instr->labelidx = instr->table.default_label;
-        eval_br(eval_state, instr);
-    }
+    u32 index = pop_i32(eval_state->opd_stack);
+    u32 default_index = instr->br_table_length - 1;
+
+    /* the branch entries directly follow the OP_BR_TABLE instruction */
+    instruction_t *entry = instr + 1 + (index < default_index ? index : default_index);
+    eval_br(eval_state, &entry->branch, ip);
 }
 
 OP_HANDLER(OP_CALL_INDIRECT) {
-    i32 offset = pop_i32(eval_state->opd_stack);
+    current_frame(eval_state->frames)->ip = *ip;
+    u32 offset = pop_i32(eval_state->opd_stack);
+    if (offset >= vec_table_entry_length(eval_state->table)) {
+        THROW_EXCEPTION(EXCEPTION_INTERPRETER_UNDEFINED_ELEMENT);
+    }
     table_entry_t *table_entry = vec_table_entry_getp(eval_state->table, offset);
 
     if (!table_entry->initialized) {
-        THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_UNINITIALIZED,
-                                 "call_indirect referencing uninitialized table entry");
+        THROW_EXCEPTION(EXCEPTION_INTERPRETER_UNINITIALIZED);
     }
 
-    func_t *func = vec_func_getp(eval_state->module->funcs, table_entry->funcidx);
-    eval_call(eval_state, func);
+    func_t *func = get_callee(eval_state, table_entry->funcidx);
+    if (!functype_equals(vec_functype_getp(eval_state->module->types, func->type),
+                         vec_functype_getp(eval_state->module->types, instr->typeidx))) {
+        THROW_EXCEPTION(EXCEPTION_INTERPRETER_INDIRECT_CALL_TYPE_MISMATCH);
+    }
+    call_func(eval_state, func, ip);
 }
 
 #endif // WASM_INTERPRETER_CONTROL_OPCODE_HANDLERS_H
@@ -31,30 +31,32 @@ typedef struct global_entry {
 
 CREATE_VEC(global_entry_t, global_entry)
 
-typedef struct local_entry {
-    val_t val;
+/* Operand stack slot, the type tag is only tracked for debugging since validated code never needs it. */
+typedef struct stack_entry {
+    val_t value;
+#ifdef TYPED_OPERAND_STACK
     valtype_t valtype;
-} local_entry_t;
-
-CREATE_VEC(local_entry_t, local_entry)
+#endif
+} stack_entry_t;
 
-typedef enum context {
-    FUNCTION_CONTEXT,
-    CONTROL_CONTEXT,
-    LOOP_CONTEXT
-} context_t;
+typedef struct opd_stack {
+    stack_entry_t *base;  /* First slot of the stack. */
+    stack_entry_t *top;  /* Next free slot. */
+    stack_entry_t *limit;  /* End of the allocated slots. */
+} opd_stack_t;
 
 typedef struct frame {
-    uint32_t ip;                    /* Index of the next instruction to be executed */
-    vec_instruction_t *instrs;      /* Pointer to the vector of instructions */
-    uint32_t arity;                 /* Number of result arguments (<= 1) */
-    context_t context;              /* Indicates whether this is a stack frame used for function calls,
-                                        or a control frame used for control operations, or a loop frame */
-    valtype_t result_type;          /* Type of result (if any) */
-    vec_local_entry_t *locals;          /* Array of parameters followed by local variables */
+    instruction_t *ip;              /* Next instruction, the dispatch loop only stores it on calls and traps */
+    instruction_t *code;            /* First instruction of the lowered code, branch targets are relative to it */
+    uint32_t stack_base;            /* Operand stack height on entry, above the locals */
+    stack_entry_t *locals;          /* Operand stack slots holding the parameters followed by the local variables */
 } frame_t;
 
-CREATE_VEC(frame_t, frame)
+typedef struct call_stack {
+    frame_t *base;  /* First frame. */
+    frame_t *top;  /* Next free frame, the current frame is top - 1. */
+    frame_t *limit;  /* End of the frames. */
+} call_stack_t;
 
 typedef struct table_entry {
     bool initialized;
@@ -63,41 +65,32 @@ typedef struct table_entry {
 
 CREATE_VEC(table_entry_t, table_entry)
 
-typedef enum marker {
-    MARKER_UNKNOWN = 0,
-    MARKER_LABEL = 1,              // Marker for labels.
-    MARKER_VALUE = 2,              // Marker for values.
-    MARKER_FUNCTION = 3,           // Marker for function calls.
-} marker_t;
-
-typedef struct stack_entry {
-    val_t value;
-    valtype_t valtype;
-    marker_t marker;
-} stack_entry_t;
-
-CREATE_VEC(stack_entry_t, stack_entry)
+typedef struct memory {
+    u32 max_size;  /* Maximum size in pages. */
+    u32 size;  /* Current size in pages. */
+    byte *data;
+    size_t reserved;  /* Bytes of address space mapped at data. */
+} memory_t;
 
-typedef vec_stack_entry_t opd_stack_t;
+/* Where the last failed call of an instance trapped, recorded before the stacks are unwound. */
+typedef struct trap {
+    bool located;  /* False if the call failed outside of any function, e.g. on invalid arguments. */
+    funcidx func;  /* Index of the trapping function. */
+    u32 pc;  /* Offset of the trapping instruction in the lowered code of the function. */
+} trap_t;
 
 typedef struct eval_state {
-    vec_frame_t *frames;  /* List of stack and control frames. */
+    call_stack_t *frames;  /* Call frames. */
     vec_global_entry_t *globals;  /* List of global variables. */
     vec_table_entry_t *table;  /* List of table entries. */
     vec_module_t *modules;  /* List of modules. */
     opd_stack_t *opd_stack;  /* Operand stack. */
-    module_t *module;  /* Pointer to current module */
+    const module_t *module;  /* Compiled module, only read, so it can be shared by any number of instances */
+    stack_entry_t *locals;  /* Locals of the current frame, cached from the top of the call stack. */
+    memory_t *memory;  /* Linear memory of the instance, NULL if it has none. */
+    byte *memory_data;  /* Cached memory->data, loads and stores only need this and memory_bytes. */
+    u64 memory_bytes;  /* Cached size of the memory in bytes. */
+    trap_t trap;  /* Location of the exception returned by the last interpret_function. */
 } eval_state_t;
 
-static SILENCE_UNUSED frame_t *peek_func_frame(vec_frame_t *vec) {
-    vec_frame_iterator_t it = vec_frame_iterator(vec, IT_BACKWARDS);
-    while (vec_frame_has_next(&it)) {
-        frame_t *frame = vec_frame_nextp(&it);
-        if (frame->context == FUNCTION_CONTEXT) {
-            return frame;
-        }
-    }
-    return NULL;
-}
-
 #endif //WASM_INTERPRETER_EVAL_TYPES_H
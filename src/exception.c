@@ -1,15 +1,52 @@
+#include <stdarg.h>
+#include <stdio.h>
+
 #include "exception.h"
 
 #ifndef DISABLE_EXCEPTION_HANDLING
-jmp_buf _exception_jump_buf;
-volatile _exception_data_t _exception_data = {
-        .active = false,
-        .code = NO_EXCEPTION,
-        .file = "",
-        .function = "",
-        .line = 0,
-        .message = "",
-};
+_Thread_local exception_context_t *_exception_context = NULL;
+
+static _Thread_local char exception_message[1024];
+
+static _Noreturn void unhandled(exception_t code, const char *file, const char *function, int line,
+                                const char *message) {
+    fprintf(stderr, "unhandled %s exception at %s(%s:%d): %s\n", exception_code_to_string(code), function, file, line,
+            message);
+    fflush(stderr);
+    abort();
+}
+
+void _exception_throw(exception_t code, const char *file, const char *function, int line) {
+    exception_context_t *context = _exception_context;
+    if (context == NULL) {
+        unhandled(code, file, function, line, exception_code_to_string(code));
+    }
+    context->code = code;
+    context->file = file;
+    context->function = function;
+    context->line = line;
+    context->message = NULL;
+    longjmp(context->jump_buf, 1);
+}
+
+void _exception_throw_with_msg(exception_t code, const char *file, const char *function, int line,
+                               const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(exception_message, sizeof(exception_message), format, args);
+    va_end(args);
+
+    exception_context_t *context = _exception_context;
+    if (context == NULL) {
+        unhandled(code, file, function, line, exception_message);
+    }
+    context->code = code;
+    context->file = file;
+    context->function = function;
+    context->line = line;
+    context->message = exception_message;
+    longjmp(context->jump_buf, 1);
+}
 #endif // DISABLE_EXCEPTION_HANDLING
 
 const char *exception_to_string[] = {
@@ -33,6 +70,30 @@ const char *exception_to_string[] = {
         [EXCEPTION_PARSER_UNKNOWN_SECTION_TYPE] = "parser unknown section type",
         [EXCEPTION_PARSER_UNKNOWN_MAGIC_VALUE] = "parser unknown magic value",
         [EXCEPTION_PARSER_VERSION_NOT_SUPPORTED] = "parser version not supported",
+        [EXCEPTION_PARSER_UNKNOWN_LABEL] = "parser unknown label",
+        [EXCEPTION_PARSER_FUNCTION_AND_CODE_SECTION_MISMATCH] = "parser function and code section have inconsistent lengths",
+        [EXCEPTION_PARSER_INVALID_MODULE_CACHE] = "parser invalid module cache",
+        [EXCEPTION_PARSER_READ_FAILED] = "parser read failed",
+        [EXCEPTION_PARSER_SIZE_MISMATCH] = "parser size mismatch",
+        [EXCEPTION_PARSER_SECTION_OUT_OF_ORDER] = "parser section out of order",
+
+        [EXCEPTION_VALIDATOR_TYPE_MISMATCH] = "validator type mismatch",
+        [EXCEPTION_VALIDATOR_UNKNOWN_TYPE] = "validator unknown type",
+        [EXCEPTION_VALIDATOR_UNKNOWN_FUNCTION] = "validator unknown function",
+        [EXCEPTION_VALIDATOR_UNKNOWN_TABLE] = "validator unknown table",
+        [EXCEPTION_VALIDATOR_UNKNOWN_MEMORY] = "validator unknown memory",
+        [EXCEPTION_VALIDATOR_UNKNOWN_GLOBAL] = "validator unknown global",
+        [EXCEPTION_VALIDATOR_UNKNOWN_LOCAL] = "validator unknown local",
+        [EXCEPTION_VALIDATOR_UNKNOWN_LABEL] = "validator unknown label",
+        [EXCEPTION_VALIDATOR_INVALID_ALIGNMENT] = "validator alignment must not be larger than natural",
+        [EXCEPTION_VALIDATOR_IMMUTABLE_GLOBAL] = "validator global is immutable",
+        [EXCEPTION_VALIDATOR_CONSTANT_EXPRESSION_REQUIRED] = "validator constant expression required",
+        [EXCEPTION_VALIDATOR_INVALID_RESULT_ARITY] = "validator invalid result arity",
+        [EXCEPTION_VALIDATOR_INVALID_LIMITS] = "validator invalid limits",
+        [EXCEPTION_VALIDATOR_MULTIPLE_TABLES] = "validator multiple tables",
+        [EXCEPTION_VALIDATOR_MULTIPLE_MEMORIES] = "validator multiple memories",
+        [EXCEPTION_VALIDATOR_DUPLICATE_EXPORT_NAME] = "validator duplicate export name",
+        [EXCEPTION_VALIDATOR_INVALID_START_FUNCTION] = "validator invalid start function",
 
         [EXCEPTION_INTERPRETER_ONLY_ONE_RETURN_VALUE_ALLOWED] = "interpreter only one return value allowed",
         [EXCEPTION_INTERPRETER_OPERAND_STACK_NOT_EMPTY] = "interpreter operand stack not empty",
@@ -42,9 +103,20 @@ const char *exception_to_string[] = {
         [EXCEPTION_INTERPRETER_INVALID_IMPORT] = "interpreter invalid import",
         [EXCEPTION_INTERPRETER_INVALID_INSTRUCTION] = "interpreter invalid instruction",
         [EXCEPTION_INTERPRETER_REACHED_OP_UNREACHABLE] = "interpreter reached op unreachable",
-        [EXCEPTION_INTERPRETER_UNINITIALIZED] = "interpreter uninitialized",
+        [EXCEPTION_INTERPRETER_UNINITIALIZED] = "interpreter uninitialized table element",
+        [EXCEPTION_INTERPRETER_UNDEFINED_ELEMENT] = "interpreter undefined table element",
         [EXCEPTION_INTERPRETER_MEMORY_ACCESS_OUT_OF_BOUNDS] = "interpreter memory access out of bounds",
         [EXCEPTION_INTERPRETER_NOT_FOUND] = "interpreter not found",
+        [EXCEPTION_INTERPRETER_INVALID_ARGUMENTS] = "interpreter invalid arguments",
+        [EXCEPTION_INTERPRETER_INDIRECT_CALL_TYPE_MISMATCH] = "interpreter indirect call type mismatch",
+        [EXCEPTION_INTERPRETER_CALL_STACK_EXHAUSTED] = "interpreter call stack exhausted",
+        [EXCEPTION_INTERPRETER_INVALID_SNAPSHOT] = "interpreter invalid snapshot",
+
+        [EXCEPTION_SERVER_SOCKET_FAILED] = "server socket failed",
+        [EXCEPTION_SERVER_CONNECTION_CLOSED] = "server connection closed",
+
+        [EXCEPTION_EXECUTOR_OUT_OF_MEMORY] = "executor out of memory",
+        [EXCEPTION_EXECUTOR_THREAD_FAILED] = "executor could not start a worker thread",
 };
 
 const char *exception_code_to_string(exception_t ex) {
@@ -29,6 +29,30 @@ typedef enum exception_type {
     EXCEPTION_PARSER_UNKNOWN_SECTION_TYPE,
     EXCEPTION_PARSER_UNKNOWN_MAGIC_VALUE,
     EXCEPTION_PARSER_VERSION_NOT_SUPPORTED,
+    EXCEPTION_PARSER_UNKNOWN_LABEL,
+    EXCEPTION_PARSER_FUNCTION_AND_CODE_SECTION_MISMATCH,
+    EXCEPTION_PARSER_INVALID_MODULE_CACHE,
+    EXCEPTION_PARSER_READ_FAILED,
+    EXCEPTION_PARSER_SIZE_MISMATCH,
+    EXCEPTION_PARSER_SECTION_OUT_OF_ORDER,
+
+    EXCEPTION_VALIDATOR_TYPE_MISMATCH,
+    EXCEPTION_VALIDATOR_UNKNOWN_TYPE,
+    EXCEPTION_VALIDATOR_UNKNOWN_FUNCTION,
+    EXCEPTION_VALIDATOR_UNKNOWN_TABLE,
+    EXCEPTION_VALIDATOR_UNKNOWN_MEMORY,
+    EXCEPTION_VALIDATOR_UNKNOWN_GLOBAL,
+    EXCEPTION_VALIDATOR_UNKNOWN_LOCAL,
+    EXCEPTION_VALIDATOR_UNKNOWN_LABEL,
+    EXCEPTION_VALIDATOR_INVALID_ALIGNMENT,
+    EXCEPTION_VALIDATOR_IMMUTABLE_GLOBAL,
+    EXCEPTION_VALIDATOR_CONSTANT_EXPRESSION_REQUIRED,
+    EXCEPTION_VALIDATOR_INVALID_RESULT_ARITY,
+    EXCEPTION_VALIDATOR_INVALID_LIMITS,
+    EXCEPTION_VALIDATOR_MULTIPLE_TABLES,
+    EXCEPTION_VALIDATOR_MULTIPLE_MEMORIES,
+    EXCEPTION_VALIDATOR_DUPLICATE_EXPORT_NAME,
+    EXCEPTION_VALIDATOR_INVALID_START_FUNCTION,
 
     EXCEPTION_INTERPRETER_ONLY_ONE_RETURN_VALUE_ALLOWED,
     EXCEPTION_INTERPRETER_OPERAND_STACK_NOT_EMPTY,
@@ -39,64 +63,77 @@ typedef enum exception_type {
     EXCEPTION_INTERPRETER_INVALID_INSTRUCTION,
     EXCEPTION_INTERPRETER_REACHED_OP_UNREACHABLE,
     EXCEPTION_INTERPRETER_UNINITIALIZED,
+    EXCEPTION_INTERPRETER_UNDEFINED_ELEMENT,
     EXCEPTION_INTERPRETER_MEMORY_ACCESS_OUT_OF_BOUNDS,
     EXCEPTION_INTERPRETER_NOT_FOUND,
+    EXCEPTION_INTERPRETER_INVALID_ARGUMENTS,
+    EXCEPTION_INTERPRETER_INDIRECT_CALL_TYPE_MISMATCH,
+    EXCEPTION_INTERPRETER_CALL_STACK_EXHAUSTED,
+    EXCEPTION_INTERPRETER_INVALID_SNAPSHOT,
+
+    EXCEPTION_SERVER_SOCKET_FAILED,
+    EXCEPTION_SERVER_CONNECTION_CLOSED,
+
+    EXCEPTION_EXECUTOR_OUT_OF_MEMORY,
+    EXCEPTION_EXECUTOR_THREAD_FAILED,
 } exception_t;
 
 #ifndef DISABLE_EXCEPTION_HANDLING
 
 #include <setjmp.h>
 
-typedef struct _exception_data {
-    volatile bool active;
-    volatile exception_t code;
-    volatile char file[1024];
-    volatile char function[1024];
-    volatile int line;
-    volatile char message[1024];
-} _exception_data_t;
-
-extern jmp_buf _exception_jump_buf;
-extern volatile _exception_data_t _exception_data;
+/*
+ * Every TRY_CATCH pushes a context onto a per-thread chain, so try blocks nest and every thread (e.g. one interpreter
+ * per core) traps independently. THROW_EXCEPTION only records the code and the throwing source location, nothing is
+ * copied or formatted. THROW_EXCEPTION_WITH_MSG formats its message into a per-thread buffer, it is meant for cold
+ * paths like parse and validation errors. The catch clause sees exception, file, function, line and message, message
+ * falls back to the description of the code and stays valid until the next throw on the same thread.
+ *
+ * The try clause must not be left with return, break or goto, the context would stay on the chain.
+ */
+typedef struct exception_context {
+    jmp_buf jump_buf;
+    struct exception_context *prev;  /* Enclosing try block of the same thread. */
+    exception_t code;
+    const char *file;
+    const char *function;
+    int line;
+    const char *message;  /* NULL unless thrown with THROW_EXCEPTION_WITH_MSG. */
+} exception_context_t;
+
+extern _Thread_local exception_context_t *_exception_context;
+
+_Noreturn void _exception_throw(exception_t code, const char *file, const char *function, int line);
+
+_Noreturn void _exception_throw_with_msg(exception_t code, const char *file, const char *function, int line,
+                                         const char *format, ...) __attribute__((format(printf, 5, 6)));
+
+#define THROW_EXCEPTION(exception_code) _exception_throw(exception_code, __FILE__, __func__, __LINE__)
 
 #define THROW_EXCEPTION_WITH_MSG(exception_code, ...) \
-do { \
-    if (!_exception_data.active) { \
-        fprintf(stderr, "unhandled %s exception at %s(%s:%d): ", exception_code_to_string(exception_code), __func__, __FILE__, __LINE__); \
-        fprintf(stderr, __VA_ARGS__); \
-        fprintf(stderr, "\n"); \
-        fflush(stderr); \
-        abort(); \
-    } \
-    _exception_data.active = false; \
-    _exception_data.code = exception_code; \
-    strncpy((char *) _exception_data.file, __FILE__, 1024); \
-    strncpy((char *) _exception_data.function, __func__, 1024); \
-    _exception_data.line = __LINE__; \
-    snprintf((char *) _exception_data.message, 1024, __VA_ARGS__); \
-    longjmp(_exception_jump_buf, 1); \
-} while (0)
+    _exception_throw_with_msg(exception_code, __FILE__, __func__, __LINE__, __VA_ARGS__)
 
 #define TRY_CATCH(try_clause, catch_clause) \
 {\
-    if (_exception_data.active == true) { \
-        fprintf(stderr, "ABORT - try already active"); \
-        abort(); \
-    } \
-    if (!setjmp(_exception_jump_buf)) { \
-        _exception_data.active = true; \
+    exception_context_t _exception_ctx; \
+    _exception_ctx.prev = _exception_context; \
+    _exception_context = &_exception_ctx; \
+    if (!setjmp(_exception_ctx.jump_buf)) { \
         {try_clause} \
-        _exception_data.active = false; \
+        _exception_context = _exception_ctx.prev; \
     } else { \
-        _exception_data.active = false; \
-        int exception = _exception_data.code; \
-        char* file = (char*) _exception_data.file; \
-        char* function = (char*) _exception_data.function; \
-        int line = _exception_data.line; \
+        _exception_context = _exception_ctx.prev; \
+        exception_t exception = _exception_ctx.code; \
+        const char *file = _exception_ctx.file; \
+        const char *function = _exception_ctx.function; \
+        int line = _exception_ctx.line; \
+        const char *message = _exception_ctx.message != NULL ? _exception_ctx.message \
+                                                             : exception_code_to_string(exception); \
          (void)(exception); \
          (void)(file); \
          (void)(function); \
          (void)(line); \
+         (void)(message); \
         {catch_clause} \
     } \
 }
@@ -113,9 +150,9 @@ do { \
 } while (0)
 
 #define TRY_CATCH(try_clause, catch_clause) {try_clause}
-#endif // DISABLE_EXCEPTION_HANDLING
 
 #define THROW_EXCEPTION(exception_code) THROW_EXCEPTION_WITH_MSG(exception_code, "%s", exception_code_to_string(exception_code))
+#endif // DISABLE_EXCEPTION_HANDLING
 
 const char *exception_code_to_string(exception_t ex);
 
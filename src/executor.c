@@ -0,0 +1,228 @@
+#include <time.h>
+
+#include "executor.h"
+#include "interpreter.h"
+
+#define RANGE(top, bottom) ((u64) (bottom) << 32 | (u32) (top))
+#define RANGE_TOP(range) ((u32) (range))
+#define RANGE_BOTTOM(range) ((u32) ((range) >> 32))
+
+/* Claims the last job of the own range. */
+static bool pop_job(executor_worker_t *worker, u32 *index) {
+    u64 range = atomic_load_explicit(&worker->range, memory_order_relaxed);
+    while (RANGE_TOP(range) < RANGE_BOTTOM(range)) {
+        u64 next = RANGE(RANGE_TOP(range), RANGE_BOTTOM(range) - 1);
+        if (atomic_compare_exchange_weak_explicit(&worker->range, &range, next, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+            *index = RANGE_BOTTOM(range) - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Moves the upper half of the range of another worker into the own, empty range. Stolen jobs are in no range until they
+ * are stored, so a worker which finds all ranges empty may finish although jobs are still being moved, the thief runs
+ * them. Ranges only ever split, so a range value cannot come back and fool a compare and swap.
+ */
+static bool steal_jobs(executor_worker_t *worker) {
+    executor_t *executor = worker->executor;
+    u32 self = worker - executor->workers;
+    for (u32 i = 1; i < executor->threads; i++) {
+        executor_worker_t *victim = &executor->workers[(self + i) % executor->threads];
+        u64 range = atomic_load_explicit(&victim->range, memory_order_relaxed);
+        while (RANGE_TOP(range) < RANGE_BOTTOM(range)) {
+            u32 top = RANGE_TOP(range);
+            u32 half = (RANGE_BOTTOM(range) - top + 1) / 2;
+            if (atomic_compare_exchange_weak_explicit(&victim->range, &range, RANGE(top + half, RANGE_BOTTOM(range)),
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                atomic_store_explicit(&worker->range, RANGE(top, top + half), memory_order_relaxed);
+                worker->steals++;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Returns the instance of the worker for the pool, acquiring one on first use. */
+static exception_t worker_instance(executor_worker_t *worker, instance_pool_t *pool, executor_instance_t **entry) {
+    for (u32 i = 0; i < vec_executor_instance_length(worker->instances); i++) {
+        *entry = vec_executor_instance_getp(worker->instances, i);
+        if ((*entry)->pool == pool) {
+            return NO_EXCEPTION;
+        }
+    }
+    eval_state_t *instance;
+    exception_t ex = acquire_instance(pool, &instance);
+    if (ex == NO_EXCEPTION) {
+        *entry = vec_executor_instance_add(worker->instances, (executor_instance_t) {.pool = pool, .instance = instance});
+    }
+    return ex;
+}
+
+static void drop_instance(executor_worker_t *worker, instance_pool_t *pool) {
+    for (u32 i = 0; i < vec_executor_instance_length(worker->instances); i++) {
+        executor_instance_t *entry = vec_executor_instance_getp(worker->instances, i);
+        if (entry->pool == pool) {
+            free_interpreter(entry->instance);
+            u32 last = vec_executor_instance_length(worker->instances) - 1;
+            if (i != last) {
+                *entry = vec_executor_instance_get(worker->instances, last);
+            }
+            vec_executor_instance_pop(worker->instances);
+            return;
+        }
+    }
+}
+
+static void run_job(executor_worker_t *worker, job_t *job) {
+    executor_instance_t *entry;
+    job->trap = (trap_t) {0};
+    job->exception = worker_instance(worker, job->pool, &entry);
+    if (job->exception != NO_EXCEPTION) {
+        return;
+    }
+    // remapping the memory is expensive, instances are only reset after a job which may have written them
+    if (entry->dirty) {
+        job->exception = reset_pooled_instance(job->pool, entry->instance);
+        if (job->exception != NO_EXCEPTION) {
+            // an instance which cannot be reset is replaced by a new one
+            drop_instance(worker, job->pool);
+            return;
+        }
+        entry->dirty = false;
+    }
+    job->exception = interpret_function(entry->instance, job->func_name, job->parameters, &job->result);
+    if (job->exception != NO_EXCEPTION) {
+        job->trap = entry->instance->trap;
+    }
+    entry->dirty = pool_writes_state(job->pool);
+}
+
+static void *executor_worker(void *arg) {
+    executor_worker_t *worker = arg;
+    executor_t *executor = worker->executor;
+    u64 batch = 0;
+
+    while (true) {
+        pthread_mutex_lock(&executor->lock);
+        while (!executor->stop && executor->batch == batch) {
+            pthread_cond_wait(&executor->start, &executor->lock);
+        }
+        if (executor->stop) {
+            pthread_mutex_unlock(&executor->lock);
+            return NULL;
+        }
+        batch = executor->batch;
+        job_t *jobs = executor->jobs;
+        pthread_mutex_unlock(&executor->lock);
+
+        u32 index;
+        while (pop_job(worker, &index) || (steal_jobs(worker) && pop_job(worker, &index))) {
+            run_job(worker, &jobs[index]);
+        }
+
+        pthread_mutex_lock(&executor->lock);
+        if (--executor->running == 0) {
+            pthread_cond_signal(&executor->done);
+        }
+        pthread_mutex_unlock(&executor->lock);
+    }
+}
+
+exception_t create_executor(u32 threads, executor_t **executor) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    executor_t *e = calloc(1, sizeof(executor_t));
+    executor_worker_t *workers = aligned_alloc(_Alignof(executor_worker_t), threads * sizeof(executor_worker_t));
+    if (e == NULL || workers == NULL) {
+        free(e);
+        free(workers);
+        *executor = NULL;
+        return EXCEPTION_EXECUTOR_OUT_OF_MEMORY;
+    }
+    memset(workers, 0, threads * sizeof(executor_worker_t));
+    e->workers = workers;
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->start, NULL);
+    pthread_cond_init(&e->done, NULL);
+
+    for (u32 i = 0; i < threads; i++) {
+        workers[i].executor = e;
+        workers[i].instances = vec_executor_instance_create();
+        if (pthread_create(&workers[i].thread, NULL, executor_worker, &workers[i]) != 0) {
+            vec_executor_instance_free(workers[i].instances);
+            e->threads = i;
+            free_executor(e);
+            *executor = NULL;
+            return EXCEPTION_EXECUTOR_THREAD_FAILED;
+        }
+        e->threads = i + 1;
+    }
+    *executor = e;
+    return NO_EXCEPTION;
+}
+
+void executor_run(executor_t *executor, job_t *jobs, u32 count, executor_stats_t *stats) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // contiguous shares keep the jobs of a worker (and so often of one module) together
+    u32 threads = executor->threads;
+    for (u32 i = 0; i < threads; i++) {
+        u32 top = (u32) ((u64) count * i / threads);
+        u32 bottom = (u32) ((u64) count * (i + 1) / threads);
+        atomic_store_explicit(&executor->workers[i].range, RANGE(top, bottom), memory_order_relaxed);
+        executor->workers[i].steals = 0;
+    }
+
+    // the mutex orders the ranges and jobs before the workers and the results before the caller
+    pthread_mutex_lock(&executor->lock);
+    executor->jobs = jobs;
+    executor->running = threads;
+    executor->batch++;
+    pthread_cond_broadcast(&executor->start);
+    while (executor->running > 0) {
+        pthread_cond_wait(&executor->done, &executor->lock);
+    }
+    executor->jobs = NULL;
+    pthread_mutex_unlock(&executor->lock);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *stats = (executor_stats_t) {.jobs = count};
+    for (u32 i = 0; i < count; i++) {
+        if (jobs[i].exception != NO_EXCEPTION) {
+            stats->failed++;
+        }
+    }
+    for (u32 i = 0; i < threads; i++) {
+        stats->steals += executor->workers[i].steals;
+    }
+    stats->seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+    stats->jobs_per_second = stats->seconds > 0 ? count / stats->seconds : 0;
+}
+
+void free_executor(executor_t *executor) {
+    pthread_mutex_lock(&executor->lock);
+    executor->stop = true;
+    pthread_cond_broadcast(&executor->start);
+    pthread_mutex_unlock(&executor->lock);
+
+    for (u32 i = 0; i < executor->threads; i++) {
+        executor_worker_t *worker = &executor->workers[i];
+        pthread_join(worker->thread, NULL);
+        for (u32 j = 0; j < vec_executor_instance_length(worker->instances); j++) {
+            executor_instance_t entry = vec_executor_instance_get(worker->instances, j);
+            release_instance(entry.pool, entry.instance);
+        }
+        vec_executor_instance_free(worker->instances);
+    }
+    pthread_cond_destroy(&executor->start);
+    pthread_cond_destroy(&executor->done);
+    pthread_mutex_destroy(&executor->lock);
+    free(executor->workers);
+    free(executor);
+}
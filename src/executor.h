@@ -0,0 +1,77 @@
+#ifndef WASM_INTERPRETER_EXECUTOR_H
+#define WASM_INTERPRETER_EXECUTOR_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "eval_types.h"
+#include "exception.h"
+#include "pool.h"
+
+/* One call of an export, run_jobs fills in exception, trap and result. */
+typedef struct job {
+    instance_pool_t *pool; /* Instances of the module to call. */
+    char *func_name;
+    vec_parameter_value_t *parameters;
+    exception_t exception; /* Exception of the call, e.g. a trap, NO_EXCEPTION if it returned. */
+    trap_t trap; /* Where the call trapped, for format_trap. */
+    return_value_t result;
+} job_t;
+
+typedef struct executor_stats {
+    u32 jobs;
+    u32 failed; /* Jobs with an exception. */
+    u64 steals;
+    double seconds; /* Wall clock time of the batch. */
+    double jobs_per_second;
+} executor_stats_t;
+
+typedef struct executor_instance {
+    instance_pool_t *pool;
+    eval_state_t *instance;
+    bool dirty; /* A job ran on the instance since it was acquired or reset and may have written its state. */
+} executor_instance_t;
+
+CREATE_VEC(executor_instance_t, executor_instance)
+
+typedef struct executor_worker {
+    /*
+     * Jobs the worker still owns, as indices [top, bottom) into the jobs of the batch: top in the low and bottom in the
+     * high 32 bits, so owner and thieves claim jobs with one compare and swap. The owner takes jobs from the bottom,
+     * thieves take half of them from the top. Aligned to its own cache line, it is written on every job.
+     */
+    _Alignas(64) _Atomic u64 range;
+    struct executor *executor;
+    pthread_t thread;
+    vec_executor_instance_t *instances; /* One reusable instance per module the worker has run jobs of. */
+    u64 steals;
+} executor_worker_t;
+
+/*
+ * Runs batches of jobs on a fixed set of worker threads. The jobs of a batch are split into one contiguous range per
+ * worker, a worker without jobs left steals half of the remaining range of another worker, so short and long calls
+ * balance out without a shared queue. Each worker keeps one instance per module (acquired from its pool) and resets it
+ * to the initialized state before a job if the previous job may have modified it, so results do not depend on which
+ * worker runs a job. Instances of modules which cannot write their globals or memory are never reset.
+ */
+typedef struct executor {
+    u32 threads;
+    executor_worker_t *workers;
+    pthread_mutex_t lock; /* Protects the fields below. */
+    pthread_cond_t start;
+    pthread_cond_t done;
+    u64 batch; /* Incremented for every batch, workers wait for a new one. */
+    u32 running; /* Workers which did not finish the current batch yet. */
+    bool stop;
+    job_t *jobs;
+} executor_t;
+
+exception_t create_executor(u32 threads, executor_t **executor);
+
+/* Runs all jobs and waits for them, only one batch runs at a time. */
+void executor_run(executor_t *executor, job_t *jobs, u32 count, executor_stats_t *stats);
+
+/* Stops the workers and releases their instances, so it has to be freed before the pools of the jobs. */
+void free_executor(executor_t *executor);
+
+#endif // WASM_INTERPRETER_EXECUTOR_H
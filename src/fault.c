@@ -0,0 +1,66 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fault.h"
+#include "exception.h"
+#include "memory.h"
+
+static _Thread_local eval_state_t *fault_eval_state = NULL;
+static size_t guard_size = 0;
+static pthread_once_t install_once = PTHREAD_ONCE_INIT;
+
+static bool in_guard_page(void *addr, void *limit) {
+    return (char *) addr >= (char *) limit && (char *) addr < (char *) limit + guard_size;
+}
+
+static void handle_fault(int sig, siginfo_t *info, void *context) {
+    (void) context;
+    eval_state_t *eval_state = fault_eval_state;
+
+    if (eval_state != NULL && (in_guard_page(info->si_addr, eval_state->opd_stack->limit) ||
+                               in_guard_page(info->si_addr, eval_state->frames->limit))) {
+        // SA_NODEFER keeps the signal unblocked, so it is safe to longjmp out of the handler.
+        THROW_EXCEPTION(EXCEPTION_INTERPRETER_CALL_STACK_EXHAUSTED);
+    }
+    if (eval_state != NULL && memory_reservation_contains(eval_state->memory, info->si_addr)) {
+        THROW_EXCEPTION(EXCEPTION_INTERPRETER_MEMORY_ACCESS_OUT_OF_BOUNDS);
+    }
+
+    // Not caused by the interpreter, the faulting instruction is retried with the default action.
+    signal(sig, SIG_DFL);
+}
+
+static void install() {
+    guard_size = sysconf(_SC_PAGESIZE);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handle_fault;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, NULL);
+    sigaction(SIGBUS, &action, NULL);
+}
+
+void install_fault_handler() {
+    pthread_once(&install_once, install);
+}
+
+eval_state_t *enter_fault_context(eval_state_t *eval_state) {
+    eval_state_t *previous = fault_eval_state;
+    fault_eval_state = eval_state;
+    return previous;
+}
+
+void leave_fault_context(eval_state_t *previous) {
+    fault_eval_state = previous;
+}
+
+void forget_fault_context(eval_state_t *eval_state) {
+    if (fault_eval_state == eval_state) {
+        fault_eval_state = NULL;
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef WASM_INTERPRETER_FAULT_H
+#define WASM_INTERPRETER_FAULT_H
+
+#include "eval_types.h"
+
+/*
+ * Installs a SIGSEGV/SIGBUS handler which turns accesses to the guard pages of the eval_state passed to
+ * enter_fault_context and to the guarded linear memory (see memory.h) into exceptions. Faults anywhere else keep their
+ * default behaviour. The fault context is per thread, so each thread can run its own interpreter.
+ */
+void install_fault_handler();
+
+/* Makes eval_state the fault context of the calling thread, returns the previous one for leave_fault_context. */
+eval_state_t *enter_fault_context(eval_state_t *eval_state);
+
+void leave_fault_context(eval_state_t *previous);
+
+/* Called when eval_state is freed, so no later fault on this thread looks at it. */
+void forget_fault_context(eval_state_t *eval_state);
+
+#endif // WASM_INTERPRETER_FAULT_H
@@ -1,6 +1,8 @@
 #ifndef WASM_INTERPRETER_HANDLER_H
 #define WASM_INTERPRETER_HANDLER_H
 
-#define OP_HANDLER(op) static void CAT(op, _HANDLER)(eval_state_t SILENCE_UNUSED *eval_state, SILENCE_UNUSED instruction_t *instr)
+/* ip points to the instruction pointer of the dispatch loop, already past instr, which control handlers move. */
+#define OP_HANDLER(op) static void CAT(op, _HANDLER)(eval_state_t SILENCE_UNUSED *eval_state, SILENCE_UNUSED instruction_t *instr, \
+                                                     SILENCE_UNUSED instruction_t **ip)
 
 #endif // WASM_INTERPRETER_HANDLER_H
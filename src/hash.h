@@ -0,0 +1,20 @@
+#ifndef WASM_INTERPRETER_HASH_H
+#define WASM_INTERPRETER_HASH_H
+
+#include <stddef.h>
+
+#include "value.h"
+
+#define FNV1A_64_INIT ((u64) 0xcbf29ce484222325ULL)
+#define FNV1A_64_PRIME ((u64) 0x100000001b3ULL)
+
+/* 64-bit FNV-1a, hashes can be chained by passing the previous result as hash (start with FNV1A_64_INIT). */
+static inline SILENCE_UNUSED u64 fnv1a_64(u64 hash, const void *data, size_t length) {
+    const byte *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * FNV1A_64_PRIME;
+    }
+    return hash;
+}
+
+#endif // WASM_INTERPRETER_HASH_H
@@ -4,12 +4,16 @@
 #include "import.h"
 #include "eval_types.h"
 
-func_t *find_exported_func(eval_state_t *eval_state, module_t *module, char *func_name) {
+func_t *find_exported_func(eval_state_t *eval_state, const module_t *module, char *func_name) {
     for (u32 i = 0; i < vec_export_length(module->exports); i++) {
         export_t *export = vec_export_getp(module->exports, i);
-        if (strcmp(func_name, export->name) == 0 && export->desc == EXPORTDESC_FUNC) {
-            funcidx idx = export->func;
-            return vec_func_getp(eval_state->module->funcs, idx);
+        if (name_equals_str(export->name, func_name) && export->desc == EXPORTDESC_FUNC) {
+            func_t *func = get_defined_func(eval_state->module, export->func);
+            if (func == NULL) {
+                THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_IMPORT, "export %s is an imported function",
+                                         func_name);
+            }
+            return func;
         }
     }
 
@@ -11,6 +11,7 @@ typedef enum opcode {
     OP_LOOP = 0x03,
     OP_IF = 0x04,
     OP_ELSE = 0x05,
+    OP_END = 0x0B,
     OP_BR = 0x0C,
     OP_BR_IF = 0x0D,
     OP_BR_TABLE = 0x0E,
@@ -209,6 +210,13 @@ typedef struct insn_br_table {
     labelidx default_label; // Default label to jump to when index out of bounds in labels.
 } insn_br_table_t;
 
+// Branch with a resolved target, only found in lowered code (see lower.h).
+typedef struct insn_branch {
+    u32 target; // Index of the instruction to continue with.
+    u32 height; // Operand stack height of the target label, relative to the stack base of the function.
+    u32 arity; // Number of result arguments (<= 1).
+} insn_branch_t;
+
 typedef struct memarg {
     u32 align;
     u32 offset;
@@ -220,6 +228,9 @@ typedef struct instruction {
         insn_if_t if_block; // Used by OP_IF and OP_ELSE.
         labelidx labelidx; // Used by OP_BR and OP_BR_IF.
         insn_br_table_t table; // Used by OP_TABLE.
+        insn_branch_t branch; // Used by OP_BR, OP_BR_IF, OP_RETURN and the entries following OP_BR_TABLE in lowered code.
+        u32 br_table_length; // Used by OP_BR_TABLE in lowered code, number of entries following (including default).
+        u32 target; // Used by OP_IF and OP_ELSE in lowered code.
         funcidx funcidx; // Used by OP_CALL.
         typeidx typeidx; // Used by OP_CALL_INDIRECT.
         localidx localidx; // Used BY OP_LOCAL_GET, OP_LOCAL_SET, OP_LOCAL_TEE.
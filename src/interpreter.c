@@ -14,14 +14,17 @@
 #include "table.h"
 #include "import.h"
 #include "opcode.h"
+#include "fault.h"
+#include "profile.h"
 
-static instruction_t *fetch_next_instr(eval_state_t *eval_state);
+static instruction_t *eval_next(eval_state_t *eval_state, instruction_t *ip);
 
 eval_state_t *create_interpreter() {
     eval_state_t *eval_state = calloc(sizeof(eval_state_t), 1);
 
-    eval_state->opd_stack = vec_stack_entry_create();
-    eval_state->frames = vec_frame_create();
+    eval_state->opd_stack = create_opd_stack();
+    eval_state->frames = create_call_stack();
+    install_fault_handler();
     eval_state->table = vec_table_entry_create();
     eval_state->modules = vec_module_create();
 
@@ -29,23 +32,86 @@ eval_state_t *create_interpreter() {
 }
 
 void free_interpreter(eval_state_t *eval_state) {
-    vec_stack_entry_free(eval_state->opd_stack);
-    vec_frame_free(eval_state->frames);
+    forget_fault_context(eval_state);
+    free_opd_stack(eval_state->opd_stack);
+    free_call_stack(eval_state->frames);
     vec_table_entry_free(eval_state->table);
-    // TODO: Proper cleanup.
+    vec_module_free(eval_state->modules);
+    if (eval_state->globals != NULL) {
+        vec_global_entry_free(eval_state->globals);
+    }
+    if (eval_state->memory != NULL) {
+        free_memory(eval_state->memory);
+    }
+    // the module belongs to the caller and may be shared with other instances
+    free(eval_state);
+}
+
+/* A trap can leave the stacks in any state. */
+static void reset_stacks(eval_state_t *eval_state) {
+    eval_state->opd_stack->top = eval_state->opd_stack->base;
+    eval_state->frames->top = eval_state->frames->base;
+    eval_state->locals = NULL;
+}
+
+exception_t instantiate(const module_t *module, eval_state_t **instance) {
+    eval_state_t *eval_state = create_interpreter();
+    eval_state->module = module;
+    // init_interpreter only leaves the fault context when it returns normally
+    eval_state_t *previous = enter_fault_context(eval_state);
+    TRY_CATCH({
+                  init_interpreter(eval_state);
+              }, {
+                  leave_fault_context(previous);
+                  free_interpreter(eval_state);
+                  *instance = NULL;
+                  return exception;
+              }
+    )
+    leave_fault_context(previous);
+    *instance = eval_state;
+    return NO_EXCEPTION;
 }
 
-static void
-_interpret_function(eval_state_t *eval_state, char *func_name, vec_parameter_value_t *parameters, return_value_t *ret) {
+/* Steps through the instructions of the current call one at a time and counts them. */
+static u64 eval_instrs_counting(eval_state_t *eval_state) {
+    u64 count = 0;
+    PROFILE_SEQUENCE_START();
+    frame_t *frame = current_frame(eval_state->frames);
+    for (instruction_t *ip = frame != NULL ? frame->ip : NULL; ip != NULL; count++) {
+        ip = eval_next(eval_state, ip);
+    }
+    return count;
+}
+
+static void _interpret_function(eval_state_t *eval_state, char *func_name, vec_parameter_value_t *parameters,
+                                return_value_t *ret, u64 *instructions) {
     func_t *func = find_exported_func(eval_state, eval_state->module, func_name);
+    vec_valtype_t *fun_input = vec_functype_getp(eval_state->module->types, func->type)->t1;
+
+    // the operand stack is untyped, so the arguments have to match the signature exactly
+    if (vec_parameter_value_length(parameters) != vec_valtype_length(fun_input)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_ARGUMENTS, "%s expects %u arguments, got %u",
+                                 func_name, vec_valtype_length(fun_input), vec_parameter_value_length(parameters));
+    }
+
     vec_parameter_value_iterator_t it = vec_parameter_value_iterator(parameters, IT_FORWARDS);
     while (vec_parameter_value_has_next(&it)) {
         parameter_value_t *param = vec_parameter_value_nextp(&it);
+        valtype_t expected = vec_valtype_get(fun_input, vec_parameter_value_get_iterator_index(&it));
+        if (param->type != expected) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_ARGUMENTS, "argument of type %s expected, got %s",
+                                     valtype2str(expected), valtype2str(param->type));
+        }
         push_generic(eval_state->opd_stack, param->type, param->val);
     }
 
     eval_call(eval_state, func);
-    eval_instrs(eval_state);
+    if (instructions != NULL) {
+        *instructions = eval_instrs_counting(eval_state);
+    } else {
+        eval_instrs(eval_state);
+    }
 
     ret->is_void = true;
     vec_valtype_t *fun_output = vec_functype_get(eval_state->module->types, func->type).t2;
@@ -58,22 +124,70 @@ _interpret_function(eval_state_t *eval_state, char *func_name, vec_parameter_val
     }
 
     //if the operand stack is not empty, something went wrong
-    if (!vec_stack_entry_empty(eval_state->opd_stack)) {
+    if (stack_height(eval_state->opd_stack) != 0) {
         THROW_EXCEPTION(EXCEPTION_INTERPRETER_OPERAND_STACK_NOT_EMPTY);
     }
 }
 
+/* The ip stored in the current frame already points past the trapping instruction. */
+static void record_trap(eval_state_t *eval_state) {
+    eval_state->trap = (trap_t) {0};
+    call_stack_t *frames = eval_state->frames;
+    // a call overflowing the call stack pushed its frame onto the guard page, the trap belongs to the caller
+    frame_t *frame = frames->top > frames->limit ? frames->limit - 1 : current_frame(frames);
+    if (frame == NULL || frame->ip == frame->code) {
+        return;
+    }
+    funcidx func;
+    if (find_func_by_code(eval_state->module, frame->code, &func)) {
+        eval_state->trap = (trap_t) {
+                .located = true,
+                .func = func,
+                .pc = frame->ip - frame->code - 1,
+        };
+    }
+}
+
+const char *format_trap(const trap_t *trap, exception_t exception, char *buffer, size_t size) {
+    if (trap->located) {
+        snprintf(buffer, size, "%s in function %u at pc %u", exception_code_to_string(exception), trap->func, trap->pc);
+    } else {
+        snprintf(buffer, size, "%s", exception_code_to_string(exception));
+    }
+    return buffer;
+}
+
 /* Intended to call a specific exported function */
 exception_t
 interpret_function(eval_state_t *eval_state, char *func_name, vec_parameter_value_t *parameters, return_value_t *ret) {
-    exception_t ex = NO_EXCEPTION;
+    eval_state_t *previous = enter_fault_context(eval_state);
     TRY_CATCH({
-                  _interpret_function(eval_state, func_name, parameters, ret);
+                  _interpret_function(eval_state, func_name, parameters, ret, NULL);
               }, {
-                  ex = exception;
+                  record_trap(eval_state);
+                  reset_stacks(eval_state);
+                  leave_fault_context(previous);
+                  return exception;
               }
     )
-    return ex;
+    leave_fault_context(previous);
+    return NO_EXCEPTION;
+}
+
+exception_t interpret_function_counting(eval_state_t *eval_state, char *func_name, vec_parameter_value_t *parameters,
+                                        return_value_t *ret, u64 *instructions) {
+    eval_state_t *previous = enter_fault_context(eval_state);
+    TRY_CATCH({
+                  _interpret_function(eval_state, func_name, parameters, ret, instructions);
+              }, {
+                  record_trap(eval_state);
+                  reset_stacks(eval_state);
+                  leave_fault_context(previous);
+                  return exception;
+              }
+    )
+    leave_fault_context(previous);
+    return NO_EXCEPTION;
 }
 
 void init_datas(eval_state_t *eval_state, vec_data_t *_datas) {
@@ -87,7 +201,7 @@ void init_datas(eval_state_t *eval_state, vec_data_t *_datas) {
         THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SECTION, "only one data section allowed");
     }
 
-    memory_t *memory = get_current_memory();
+    memory_t *memory = eval_state->memory;
     if (memory == NULL) {
         THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_NO_MEMORY, "trying to load data section without memory");
     }
@@ -105,15 +219,17 @@ void init_datas(eval_state_t *eval_state, vec_data_t *_datas) {
     //the result of the expression should be on the operand stack now, so we can consume it
     i32 offset = pop_i32(eval_state->opd_stack);
 
-    if (memory->size * PAGE_SIZE < offset + vec_byte_length(data.init)) {
+    if ((u64) memory->size * PAGE_SIZE < (u64) (u32) offset + data.init.length) {
         THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SECTION, "data section does not fit into memory");
     }
 
     // TODO: fix unsafe array access
-    memcpy(memory->data + offset, data.init->_elements, data.init->_length);
+    memcpy(memory->data + offset, data.init.bytes, data.init.length);
 }
 
 void init_interpreter(eval_state_t *eval_state) {
+    eval_state_t *previous = enter_fault_context(eval_state);
+
     bool hasMem = false;
     memtype_t memtype = {0};
 
@@ -122,8 +238,8 @@ void init_interpreter(eval_state_t *eval_state) {
             THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SECTION, "only one memory section supported");
         }
         memtype = vec_memtype_get(eval_state->module->mems, 0);
-        memory_t *mem = create_memory(memtype.lim.min);
-        use_memory(mem);
+        memory_t *mem = create_memory(memtype.lim);
+        use_memory(eval_state, mem);
     }
     if (eval_state->module->imports != NULL) {
         for (u32 i = 0; i < vec_import_length(eval_state->module->imports); i++) {
@@ -149,39 +265,113 @@ void init_interpreter(eval_state_t *eval_state) {
     init_datas(eval_state, eval_state->module->data);
 
     if (eval_state->module->has_start) {
-        eval_call(eval_state, vec_func_getp(eval_state->module->funcs, eval_state->module->start));
+        func_t *start = get_defined_func(eval_state->module, eval_state->module->start);
+        if (start == NULL) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_IMPORT, "start function is imported");
+        }
+        eval_call(eval_state, start);
         eval_instrs(eval_state);
     }
 
     if (eval_state->module->exports == NULL || eval_state->module->types == NULL || eval_state->module->funcs == NULL) {
         THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SECTION, "could not find all required sections");
     }
+    leave_fault_context(previous);
+}
+
+#ifdef THREADED_DISPATCH
+
+/*
+ * Direct threaded dispatch using labels as values (GCC/Clang): every handler is inlined at its own label and ends
+ * with its own indirect jump to the handler of the next instruction, which gives the branch predictor one jump site
+ * per opcode instead of a single shared one.
+ *
+ * The instruction pointer lives in a local. It is only exchanged with the frame by calls and returns, and stored
+ * before instructions that may trap (OP_MAY_TRAP), so a trap finds its location in the frame.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#ifdef __clang__
+#pragma GCC diagnostic ignored "-Winitializer-overrides"
+#else
+#pragma GCC diagnostic ignored "-Woverride-init"
+#endif
+
+#define DISPATCH() goto *dispatch_table[(instr = ip++)->opcode]
+
+#define DISPATCH_TABLE_ENTRY(op) [op] = &&CAT(handle_, op),
+
+// The conditions are constant for every op, the compiler drops them where they are false.
+#define THREADED_OP_HANDLER(op) \
+    CAT(handle_, op): \
+    if (OP_MAY_TRAP(op)) frame->ip = ip; \
+    PROFILE_ENTER(eval_state, instr); \
+    CAT(op, _HANDLER)(eval_state, instr, &ip); \
+    PROFILE_EXIT(); \
+    if ((op) == OP_CALL || (op) == OP_CALL_INDIRECT || (op) == OP_RETURN) { \
+        if (ip == NULL) return; \
+        frame = current_frame(eval_state->frames); \
+    } \
+    DISPATCH();
+
+void eval_instrs(eval_state_t *eval_state) {
+    static void *dispatch_table[256] = {
+            [0 ... 255] = &&handle_invalid,
+            FOR_EACH_OP_HANDLER(DISPATCH_TABLE_ENTRY)
+    };
+    frame_t *frame = current_frame(eval_state->frames);
+    if (frame == NULL) {
+        return;
+    }
+    instruction_t *ip = frame->ip;
+    instruction_t *instr;
+
+    PROFILE_SEQUENCE_START();
+    DISPATCH();
+
+    FOR_EACH_OP_HANDLER(THREADED_OP_HANDLER)
+
+    handle_invalid:
+    // Throws for opcodes without handler.
+    handle_instruction(eval_state, instr, &ip);
 }
 
+#undef DISPATCH
+#undef DISPATCH_TABLE_ENTRY
+#undef THREADED_OP_HANDLER
+
+#pragma GCC diagnostic pop
+
+#else
+
 void eval_instrs(eval_state_t *eval_state) {
-    for (instruction_t *instr; (instr = fetch_next_instr(eval_state)) != NULL;) {
-        eval_instr(eval_state, instr);
+    PROFILE_SEQUENCE_START();
+    frame_t *frame = current_frame(eval_state->frames);
+    for (instruction_t *ip = frame != NULL ? frame->ip : NULL; ip != NULL;) {
+        ip = eval_next(eval_state, ip);
     }
 }
 
-static instruction_t *fetch_next_instr(eval_state_t *eval_state) {
-    for (frame_t *frame; (frame = vec_frame_peekp_or(eval_state->frames, NULL)) != NULL;) {
-        //if the ip is past the last instruction - clean all but the result argument and pop the frame
-        if (frame->ip >= vec_instruction_length(frame->instrs)) {
-            if (frame->context == FUNCTION_CONTEXT) {
-                clean_to_func_marker(eval_state);
-            } else if (frame->context == CONTROL_CONTEXT || frame->context == LOOP_CONTEXT) {
-                clean_to_label(eval_state);
-            }
-            vec_frame_pop(eval_state->frames);
-            continue;
-        }
+#endif // THREADED_DISPATCH
 
-        return vec_instruction_getp(frame->instrs, frame->ip++);
+/*
+ * Runs the instruction at ip and returns the next one, NULL once the outermost frame returned. Lowered code always
+ * ends with OP_RETURN, so the ip never runs past the end.
+ */
+static instruction_t *eval_next(eval_state_t *eval_state, instruction_t *ip) {
+    instruction_t *instr = ip++;
+    if (OP_MAY_TRAP(instr->opcode)) {
+        current_frame(eval_state->frames)->ip = ip;
     }
-    return NULL;
+    PROFILE_ENTER(eval_state, instr);
+    handle_instruction(eval_state, instr, &ip);
+    PROFILE_EXIT();
+    return ip;
 }
 
 void eval_instr(eval_state_t *eval_state, instruction_t *instr) {
-    handle_instruction(eval_state, instr);
+    instruction_t *ip = instr + 1;
+    PROFILE_ENTER(eval_state, instr);
+    handle_instruction(eval_state, instr, &ip);
+    PROFILE_EXIT();
 }
@@ -7,15 +7,37 @@
 
 eval_state_t *create_interpreter();
 
+/* Throws on errors, in which case the caller restores the fault context (see fault.h), like instantiate does. */
 void init_interpreter(eval_state_t *eval_state);
 
 void free_interpreter(eval_state_t *eval_state);
 
+/*
+ * Creates an instance of a parsed module: its memory, globals, table and stacks. The module is never written, so one
+ * module can be instantiated any number of times, also concurrently from several threads.
+ */
+exception_t instantiate(const module_t *module, eval_state_t **instance);
+
 exception_t
 interpret_function(eval_state_t *eval_state, char *func_name, vec_parameter_value_t *parameters, return_value_t *ret);
 
+/*
+ * Like interpret_function, but runs the instructions one at a time without threaded dispatch and returns the number of
+ * executed (lowered) instructions, e.g. to relate benchmark timings of interpret_function to instructions.
+ */
+exception_t interpret_function_counting(eval_state_t *eval_state, char *func_name, vec_parameter_value_t *parameters,
+                                        return_value_t *ret, u64 *instructions);
+
+/*
+ * Describes an exception returned by interpret_function, including the function and lowered instruction it trapped at
+ * (the trap of the instance right after the call), e.g. "unreachable executed in function 3 at pc 12". Only formatted
+ * when asked for.
+ */
+const char *format_trap(const trap_t *trap, exception_t exception, char *buffer, size_t size);
+
 void eval_instrs(eval_state_t *eval_state);
 
+/* Evaluates an instruction outside of any function, i.e. of a constant expression, which never branches or calls. */
 void eval_instr(eval_state_t *eval_state, instruction_t *instr);
 
 #endif //WASM_INTERPRETER_INTERPRETER_H
@@ -0,0 +1,228 @@
+#include "lower.h"
+
+#include "instruction.h"
+#include "exception.h"
+
+CREATE_VEC(u32, u32)
+
+typedef struct label {
+    bool is_loop;
+    u32 start; /* Index of the first instruction of the loop body, branch target of loops */
+    u32 height; /* Operand stack height at the start of the label */
+    u32 arity;
+    vec_u32_t *fixups; /* Branch instructions waiting for the end of this label */
+} label_t;
+
+CREATE_VEC(label_t, label)
+
+typedef struct lower_state {
+    module_t *module;
+    vec_instruction_t *code;
+    vec_label_t *labels;
+    u32 height; /* Current operand stack height relative to the stack base of the function */
+} lower_state_t;
+
+static u32 emit(lower_state_t *state, instruction_t instr) {
+    vec_instruction_add(state->code, instr);
+    return vec_instruction_length(state->code) - 1;
+}
+
+static void push_label(lower_state_t *state, bool is_loop, u32 arity) {
+    vec_label_push(state->labels, (label_t) {
+            .is_loop = is_loop,
+            .start = vec_instruction_length(state->code),
+            .height = state->height,
+            .arity = arity,
+            .fixups = vec_u32_create(),
+    });
+}
+
+/* Pops the innermost label and resolves all branches to it to the given target. */
+static void pop_label(lower_state_t *state, u32 target) {
+    label_t label = vec_label_pop(state->labels);
+    vec_u32_iterator_t it = vec_u32_iterator(label.fixups, IT_FORWARDS);
+    while (vec_u32_has_next(&it)) {
+        vec_instruction_getp(state->code, vec_u32_next(&it))->branch.target = target;
+    }
+    vec_u32_free(label.fixups);
+
+    state->height = label.height + label.arity;
+}
+
+/* Resolves the label with the given index for the branch at position pos. */
+static insn_branch_t resolve_branch(lower_state_t *state, u32 pos, labelidx labelidx) {
+    if (labelidx >= vec_label_length(state->labels)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_PARSER_UNKNOWN_LABEL, "unknown label %u", labelidx);
+    }
+    label_t *label = vec_label_getp(state->labels, vec_label_length(state->labels) - labelidx - 1);
+
+    insn_branch_t branch = {
+            .height = label->height,
+            .arity = label->is_loop ? 0 : label->arity,
+    };
+
+    if (label->is_loop) {
+        branch.target = label->start;
+    } else {
+        vec_u32_add(label->fixups, pos);
+    }
+    return branch;
+}
+
+static void pop_operands(lower_state_t *state, u32 n) {
+    u32 floor = vec_label_peekp(state->labels)->height;
+    /* in unreachable code the stack is polymorphic, values below the label are never popped */
+    state->height = state->height >= floor + n ? state->height - n : floor;
+}
+
+static void push_operands(lower_state_t *state, u32 n) {
+    state->height += n;
+}
+
+/* The rest of the current label is unreachable, the operand stack becomes polymorphic. */
+static void set_unreachable(lower_state_t *state) {
+    state->height = vec_label_peekp(state->labels)->height;
+}
+
+static void apply_functype(lower_state_t *state, typeidx typeidx) {
+    functype_t *ft = vec_functype_getp(state->module->types, typeidx);
+    pop_operands(state, vec_valtype_length(ft->t1));
+    push_operands(state, vec_valtype_length(ft->t2));
+}
+
+/* Operand stack effect of all instructions which do not affect control flow. */
+static void apply_stack_effect(lower_state_t *state, instruction_t *instr) {
+    opcode_t op = instr->opcode;
+
+    if (op == OP_I32_EQZ || op == OP_I64_EQZ
+        || (op >= OP_I32_CLZ && op <= OP_I32_POPCNT)
+        || (op >= OP_I64_CLZ && op <= OP_I64_POPCNT)
+        || (op >= OP_F32_ABS && op <= OP_F32_SQRT)
+        || (op >= OP_F64_ABS && op <= OP_F64_SQRT)
+        || (op >= OP_I32_WRAP_I64 && op <= OP_F64_REINTERPRET_I64)
+        || (op >= OP_I32_LOAD && op <= OP_I64_LOAD32_U)
+        || op == OP_MEMORY_GROW || op == OP_LOCAL_TEE) {
+        pop_operands(state, 1);
+        push_operands(state, 1);
+    } else if ((op >= OP_I32_EQ && op <= OP_I32_GE_U)
+               || (op >= OP_I64_EQ && op <= OP_F64_GE)
+               || (op >= OP_I32_ADD && op <= OP_I32_ROTR)
+               || (op >= OP_I64_ADD && op <= OP_I64_ROTR)
+               || (op >= OP_F32_ADD && op <= OP_F32_COPYSIGN)
+               || (op >= OP_F64_ADD && op <= OP_F64_COPYSIGN)) {
+        pop_operands(state, 2);
+        push_operands(state, 1);
+    } else if ((op >= OP_I32_CONST && op <= OP_F64_CONST)
+               || op == OP_LOCAL_GET || op == OP_GLOBAL_GET || op == OP_MEMORY_SIZE) {
+        push_operands(state, 1);
+    } else if (op >= OP_I32_STORE && op <= OP_I64_STORE32) {
+        pop_operands(state, 2);
+    } else if (op == OP_DROP || op == OP_LOCAL_SET || op == OP_GLOBAL_SET) {
+        pop_operands(state, 1);
+    } else if (op == OP_SELECT) {
+        pop_operands(state, 3);
+        push_operands(state, 1);
+    } else if (op == OP_CALL) {
+        apply_functype(state, get_func_typeidx(state->module, instr->funcidx));
+    } else if (op == OP_CALL_INDIRECT) {
+        pop_operands(state, 1);
+        apply_functype(state, instr->typeidx);
+    }
+}
+
+static void lower_instrs(lower_state_t *state, vec_instruction_t *instrs);
+
+static void lower_instr(lower_state_t *state, instruction_t *instr) {
+    switch (instr->opcode) {
+        case OP_BLOCK:
+        case OP_LOOP:
+            push_label(state, instr->opcode == OP_LOOP, instr->block.resulttype.empty ? 0 : 1);
+            lower_instrs(state, instr->block.instructions);
+            pop_label(state, vec_instruction_length(state->code));
+            break;
+        case OP_IF: {
+            pop_operands(state, 1);
+            u32 start = emit(state, (instruction_t) {.opcode = OP_IF});
+            push_label(state, false, instr->if_block.resulttype.empty ? 0 : 1);
+            lower_instrs(state, instr->if_block.ifpath);
+            if (instr->if_block.elsepath != NULL) {
+                u32 else_pos = emit(state, (instruction_t) {.opcode = OP_ELSE});
+                vec_instruction_getp(state->code, start)->target = else_pos + 1;
+                state->height = vec_label_peekp(state->labels)->height;
+                lower_instrs(state, instr->if_block.elsepath);
+                start = else_pos;
+            }
+            vec_instruction_getp(state->code, start)->target = vec_instruction_length(state->code);
+            pop_label(state, vec_instruction_length(state->code));
+            break;
+        }
+        case OP_BR:
+        case OP_BR_IF: {
+            if (instr->opcode == OP_BR_IF) {
+                pop_operands(state, 1);
+            }
+            u32 pos = emit(state, (instruction_t) {.opcode = instr->opcode});
+            insn_branch_t branch = resolve_branch(state, pos, instr->labelidx);
+            vec_instruction_getp(state->code, pos)->branch = branch;
+            if (instr->opcode == OP_BR) {
+                set_unreachable(state);
+            }
+            break;
+        }
+        case OP_BR_TABLE: {
+            pop_operands(state, 1);
+            u32 length = vec_labelidx_length(instr->table.labels) + 1;
+            emit(state, (instruction_t) {.opcode = OP_BR_TABLE, .br_table_length = length});
+            for (u32 i = 0; i < length; i++) {
+                labelidx labelidx = i < length - 1 ? vec_labelidx_get(instr->table.labels, i)
+                                                   : instr->table.default_label;
+                u32 pos = emit(state, (instruction_t) {.opcode = OP_BR});
+                insn_branch_t branch = resolve_branch(state, pos, labelidx);
+                vec_instruction_getp(state->code, pos)->branch = branch;
+            }
+            set_unreachable(state);
+            break;
+        }
+        case OP_RETURN: {
+            /* the function label is always at the bottom of the label stack */
+            label_t *label = vec_label_getp(state->labels, 0);
+            emit(state, (instruction_t) {.opcode = OP_RETURN, .branch = {.height = 0, .arity = label->arity}});
+            set_unreachable(state);
+            break;
+        }
+        case OP_UNREACHABLE:
+            emit(state, *instr);
+            set_unreachable(state);
+            break;
+        default:
+            apply_stack_effect(state, instr);
+            emit(state, *instr);
+    }
+}
+
+static void lower_instrs(lower_state_t *state, vec_instruction_t *instrs) {
+    vec_instruction_iterator_t it = vec_instruction_iterator(instrs, IT_FORWARDS);
+    while (vec_instruction_has_next(&it)) {
+        lower_instr(state, vec_instruction_nextp(&it));
+    }
+}
+
+void lower_func(module_t *module, func_t *func) {
+    functype_t *ft = vec_functype_getp(module->types, func->type);
+    u32 arity = vec_valtype_length(ft->t2);
+
+    lower_state_t state = {
+            .module = module,
+            .code = vec_instruction_create(),
+            .labels = vec_label_create(),
+            .height = 0,
+    };
+
+    push_label(&state, false, arity);
+    lower_instrs(&state, func->expression.instructions);
+    pop_label(&state, vec_instruction_length(state.code));
+    emit(&state, (instruction_t) {.opcode = OP_RETURN, .branch = {.height = 0, .arity = arity}});
+
+    vec_label_free(state.labels);
+    func->code = state.code;
+}
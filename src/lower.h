@@ -0,0 +1,23 @@
+#ifndef WASM_INTERPRETER_LOWER_H
+#define WASM_INTERPRETER_LOWER_H
+
+#include "module.h"
+
+/*
+ * Lowering turns the nested instruction tree of a validated function body (see validator.h) into one contiguous
+ * instruction vector:
+ *
+ * - Blocks and loops emit no instructions, labels only exist while lowering.
+ * - OP_IF jumps to instr->target (the else path or the end of the if) if the condition is zero.
+ * - OP_ELSE terminates the if path and jumps to instr->target (the end of the if).
+ * - OP_BR and OP_BR_IF carry an insn_branch_t with an absolute target index and the operand stack
+ *   height of the target label, so branching is a truncation of the operand stack to that height.
+ * - OP_BR_TABLE is followed by instr->br_table_length branch entries, the last one is the default label.
+ * - OP_RETURN carries an insn_branch_t with the arity of the function.
+ * - The body is terminated by OP_RETURN, branches to the function label jump there.
+ *
+ * lower_func only reads the rest of the module, functions can be lowered concurrently.
+ */
+void lower_func(module_t *module, func_t *func);
+
+#endif // WASM_INTERPRETER_LOWER_H
@@ -8,33 +8,40 @@
 #include "interpreter.h"
 #include "memory.h"
 #include "variable.h"
+#include "snapshot.h"
+#include "module_cache.h"
+#include "hash.h"
+#include "batch.h"
+#include "server.h"
+#include "executor.h"
 
 char *prg_name;
 
 void usage() {
-    fprintf(stderr, "Usage: %s <-p name> <-f name> [-a type:value]...\n", prg_name);
+    fprintf(stderr, "Usage: %s <-p name|-> <-f name> [-a type:value]... [-c module cache] [-s snapshot]\n"
+                    "       [-t parser threads] [-l] [-n calls] [-j call threads]\n"
+                    "       %s -b <script|-> [-t parser threads] [-l]\n"
+                    "       %s -L socket <-p name|-> [-c module cache] [-t parser threads] [-l]\n"
+                    "       %s -C socket <-f name> [-a type:value]...\n", prg_name, prg_name, prg_name, prg_name);
     exit(EXIT_FAILURE);
 }
 
 void parse_arg(char *str, parameter_value_t *param) {
-    char *type_str = strtok(str, ":");
-    char *value_str = strtok(NULL, ":");
-    if (strcmp(type_str, "i32") == 0) {
-        param->type = VALTYPE_I32;
-        param->val.i32 = (i32) strtoul(value_str, NULL, 10);
-    } else if (strcmp(type_str, "i64") == 0) {
-        param->type = VALTYPE_I64;
-        param->val.i64 = (i64) strtoul(value_str, NULL, 10);
-    } else if (strcmp(type_str, "f32") == 0) {
-        param->type = VALTYPE_F32;
-        param->val.i32 = strtoul(value_str, NULL, 10);
-    } else if (strcmp(type_str, "f64") == 0) {
-        param->type = VALTYPE_F64;
-        param->val.i64 = strtoul(value_str, NULL, 10);
-    } else {
-        fprintf(stderr, "Unknown parameter type %s\n", type_str);
+    if (!parse_value(str, param)) {
+        fprintf(stderr, "Unknown parameter type %s\n", str);
     }
+}
 
+/* Identifies the module in module caches and snapshots. */
+static u64 hash_module_file(FILE *file) {
+    u64 hash = FNV1A_64_INIT;
+    byte buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        hash = fnv1a_64(hash, buffer, n);
+    }
+    rewind(file);
+    return hash;
 }
 
 int main(int argc, char *argv[]) {
@@ -45,8 +52,17 @@ int main(int argc, char *argv[]) {
 
     char *module_path = NULL;
     char *function = NULL;
+    char *cache_path = NULL;
+    char *snapshot_path = NULL;
+    char *batch_path = NULL;
+    char *listen_path = NULL;
+    char *connect_path = NULL;
+    u32 calls = 1;
+    u32 call_threads = 1;
+    parse_options_t parse_options = {.threads = 0, .lazy = false};
+    exception_t ex = NO_EXCEPTION;
     int opt;
-    while ((opt = getopt(argc, argv, "p:f:a:")) != -1) {
+    while ((opt = getopt(argc, argv, "p:f:a:c:s:t:lb:L:C:n:j:")) != -1) {
         switch (opt) {
             case 'p':
                 if (module_path != NULL) {
@@ -64,6 +80,33 @@ int main(int argc, char *argv[]) {
                 parse_arg(strdup(optarg), &a);
                 vec_parameter_value_add(parameters, a);
                 break;
+            case 'c':
+                cache_path = strdup(optarg);
+                break;
+            case 's':
+                snapshot_path = strdup(optarg);
+                break;
+            case 't':
+                parse_options.threads = strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                parse_options.lazy = true;
+                break;
+            case 'b':
+                batch_path = strdup(optarg);
+                break;
+            case 'L':
+                listen_path = strdup(optarg);
+                break;
+            case 'C':
+                connect_path = strdup(optarg);
+                break;
+            case 'n':
+                calls = strtoul(optarg, NULL, 10);
+                break;
+            case 'j':
+                call_threads = strtoul(optarg, NULL, 10);
+                break;
             default: /* '?' */
                 usage();
         }
@@ -73,54 +116,160 @@ int main(int argc, char *argv[]) {
         usage();
     }
 
-    FILE *input = fopen(module_path, "r");
-    if (input == NULL) {
-        fprintf(stderr, "Error opening input file %s: %s", module_path, strerror(errno));
-        exit(EXIT_FAILURE);
+    // a batch script names its own modules and calls (see batch.h)
+    if (batch_path != NULL) {
+        if (module_path != NULL || function != NULL || vec_parameter_value_length(parameters) > 0 || cache_path != NULL
+            || snapshot_path != NULL || listen_path != NULL || connect_path != NULL) {
+            usage();
+        }
+        FILE *script = strcmp(batch_path, "-") == 0 ? stdin : fopen(batch_path, "r");
+        if (script == NULL) {
+            fprintf(stderr, "Error opening batch script %s: %s", batch_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        return run_batch(script, stdout, &parse_options) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // the client only sends the call, the server has the module
+    if (connect_path != NULL) {
+        if (module_path != NULL || function == NULL || cache_path != NULL || snapshot_path != NULL
+            || listen_path != NULL) {
+            usage();
+        }
+        int fd;
+        return_value_t ret;
+        ex = connect_server(connect_path, &fd);
+        if (ex == NO_EXCEPTION) {
+            ex = server_call(fd, function, parameters, &ret);
+            close(fd);
+        }
+        if (ex > 0) {
+            fprintf(stderr, "error interpreting: %s", exception_code_to_string(ex));
+            exit(1);
+        }
+        print_return_value(stdout, &ret);
+        return 0;
+    }
+
+    if (module_path == NULL || (function == NULL) == (listen_path == NULL)
+        || (listen_path != NULL && (vec_parameter_value_length(parameters) > 0 || snapshot_path != NULL))
+        || calls == 0 || call_threads == 0 || ((calls > 1 || call_threads > 1) && snapshot_path != NULL)) {
+        usage();
     }
 
     module_t *module = NULL;
-    exception_t ex = parse(input, &module);
-    if (ex > 0) {
-        fprintf(stderr, "error parsing file: %s", exception_code_to_string(ex));
+    u64 module_key = 0;
+
+    if (strcmp(module_path, "-") == 0) {
+        // the module is decoded while it arrives, its key is only known afterwards, so no module cache is loaded
+        ex = parse_fd(STDIN_FILENO, &parse_options, &module);
+        if (ex > 0) {
+            fprintf(stderr, "error parsing file: %s", exception_code_to_string(ex));
+            exit(1);
+        }
+        module_key = fnv1a_64(FNV1A_64_INIT, module->binary, module->binary_size);
+        if (cache_path != NULL && write_module_cache(module, module_key, cache_path) != NO_EXCEPTION) {
+            fprintf(stderr, "warning: could not write module cache %s\n", cache_path);
+        }
+    } else {
+        FILE *input = fopen(module_path, "r");
+        if (input == NULL) {
+            fprintf(stderr, "Error opening input file %s: %s", module_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        module_key = cache_path != NULL || snapshot_path != NULL ? hash_module_file(input) : 0;
+
+        // with a module cache the module is only parsed if there is no usable cache yet, which is then written
+        if (cache_path == NULL || load_module_cache(module_key, cache_path, &module) != NO_EXCEPTION) {
+            ex = parse(input, &parse_options, &module);
+            if (ex > 0) {
+                fprintf(stderr, "error parsing file: %s", exception_code_to_string(ex));
+                exit(1);
+            }
+            if (cache_path != NULL && write_module_cache(module, module_key, cache_path) != NO_EXCEPTION) {
+                fprintf(stderr, "warning: could not write module cache %s\n", cache_path);
+            }
+        }
+        fclose(input);
+    }
+
+    if (listen_path != NULL) {
+        ex = run_server(module, listen_path);
+        fprintf(stderr, "error serving %s: %s", listen_path, exception_code_to_string(ex));
         exit(1);
     }
-    fclose(input);
 
-    eval_state_t *interpreter = create_interpreter();
-    interpreter->module = module;
-    init_interpreter(interpreter);
+    // repeated calls are spread over the threads of an executor, the first result is printed like a single call's
+    if (calls > 1 || call_threads > 1) {
+        instance_pool_t *pool;
+        executor_t *executor;
+        ex = create_instance_pool(module, &pool);
+        if (ex > 0) {
+            fprintf(stderr, "error instantiating module: %s", exception_code_to_string(ex));
+            exit(1);
+        }
+        ex = create_executor(call_threads, &executor);
+        if (ex > 0) {
+            fprintf(stderr, "error creating executor: %s\n", exception_code_to_string(ex));
+            exit(1);
+        }
+        job_t *jobs = malloc(calls * sizeof(job_t));
+        for (u32 i = 0; i < calls; i++) {
+            jobs[i] = (job_t) {.pool = pool, .func_name = function, .parameters = parameters};
+        }
+        executor_stats_t stats;
+        executor_run(executor, jobs, calls, &stats);
+        fprintf(stderr, "calls %u failed %u steals %lu seconds %.6f calls/s %.0f\n", stats.jobs, stats.failed,
+                stats.steals, stats.seconds, stats.jobs_per_second);
+
+        // calls of one export on reset instances usually fail alike, only the first failure is reported
+        for (u32 i = 0; i < calls; i++) {
+            if (jobs[i].exception != NO_EXCEPTION) {
+                char error[256];
+                fprintf(stderr, "error interpreting call %u: %s\n", i,
+                        format_trap(&jobs[i].trap, jobs[i].exception, error, sizeof(error)));
+                break;
+            }
+        }
+        ex = jobs[0].exception;
+        return_value_t ret = jobs[0].result;
+        free(jobs);
+        free_executor(executor);
+        free_instance_pool(pool);
+        free_module(module);
+        if (ex > 0) {
+            exit(1);
+        }
+        print_return_value(stdout, &ret);
+        return stats.failed == 0 ? 0 : 1;
+    }
+
+    // with a snapshot initialization only runs if there is no usable snapshot yet, which is then written
+    eval_state_t *interpreter = NULL;
+    if (snapshot_path == NULL || instantiate_snapshot(module, module_key, snapshot_path, &interpreter) != NO_EXCEPTION) {
+        ex = instantiate(module, &interpreter);
+        if (ex > 0) {
+            fprintf(stderr, "error instantiating module: %s", exception_code_to_string(ex));
+            exit(1);
+        }
+        if (snapshot_path != NULL && write_snapshot(interpreter, module_key, snapshot_path) != NO_EXCEPTION) {
+            fprintf(stderr, "warning: could not write snapshot %s\n", snapshot_path);
+        }
+    }
 
     return_value_t ret;
     ex = interpret_function(interpreter, function, parameters, &ret);
     if (ex > 0) {
-        fprintf(stderr, "error interpreting: %s", exception_code_to_string(ex));
+        char error[256];
+        fprintf(stderr, "error interpreting: %s", format_trap(&interpreter->trap, ex, error, sizeof(error)));
         exit(1);
     }
 
-    if (ret.is_void) {
-        printf("void");
-    } else {
-        switch (ret.type) {
-            case VALTYPE_I32:
-                printf("i32:%u", ret.val.i32);
-                break;
-            case VALTYPE_I64:
-                printf("i64:%lu", ret.val.i64);
-                break;
-            case VALTYPE_F32:
-                printf("f32:%u", ret.val.i32);
-                break;
-            case VALTYPE_F64:
-                printf("f64:%lu", ret.val.i64);
-                break;
-            default:
-                fprintf(stderr, "unknown return valtype");
-                exit(1);
-        }
-    }
+    print_return_value(stdout, &ret);
 
     free_interpreter(interpreter);
+    free_module(module);
 
     return 0;
 }
@@ -1,32 +1,162 @@
+#define _GNU_SOURCE // mremap, memfd_create
+
+#include <stdint.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "memory.h"
 
-static memory_t *memory = NULL;
+/* Maps reserved bytes of inaccessible address space, returns NULL on failure. */
+static byte *reserve(size_t reserved) {
+    byte *data = mmap(NULL, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return data == MAP_FAILED ? NULL : data;
+}
 
-memory_t *create_memory(i32 size) {
-    memory_t *m = malloc(sizeof(memory_t));
-    m->size = size;
-    m->data = malloc(sizeof(byte) * size * PAGE_SIZE);
+/* Makes the pages [from, to) of the reservation accessible, the kernel only commits them once touched. */
+static bool commit(memory_t *m, u32 from, u32 to) {
+    if (from == to) {
+        return true;
+    }
+    return mprotect(m->data + (size_t) from * PAGE_SIZE, (size_t) (to - from) * PAGE_SIZE,
+                    PROT_READ | PROT_WRITE) == 0;
+}
+
+/* Makes sure at least bytes of address space are mapped at m->data, possibly moving the mapping. */
+static bool ensure_reserved(memory_t *m, size_t bytes) {
+    if (bytes <= m->reserved) {
+        return true;
+    }
+#ifdef __linux__
+    // the pages are moved by remapping them, the contents are never copied
+    byte *data = mremap(m->data, m->reserved, bytes, MREMAP_MAYMOVE);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    m->data = data;
+    m->reserved = bytes;
+    return true;
+#else
+    return false;
+#endif
+}
+
+memory_t *create_memory(limits_t lim) {
+    memory_t *m = calloc(sizeof(memory_t), 1);
+    m->size = lim.min;
+    m->max_size = lim.has_max ? lim.max : MAX_MEMORY_PAGES;
+
+#ifdef GUARD_PAGE_MEMORY
+    m->reserved = MEMORY_RESERVATION;
+    m->data = reserve(m->reserved);
+#else
+    // reserving up to the maximum lets memory.grow work in place, but may fail for large maxima on small hosts
+    u64 max_bytes = (u64) (m->max_size > 0 ? m->max_size : 1) * PAGE_SIZE;
+    if (max_bytes <= SIZE_MAX) {
+        m->reserved = max_bytes;
+        m->data = reserve(m->reserved);
+    }
+    if (m->data == NULL) {
+        m->reserved = (size_t) (m->size > 0 ? m->size : 1) * PAGE_SIZE;
+        m->data = reserve(m->reserved);
+    }
+#endif
+    if (m->data == NULL) {
+        free(m);
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_MEMORY, "could not reserve linear memory");
+    }
+    if (!commit(m, 0, m->size)) {
+        free_memory(m);
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_MEMORY, "could not commit %u pages", lim.min);
+    }
     return m;
 }
 
-void use_memory(memory_t *m) {
-    memory = m;
+i32 grow_memory(eval_state_t *eval_state, u32 delta) {
+    memory_t *m = eval_state->memory;
+    u32 old_size = m->size;
+    if (delta > m->max_size - old_size) {
+        return -1;
+    }
+    u32 new_size = old_size + delta;
+
+    if (!ensure_reserved(m, (size_t) new_size * PAGE_SIZE) || !commit(m, old_size, new_size)) {
+        return -1;
+    }
+    m->size = new_size;
+    use_memory(eval_state, m);
+    return (i32) old_size;
+}
+
+void use_memory(eval_state_t *eval_state, memory_t *m) {
+    eval_state->memory = m;
+    eval_state->memory_data = m != NULL ? m->data : NULL;
+    eval_state->memory_bytes = m != NULL ? (u64) m->size * PAGE_SIZE : 0;
+}
+
+bool memory_reservation_contains(memory_t *m, void *addr) {
+#ifdef GUARD_PAGE_MEMORY
+    return m != NULL && m->data != NULL && (byte *) addr >= m->data && (byte *) addr < m->data + m->reserved;
+#else
+    (void) m;
+    (void) addr;
+    return false;
+#endif
+}
+
+int snapshot_memory(memory_t *m) {
+    int fd = memfd_create("wasm-memory", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    size_t bytes = (size_t) m->size * PAGE_SIZE;
+    if (ftruncate(fd, bytes) != 0) {
+        close(fd);
+        return -1;
+    }
+    for (size_t written = 0; written < bytes;) {
+        ssize_t n = write(fd, m->data + written, bytes - written);
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+        written += n;
+    }
+    return fd;
 }
 
-memory_t *get_current_memory() {
-    return memory;
+bool restore_memory(eval_state_t *eval_state, memory_t *m, int fd, off_t offset, u32 size) {
+    size_t bytes = (size_t) size * PAGE_SIZE;
+    size_t current_bytes = (size_t) m->size * PAGE_SIZE;
+
+    if (!ensure_reserved(m, bytes)) {
+        return false;
+    }
+    // MAP_FIXED atomically replaces the old pages, dirty private pages are dropped and reads share the page cache
+    if (bytes > 0 && mmap(m->data, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) == MAP_FAILED) {
+        return false;
+    }
+    // pages grown after the snapshot are discarded and become inaccessible again
+    if (current_bytes > bytes &&
+        mmap(m->data + bytes, current_bytes - bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+             -1, 0) == MAP_FAILED) {
+        return false;
+    }
+    m->size = size;
+    use_memory(eval_state, m);
+    return true;
 }
 
 void free_memory(memory_t *m) {
     if (m->data != NULL) {
-        free(m->data);
+        munmap(m->data, m->reserved);
     }
     free(m);
 }
 
-void init_memory(eval_state_t SILENCE_UNUSED *eval_state, memtype_t mem) {
+void init_memory(eval_state_t *eval_state, memtype_t mem) {
+    memory_t *memory = eval_state->memory;
+
     if (memory == NULL) {
         THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_NO_MEMORY, "this module needs memory");
     }
@@ -1,23 +1,46 @@
 #ifndef WASM_INTERPRETER_MEMORY_H
 #define WASM_INTERPRETER_MEMORY_H
 
+#include <sys/types.h>
+
 #include "value.h"
 #include "instruction.h"
 #include "interpreter.h"
 
 #define PAGE_SIZE (65536)
-
-typedef struct memory {
-    i32 max_size;
-    i32 size;
-    byte *data;
-} memory_t;
-
-memory_t *create_memory(i32 max_size);
-
-void use_memory(memory_t *m);
-
-memory_t *get_current_memory();
+#define MAX_MEMORY_PAGES (65536)
+
+/*
+ * With GUARD_PAGE_MEMORY (64-bit hosts only) the data of a memory is the start of a PROT_NONE reservation which covers
+ * every effective address a load or store can form: a u32 address plus a u32 offset, i.e. 8 GiB. Only the pages of the
+ * current size are accessible, so an out of bounds access faults and the fault handler (see fault.h) turns it into
+ * EXCEPTION_INTERPRETER_MEMORY_ACCESS_OUT_OF_BOUNDS, loads and stores need no bounds check. Without it accesses are
+ * checked explicitly and the reservation only covers the maximum size.
+ *
+ * memory.grow never copies: it makes further pages of the reservation accessible. If the maximum size could not be
+ * reserved, the mapping is enlarged with mremap, which may move it but does not copy the pages.
+ */
+#define MEMORY_RESERVATION ((size_t) 1 << 33)
+
+memory_t *create_memory(limits_t lim);
+
+/* Grows the memory by delta pages, returns the previous size in pages or -1 if the memory cannot grow. */
+i32 grow_memory(eval_state_t *eval_state, u32 delta);
+
+/* Makes m the memory of the instance and refreshes the cached data pointer and size in eval_state. */
+void use_memory(eval_state_t *eval_state, memory_t *m);
+
+/* Whether addr lies in the guarded reservation of m, always false without GUARD_PAGE_MEMORY. */
+bool memory_reservation_contains(memory_t *m, void *addr);
+
+/* Copies the contents of m into a new memfd, returns its descriptor or -1. */
+int snapshot_memory(memory_t *m);
+
+/*
+ * Maps size pages of fd starting at offset (a multiple of PAGE_SIZE) copy-on-write over m, discarding all changes
+ * since, and makes m the memory of the instance. Returns false if the mapping failed.
+ */
+bool restore_memory(eval_state_t *eval_state, memory_t *m, int fd, off_t offset, u32 size);
 
 void free_memory(memory_t *m);
 
@@ -1,6 +1,8 @@
 #ifndef WASM_INTERPRETER_MEMORY_OPCODE_HANDLERS_H
 #define WASM_INTERPRETER_MEMORY_OPCODE_HANDLERS_H
 
+#include <string.h>
+
 #include "type.h"
 #include "instruction.h"
 #include "interpreter.h"
@@ -11,47 +13,39 @@
 #include "util.h"
 #include "strings.h"
 
-static i32 calculate_address(eval_state_t *eval_state, instruction_t *instr, i32 bit_width) {
-    i32 a = pop_i32(eval_state->opd_stack);
-    i32 ea = a + instr->memarg.offset;
-    if ((ea + bit_width / 8) > (get_current_memory()->size * PAGE_SIZE)) {
+/*
+ * Effective addresses are computed in 64 bits, so address + offset cannot wrap around. The module is validated, so it
+ * has a memory.
+ */
+static byte *effective_address(eval_state_t *eval_state, instruction_t *instr, u32 width) {
+    u64 ea = (u64) (u32) pop_i32(eval_state->opd_stack) + instr->memarg.offset;
+#ifdef GUARD_PAGE_MEMORY
+    // accesses beyond the size fault on the reservation, see memory.h
+    (void) width;
+#else
+    if (ea + width > eval_state->memory_bytes) {
         THROW_EXCEPTION(EXCEPTION_INTERPRETER_MEMORY_ACCESS_OUT_OF_BOUNDS);
     }
-    return ea;
+#endif
+    return eval_state->memory_data + ea;
 }
 
 #define LOAD_INSN(eval_state, srctype, targettype) \
-    if (get_current_memory() == NULL) { \
-        THROW_EXCEPTION(EXCEPTION_INTERPRETER_NO_MEMORY); \
-    } \
-    i32 ea = calculate_address(eval_state, instr, sizeof(srctype) * 8); \
-    srctype value = *((srctype *) (get_current_memory()->data + ea)); \
+    srctype value; \
+    memcpy(&value, effective_address(eval_state, instr, sizeof(srctype)), sizeof(srctype)); \
     CAT(push_, targettype)(eval_state->opd_stack, (targettype) value)
 
 #define FLOAT_LOAD_INSN(eval_state, type) \
-    if (get_current_memory() == NULL) { \
-        THROW_EXCEPTION(EXCEPTION_INTERPRETER_NO_MEMORY); \
-    } \
-    i32 ea = calculate_address(eval_state, instr, sizeof(type) * 8); \
-    type value = *((type *) (get_current_memory()->data + ea)); \
-    CAT(push_, type)(eval_state->opd_stack, value)
+    LOAD_INSN(eval_state, type, type)
 
 #define STORE_INSN(eval_state, srctype, intermediatetype, targettype) \
-    if (get_current_memory() == NULL) { \
-        THROW_EXCEPTION(EXCEPTION_INTERPRETER_NO_MEMORY); \
-    } \
     srctype value = CAT(pop_, srctype)(eval_state->opd_stack); \
-    intermediatetype v = (intermediatetype) value; \
-    i32 ea = calculate_address(eval_state, instr, sizeof(targettype) * 8); \
-    *((targettype *) (get_current_memory()->data + ea)) = (targettype) (v & BIT_MASK(intermediatetype, sizeof(targettype) * 8))
+    targettype v = (targettype) ((intermediatetype) value & BIT_MASK(intermediatetype, sizeof(targettype) * 8)); \
+    memcpy(effective_address(eval_state, instr, sizeof(targettype)), &v, sizeof(targettype))
 
 #define FLOAT_STORE_INSN(eval_state, type) \
-    if (get_current_memory() == NULL) { \
-        THROW_EXCEPTION(EXCEPTION_INTERPRETER_NO_MEMORY); \
-    } \
     type value = CAT(pop_, type)(eval_state->opd_stack); \
-    i32 ea = calculate_address(eval_state, instr, sizeof(type) * 8); \
-    *((type *) (get_current_memory()->data + ea)) = value
+    memcpy(effective_address(eval_state, instr, sizeof(type)), &value, sizeof(type))
 
 OP_HANDLER(OP_I32_LOAD) {
     LOAD_INSN(eval_state, i32, i32);
@@ -146,11 +140,12 @@ OP_HANDLER(OP_I64_STORE32) {
 }
 
 OP_HANDLER(OP_MEMORY_SIZE) {
-    push_i32(eval_state->opd_stack, get_current_memory()->size);
+    push_i32(eval_state->opd_stack, eval_state->memory->size);
 }
 
 OP_HANDLER(OP_MEMORY_GROW) {
-    THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_INSTRUCTION, "memory grow opcode not implemented");
+    u32 delta = pop_i32(eval_state->opd_stack);
+    push_i32(eval_state->opd_stack, grow_memory(eval_state, delta));
 }
 
 #undef LOAD_INSN
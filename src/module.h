@@ -1,10 +1,21 @@
 #ifndef MODULE_H
 #define MODULE_H
 
+#include <stdatomic.h>
+#include <string.h>
+
 #include "type.h"
 #include "value.h"
 #include "instruction.h"
 
+static inline SILENCE_UNUSED bool names_equal(name a, name b) {
+    return a.length == b.length && (a.length == 0 || memcmp(a.bytes, b.bytes, a.length) == 0);
+}
+
+static inline SILENCE_UNUSED bool name_equals_str(name a, const char *str) {
+    return names_equal(a, (name) {.bytes = (const byte *) str, .length = strlen(str)});
+}
+
 typedef enum section_type {
     SECTION_TYPE_CUSTOM = 0,
     SECTION_TYPE_TYPE = 1,
@@ -121,8 +132,13 @@ CREATE_VEC(locals_t, locals)
 
 typedef struct func {
     typeidx type;
+    span_t body; // Encoded locals and expression in the binary, decoded after all sections are read or on first call.
+    atomic_bool decoded; // Set (release) once the fields below are computed, see decode_lazy_func.
     vec_locals_t *locals;
     expression_t expression;
+    u32 num_locals; // Number of declared locals (excluding parameters), computed by validate_func.
+    u32 max_stack_height; // Maximum operand stack height of the body (excluding locals), computed by validate_func.
+    vec_instruction_t *code; // Flat body with resolved branch targets, produced by lower_func.
 } func_t;
 
 CREATE_VEC(func_t, func)
@@ -134,7 +150,7 @@ typedef struct code_section {
 typedef struct data {
     memidx memidx;
     expression_t expression;
-    vec_byte_t *init;
+    span_t init;
 } data_t;
 
 CREATE_VEC(data_t, data)
@@ -172,10 +188,38 @@ typedef struct module {
     bool has_start;
     funcidx start;
     vec_import_t *imports;
+    u32 imported_funcs; /* Number of imported functions, they precede the funcs in the function index space. */
     vec_export_t *exports;
     name name;
+    /* Mapping of the binary if it is owned by the module (see parse), names, data segments and bodies point into it. */
+    byte *binary;
+    size_t binary_size;
+    arena_t *arena; /* All vecs of the module and the module itself, NULL for modules loaded from a module cache. */
 } module_t;
 
 CREATE_VEC(module_t, module)
 
+/* Defined function of a funcidx, NULL for imported and unknown functions. */
+static inline SILENCE_UNUSED func_t *get_defined_func(const module_t *module, funcidx idx) {
+    if (idx < module->imported_funcs || module->funcs == NULL
+        || idx - module->imported_funcs >= vec_func_length(module->funcs)) {
+        return NULL;
+    }
+    return vec_func_getp(module->funcs, idx - module->imported_funcs);
+}
+
+/* Type of a function of the module, imported or defined, which has to exist. */
+static inline SILENCE_UNUSED typeidx get_func_typeidx(const module_t *module, funcidx idx) {
+    if (idx >= module->imported_funcs) {
+        return vec_func_getp(module->funcs, idx - module->imported_funcs)->type;
+    }
+    for (u32 i = 0; i < vec_import_length(module->imports); i++) {
+        import_t *import = vec_import_getp(module->imports, i);
+        if (import->desc == IMPORTDESC_FUNC && idx-- == 0) {
+            return import->func;
+        }
+    }
+    return 0;
+}
+
 #endif // MODULE_H
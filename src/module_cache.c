@@ -0,0 +1,334 @@
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "module_cache.h"
+#include "parser.h"
+
+#define MODULE_CACHE_MAGIC 0x444f4d57 // "WMOD"
+#define MODULE_CACHE_VERSION 3
+#define DATA_ALIGNMENT 65536 // at least the page size of all hosts
+
+typedef struct module_cache_header {
+    u32 magic;
+    u32 version;
+    u64 key;
+    u32 pointer_size;  /* Layout of the writer, the file is a memory image. */
+    u32 module_size;
+    u32 func_size;
+    u32 instruction_size;
+    u64 module_offset;  /* File offset of the module_t. */
+    u64 fixups_offset;  /* File offset of the u64 offsets of all pointer fields. */
+    u64 fixup_count;
+    u64 data_offset;
+    u64 size;  /* Size of the whole file. */
+} module_cache_header_t;
+
+/* Layout shared by all vec types generated by CREATE_VEC. */
+typedef struct raw_vec {
+    u32 _length;
+    u32 _capacity;
+    void *_elements;
+} raw_vec_t;
+
+typedef struct buffer {
+    byte *bytes;
+    size_t length;
+    size_t capacity;
+} buffer_t;
+
+typedef enum region {
+    REGION_FIXUP = 0,
+    REGION_DATA = 1,
+} region_t;
+
+/*
+ * While writing, references are encoded as region bit (63) and offset + 1 within the region, 0 is NULL. They are
+ * turned into file offsets + 1 once the position of the data region is known.
+ */
+typedef u64 ref_t;
+
+#define REF_DATA_BIT ((u64) 1 << 63)
+
+typedef struct cache_writer {
+    buffer_t regions[2];
+    buffer_t fixups;  /* u64 positions of pointer fields in the fix-up region. */
+} cache_writer_t;
+
+static size_t append(buffer_t *buffer, const void *data, size_t length) {
+    size_t pos = (buffer->length + 7) & ~(size_t) 7;
+    if (pos + length > buffer->capacity) {
+        size_t capacity = buffer->capacity > 0 ? buffer->capacity : 4096;
+        while (capacity < pos + length) {
+            capacity *= 2;
+        }
+        byte *bytes = realloc(buffer->bytes, capacity);
+        if (bytes == NULL) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_PARSER_INVALID_MODULE_CACHE, "out of memory");
+        }
+        buffer->bytes = bytes;
+        buffer->capacity = capacity;
+    }
+    memset(buffer->bytes + buffer->length, 0, pos - buffer->length);
+    if (length > 0) {
+        memcpy(buffer->bytes + pos, data, length);
+    }
+    buffer->length = pos + length;
+    return pos;
+}
+
+static ref_t put(cache_writer_t *w, region_t region, const void *data, size_t length) {
+    size_t pos = append(&w->regions[region], data, length);
+    return (pos + 1) | (region == REGION_DATA ? REF_DATA_BIT : 0);
+}
+
+/* Stores ref in the pointer field at pos of the fix-up region. */
+static void set_ref(cache_writer_t *w, size_t pos, ref_t ref) {
+    if (ref == 0) {
+        memset(w->regions[REGION_FIXUP].bytes + pos, 0, sizeof(uintptr_t));
+        return;
+    }
+    uintptr_t value = ref;
+    memcpy(w->regions[REGION_FIXUP].bytes + pos, &value, sizeof(value));
+    u64 fixup = pos;
+    append(&w->fixups, &fixup, sizeof(fixup));
+}
+
+static size_t ref_pos(ref_t ref) {
+    return (ref & ~REF_DATA_BIT) - 1;
+}
+
+/*
+ * Writes the vec header to the fix-up region and its elements to the given region, returns the reference to the
+ * header. The position of the copied elements is stored in elements_pos if requested.
+ */
+static ref_t put_vec(cache_writer_t *w, const void *vec, size_t element_size, region_t region, size_t *elements_pos) {
+    if (vec == NULL) {
+        return 0;
+    }
+    const raw_vec_t *raw = vec;
+    raw_vec_t header = {._length = raw->_length, ._capacity = raw->_length, ._elements = NULL};
+    ref_t elements = put(w, region, raw->_elements, (size_t) raw->_length * element_size);
+    if (elements_pos != NULL) {
+        *elements_pos = ref_pos(elements);
+    }
+    ref_t ref = put(w, REGION_FIXUP, &header, sizeof(header));
+    set_ref(w, ref_pos(ref) + offsetof(raw_vec_t, _elements), raw->_length > 0 ? elements : 0);
+    return ref;
+}
+
+/* Writes the bytes of a span to the span field at pos. */
+static void put_span(cache_writer_t *w, size_t pos, span_t span) {
+    set_ref(w, pos + offsetof(span_t, bytes), span.bytes != NULL ? put(w, REGION_DATA, span.bytes, span.length) : 0);
+}
+
+/* Writes a vec whose elements contain pointers to field_pos, fix_element patches the copy of each element at pos. */
+#define PUT_VEC_WITH_POINTERS(w, field_pos, vec, type, fix_element) \
+do { \
+    size_t _elements_pos = 0; \
+    set_ref(w, field_pos, put_vec(w, vec, sizeof(type), REGION_FIXUP, &_elements_pos)); \
+    for (u32 i = 0; (vec) != NULL && i < (vec)->_length; i++) { \
+        size_t pos = _elements_pos + i * sizeof(type); \
+        type *element = &(vec)->_elements[i]; \
+        fix_element \
+    } \
+} while (0)
+
+static void write_module(cache_writer_t *w, const module_t *module) {
+    // the cached module references its own copy of names and data segments instead of the binary
+    module_t root_module = *module;
+    root_module.binary = NULL;
+    root_module.binary_size = 0;
+    root_module.arena = NULL;
+    ref_t root = put(w, REGION_FIXUP, &root_module, sizeof(module_t));
+    size_t m = ref_pos(root);
+
+    PUT_VEC_WITH_POINTERS(w, m + offsetof(module_t, types), module->types, functype_t, {
+        set_ref(w, pos + offsetof(functype_t, t1), put_vec(w, element->t1, sizeof(valtype_t), REGION_DATA, NULL));
+        set_ref(w, pos + offsetof(functype_t, t2), put_vec(w, element->t2, sizeof(valtype_t), REGION_DATA, NULL));
+    });
+    PUT_VEC_WITH_POINTERS(w, m + offsetof(module_t, funcs), module->funcs, func_t, {
+        set_ref(w, pos + offsetof(func_t, locals), put_vec(w, element->locals, sizeof(locals_t), REGION_DATA, NULL));
+        set_ref(w, pos + offsetof(func_t, body.bytes), 0);
+        set_ref(w, pos + offsetof(func_t, expression.instructions), 0);
+        set_ref(w, pos + offsetof(func_t, code), put_vec(w, element->code, sizeof(instruction_t), REGION_DATA, NULL));
+    });
+    set_ref(w, m + offsetof(module_t, tables), put_vec(w, module->tables, sizeof(tabletype_t), REGION_DATA, NULL));
+    set_ref(w, m + offsetof(module_t, mems), put_vec(w, module->mems, sizeof(memtype_t), REGION_DATA, NULL));
+    PUT_VEC_WITH_POINTERS(w, m + offsetof(module_t, globals), module->globals, global_t, {
+        set_ref(w, pos + offsetof(global_t, e.instructions),
+                put_vec(w, element->e.instructions, sizeof(instruction_t), REGION_DATA, NULL));
+    });
+    PUT_VEC_WITH_POINTERS(w, m + offsetof(module_t, elem), module->elem, element_t, {
+        set_ref(w, pos + offsetof(element_t, offset.instructions),
+                put_vec(w, element->offset.instructions, sizeof(instruction_t), REGION_DATA, NULL));
+        set_ref(w, pos + offsetof(element_t, init), put_vec(w, element->init, sizeof(funcidx), REGION_DATA, NULL));
+    });
+    PUT_VEC_WITH_POINTERS(w, m + offsetof(module_t, data), module->data, data_t, {
+        set_ref(w, pos + offsetof(data_t, expression.instructions),
+                put_vec(w, element->expression.instructions, sizeof(instruction_t), REGION_DATA, NULL));
+        put_span(w, pos + offsetof(data_t, init), element->init);
+    });
+    PUT_VEC_WITH_POINTERS(w, m + offsetof(module_t, imports), module->imports, import_t, {
+        put_span(w, pos + offsetof(import_t, module), element->module);
+        put_span(w, pos + offsetof(import_t, name), element->name);
+    });
+    PUT_VEC_WITH_POINTERS(w, m + offsetof(module_t, exports), module->exports, export_t, {
+        put_span(w, pos + offsetof(export_t, name), element->name);
+    });
+    put_span(w, m + offsetof(module_t, name), module->name);
+}
+
+static void write_all(int fd, const void *data, size_t length) {
+    const byte *bytes = data;
+    while (length > 0) {
+        ssize_t n = write(fd, bytes, length);
+        if (n <= 0) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_PARSER_INVALID_MODULE_CACHE, "could not write module cache");
+        }
+        bytes += n;
+        length -= n;
+    }
+}
+
+static void _write_module_cache(cache_writer_t *w, const module_t *module, u64 key, int fd) {
+    // only lowered code is stored, bodies of a lazily parsed module which were never called are decoded now
+    decode_lazy_funcs(module);
+    write_module(w, module);
+
+    buffer_t *fixup_region = &w->regions[REGION_FIXUP];
+    buffer_t *data_region = &w->regions[REGION_DATA];
+    u64 *fixups = (u64 *) w->fixups.bytes;
+    u64 fixup_count = w->fixups.length / sizeof(u64);
+
+    module_cache_header_t header = {
+            .magic = MODULE_CACHE_MAGIC,
+            .version = MODULE_CACHE_VERSION,
+            .key = key,
+            .pointer_size = sizeof(void *),
+            .module_size = sizeof(module_t),
+            .func_size = sizeof(func_t),
+            .instruction_size = sizeof(instruction_t),
+            .module_offset = sizeof(module_cache_header_t),
+            .fixups_offset = sizeof(module_cache_header_t) + fixup_region->length,
+            .fixup_count = fixup_count,
+    };
+    header.data_offset = (header.fixups_offset + fixup_count * sizeof(u64) + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT *
+                         DATA_ALIGNMENT;
+    header.size = header.data_offset + data_region->length;
+
+    // turn region references into file offsets + 1
+    for (u64 i = 0; i < fixup_count; i++) {
+        uintptr_t ref;
+        memcpy(&ref, fixup_region->bytes + fixups[i], sizeof(ref));
+        u64 base = (ref & REF_DATA_BIT) ? header.data_offset : header.module_offset;
+        uintptr_t offset = base + ref_pos(ref) + 1;
+        memcpy(fixup_region->bytes + fixups[i], &offset, sizeof(offset));
+        fixups[i] += header.module_offset;
+    }
+
+    write_all(fd, &header, sizeof(header));
+    write_all(fd, fixup_region->bytes, fixup_region->length);
+    write_all(fd, fixups, fixup_count * sizeof(u64));
+    if (lseek(fd, header.data_offset, SEEK_SET) < 0) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_PARSER_INVALID_MODULE_CACHE, "could not write module cache");
+    }
+    write_all(fd, data_region->bytes, data_region->length);
+    if (ftruncate(fd, header.size) != 0) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_PARSER_INVALID_MODULE_CACHE, "could not write module cache");
+    }
+}
+
+exception_t write_module_cache(const module_t *module, u64 key, const char *path) {
+    if (sizeof(uintptr_t) != sizeof(u64)) {
+        // references are tagged in the upper bit while writing
+        return EXCEPTION_PARSER_INVALID_MODULE_CACHE;
+    }
+
+    // written to a temporary file and renamed, so concurrent readers never see a partial cache
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, getpid());
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return EXCEPTION_PARSER_INVALID_MODULE_CACHE;
+    }
+
+    cache_writer_t writer = {0};
+    exception_t ex = NO_EXCEPTION;
+    TRY_CATCH({
+                  _write_module_cache(&writer, module, key, fd);
+              }, {
+                  ex = exception;
+              }
+    )
+    free(writer.regions[REGION_FIXUP].bytes);
+    free(writer.regions[REGION_DATA].bytes);
+    free(writer.fixups.bytes);
+
+    if (close(fd) != 0 && ex == NO_EXCEPTION) {
+        ex = EXCEPTION_PARSER_INVALID_MODULE_CACHE;
+    }
+    if (ex == NO_EXCEPTION && rename(tmp_path, path) != 0) {
+        ex = EXCEPTION_PARSER_INVALID_MODULE_CACHE;
+    }
+    if (ex != NO_EXCEPTION) {
+        unlink(tmp_path);
+    }
+    return ex;
+}
+
+static bool check_header(const module_cache_header_t *header, u64 key, u64 file_size) {
+    return header->magic == MODULE_CACHE_MAGIC && header->version == MODULE_CACHE_VERSION && header->key == key &&
+           header->pointer_size == sizeof(void *) && header->module_size == sizeof(module_t) &&
+           header->func_size == sizeof(func_t) && header->instruction_size == sizeof(instruction_t) &&
+           header->size == file_size && header->module_offset + sizeof(module_t) <= header->fixups_offset &&
+           header->fixups_offset + header->fixup_count * sizeof(u64) <= header->data_offset &&
+           header->data_offset <= header->size && header->data_offset % DATA_ALIGNMENT == 0;
+}
+
+exception_t load_module_cache(u64 key, const char *path, module_t **module) {
+    *module = NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return EXCEPTION_PARSER_INVALID_MODULE_CACHE;
+    }
+
+    struct stat st;
+    module_cache_header_t header;
+    if (fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        !check_header(&header, key, st.st_size)) {
+        close(fd);
+        return EXCEPTION_PARSER_INVALID_MODULE_CACHE;
+    }
+
+    byte *base = mmap(NULL, header.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return EXCEPTION_PARSER_INVALID_MODULE_CACHE;
+    }
+
+    const u64 *fixups = (const u64 *) (base + header.fixups_offset);
+    for (u64 i = 0; i < header.fixup_count; i++) {
+        if (fixups[i] < header.module_offset || fixups[i] + sizeof(uintptr_t) > header.fixups_offset) {
+            munmap(base, header.size);
+            return EXCEPTION_PARSER_INVALID_MODULE_CACHE;
+        }
+        uintptr_t *field = (uintptr_t *) (base + fixups[i]);
+        if (*field == 0 || *field > header.size) {
+            munmap(base, header.size);
+            return EXCEPTION_PARSER_INVALID_MODULE_CACHE;
+        }
+        *field = (uintptr_t) (base + *field - 1);
+    }
+    // the module owns the mapping, it is unmapped by free_module
+    *module = (module_t *) (base + header.module_offset);
+    (*module)->binary = base;
+    (*module)->binary_size = header.size;
+    mprotect(base, header.size, PROT_READ);
+
+    return NO_EXCEPTION;
+}
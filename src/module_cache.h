@@ -0,0 +1,28 @@
+#ifndef WASM_INTERPRETER_MODULE_CACHE_H
+#define WASM_INTERPRETER_MODULE_CACHE_H
+
+#include "module.h"
+#include "exception.h"
+
+/*
+ * On-disk cache of a parsed, validated and lowered module. The file is an image of the module_t with all pointers
+ * stored as file offsets:
+ *
+ * - header (module_cache_header_t in module_cache.c)
+ * - fix-up region: the module_t, all vec headers and the elements of vecs which contain pointers
+ * - list of file offsets of all pointer fields in the fix-up region
+ * - data region (page aligned): pointer-free elements, i.e. the lowered code, valtypes, bytes and names
+ *
+ * Loading maps the file privately and turns the offsets into pointers, which only dirties the fix-up region: the data
+ * region, by far the largest part, stays shared between all processes through the page cache. The mapping is made
+ * read-only afterwards, so the module must not be modified. The module owns the mapping (module->binary), free_module
+ * unmaps it. Nested instruction trees (func->expression) are not stored, only the lowered code.
+ *
+ * The key identifies the module (e.g. a hash of the module file), loading a cache with another key, or one written by
+ * an interpreter with a different layout, fails with EXCEPTION_PARSER_INVALID_MODULE_CACHE.
+ */
+exception_t write_module_cache(const module_t *module, u64 key, const char *path);
+
+exception_t load_module_cache(u64 key, const char *path, module_t **module);
+
+#endif // WASM_INTERPRETER_MODULE_CACHE_H
@@ -10,16 +10,10 @@ OP_HANDLER(OP_DROP) {
 
 OP_HANDLER(OP_SELECT) {
     i32 c = pop_i32(eval_state->opd_stack);
-    valtype_t valtype = peek_valtype(eval_state->opd_stack);
-    val_t val1;
-    val_t val2;
-    pop_generic_assert_type(eval_state->opd_stack, valtype, &val2);
-    pop_generic_assert_type(eval_state->opd_stack, valtype, &val1);
+    stack_entry_t *val2 = pop_entry(eval_state->opd_stack);
 
-    if (c != 0) {
-        push_generic(eval_state->opd_stack, valtype, val1);
-    } else {
-        push_generic(eval_state->opd_stack, valtype, val2);
+    if (c == 0) {
+        *peek_entry(eval_state->opd_stack) = *val2;
     }
 }
 
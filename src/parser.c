@@ -1,3 +1,9 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "parser.h"
 
 #include "type.h"
@@ -6,42 +12,57 @@
 #include "stdlib.h"
 #include "string.h"
 #include "strings.h"
+#include "lower.h"
+#include "validator.h"
+#include "arena.h"
 
 typedef struct parser_state {
-    FILE *input;
+    const byte *pos;
+    const byte *end;
+    arena_t *arena; /* Everything the module references is allocated here. */
+    vec_instruction_t *scratch; /* Instructions of the blocks which are being decoded, innermost last. */
 } parser_state_t;
 
+/* The vec is allocated with the length of its count prefix, every element takes at least one byte. */
 #define MAKE_NEXT_VEC(name, generator_func) \
 static CAT(CAT(vec_, name), _t) *CAT(CAT(next_, name), _vec)(parser_state_t *state) { \
     u32 n = next_u32(state); \
-    CAT(CAT(vec_, name), _t) *vec = CAT(CAT(vec_, name), _create)(); \
+    ensure_available(state, n); \
+    CAT(CAT(vec_, name), _t) *vec = CAT(CAT(vec_, name), _create_in)(state->arena, n); \
     for (u32 i = 0; i < n; i++) { \
-        CAT(CAT(vec_, name), _add)(vec, generator_func(state)); \
+        vec->_elements[i] = generator_func(state); \
     } \
     return vec; \
 }
 
-static byte next_byte(parser_state_t *state) {
-    int value = fgetc(state->input);
-    if (value == EOF) {
+/* Throws unless count more bytes are available. */
+static void ensure_available(parser_state_t *state, size_t count) {
+    if ((size_t) (state->end - state->pos) < count) {
         THROW_EXCEPTION(EXCEPTION_PARSER_EOF_BEFORE_FINISHED);
     }
-    return value;
+}
+
+static byte next_byte(parser_state_t *state) {
+    ensure_available(state, 1);
+    return *state->pos++;
 }
 
 static byte peek_byte(parser_state_t *state) {
-    int value = fgetc(state->input);
-    if (value == EOF) {
-        THROW_EXCEPTION(EXCEPTION_PARSER_EOF_BEFORE_FINISHED);
-    }
-    ungetc(value, state->input);
-    return value;
+    ensure_available(state, 1);
+    return *state->pos;
 }
 
 static void advance(parser_state_t *state, u32 count) {
-    for (u32 i = 0; i < count; i++) {
-        next_byte(state);
-    }
+    ensure_available(state, count);
+    state->pos += count;
+}
+
+/* Returns a span of the next count bytes, which stays valid as long as the binary. */
+static span_t next_span(parser_state_t *state, u32 count) {
+    ensure_available(state, count);
+    span_t span = {.bytes = state->pos, .length = count};
+    state->pos += count;
+    return span;
 }
 
 static uint64_t read_LEB(parser_state_t *state, uint32_t maxbits, bool sign) {
@@ -91,23 +112,13 @@ static i64 next_i64(parser_state_t *state) {
 
 static f32 next_f32(parser_state_t *state) {
     f32 output;
-    *((byte *) (&output) + 0) = next_byte(state);
-    *((byte *) (&output) + 1) = next_byte(state);
-    *((byte *) (&output) + 2) = next_byte(state);
-    *((byte *) (&output) + 3) = next_byte(state);
+    memcpy(&output, next_span(state, sizeof(output)).bytes, sizeof(output));
     return output;
 }
 
 static f64 next_f64(parser_state_t *state) {
     f64 output;
-    *((byte *) (&output) + 0) = next_byte(state);
-    *((byte *) (&output) + 1) = next_byte(state);
-    *((byte *) (&output) + 2) = next_byte(state);
-    *((byte *) (&output) + 3) = next_byte(state);
-    *((byte *) (&output) + 4) = next_byte(state);
-    *((byte *) (&output) + 5) = next_byte(state);
-    *((byte *) (&output) + 6) = next_byte(state);
-    *((byte *) (&output) + 7) = next_byte(state);
+    memcpy(&output, next_span(state, sizeof(output)).bytes, sizeof(output));
     return output;
 }
 
@@ -139,8 +150,6 @@ static labelidx next_labelidx(parser_state_t *state) {
     return next_u32(state);
 }
 
-MAKE_NEXT_VEC(byte, next_byte)
-
 MAKE_NEXT_VEC(typeidx, next_typeidx)
 
 MAKE_NEXT_VEC(funcidx, next_funcidx)
@@ -148,13 +157,7 @@ MAKE_NEXT_VEC(funcidx, next_funcidx)
 MAKE_NEXT_VEC(labelidx, next_labelidx)
 
 static name next_name(parser_state_t *state) {
-    // TODO: Should not use internal vec API.
-    vec_byte_t *vec = next_byte_vec(state);
-    name name = malloc(sizeof(char) * (vec->_length + 1));
-    memcpy(name, vec->_elements, sizeof(char) * vec->_length);
-    name[vec->_length] = '\0';
-    vec_byte_free(vec);
-    return name;
+    return next_span(state, next_u32(state));
 }
 
 static instruction_t next_instruction(parser_state_t *state);
@@ -195,19 +198,35 @@ static blocktype_t next_blocktype(parser_state_t *state) {
     if (peek_byte(state) == 0x40) {
         next_byte(state);
         blocktype.empty = true;
+        blocktype.type = VALTYPE_UNKNOWN;
     } else {
+        blocktype.empty = false;
         blocktype.type = next_valtype(state);
     }
     return blocktype;
 }
 
+/*
+ * Decodes instructions up to OP_END (or OP_ELSE, if else_ends), which is not consumed. They are collected on the
+ * scratch vec, above the instructions of the enclosing blocks, and then copied into a vec of the exact length.
+ */
+static vec_instruction_t *next_instructions(parser_state_t *state, bool else_ends) {
+    u32 start = vec_instruction_length(state->scratch);
+    while (peek_byte(state) != OP_END && !(else_ends && peek_byte(state) == OP_ELSE)) {
+        instruction_t instruction = next_instruction(state);
+        vec_instruction_add(state->scratch, instruction);
+    }
+    u32 length = vec_instruction_length(state->scratch) - start;
+    vec_instruction_t *instructions = vec_instruction_create_from(state->arena, state->scratch->_elements + start,
+                                                                  length);
+    vec_instruction_resize(state->scratch, start);
+    return instructions;
+}
+
 static insn_block_t next_insn_block(parser_state_t *state) {
     insn_block_t block;
     block.resulttype = next_blocktype(state);
-    block.instructions = vec_instruction_create();
-    while (peek_byte(state) != 0x0B) {
-        vec_instruction_add(block.instructions, next_instruction(state));
-    }
+    block.instructions = next_instructions(state, false);
     next_byte(state);
     return block;
 }
@@ -215,16 +234,10 @@ static insn_block_t next_insn_block(parser_state_t *state) {
 static insn_if_t next_insn_if(parser_state_t *state) {
     insn_if_t if_block;
     if_block.resulttype = next_blocktype(state);
-    if_block.ifpath = vec_instruction_create();
-    while (peek_byte(state) != OP_ELSE && peek_byte(state) != 0x0B) {
-        vec_instruction_add(if_block.ifpath, next_instruction(state));
-    }
+    if_block.ifpath = next_instructions(state, true);
     if (peek_byte(state) == OP_ELSE) {
         next_byte(state);
-        if_block.elsepath = vec_instruction_create();
-        while (peek_byte(state) != 0x0B) {
-            vec_instruction_add(if_block.elsepath, next_instruction(state));
-        }
+        if_block.elsepath = next_instructions(state, false);
     } else {
         if_block.elsepath = NULL;
     }
@@ -446,10 +459,7 @@ static instruction_t next_instruction(parser_state_t *state) {
 
 expression_t next_expression(parser_state_t *state) {
     expression_t expression;
-    expression.instructions = vec_instruction_create();
-    while (peek_byte(state) != 0x0B) {
-        vec_instruction_add(expression.instructions, next_instruction(state));
-    }
+    expression.instructions = next_instructions(state, false);
     next_byte(state);
     return expression;
 }
@@ -653,27 +663,11 @@ static locals_t next_locals(parser_state_t *state) {
 
 MAKE_NEXT_VEC(locals, next_locals)
 
-static func_t next_func(parser_state_t *state) {
-    func_t func = {0};
-    next_u32(state); // Consume size.
-    func.locals = next_locals_vec(state);
-    func.expression = next_expression(state);
-    return func;
-}
-
-MAKE_NEXT_VEC(func, next_func)
-
-static code_section_t next_code_section(parser_state_t *state) {
-    code_section_t code_section;
-    code_section.funcs = next_func_vec(state);
-    return code_section;
-}
-
 static data_t next_data(parser_state_t *state) {
     data_t data;
     data.memidx = next_memidx(state);
     data.expression = next_expression(state);
-    data.init = next_byte_vec(state);
+    data.init = next_span(state, next_u32(state));
     return data;
 }
 
@@ -685,14 +679,10 @@ static data_section_t next_data_section(parser_state_t *state) {
     return data_section;
 }
 
-static section_t next_section(parser_state_t *state) {
+/* Decodes the content of a section, except for the code section which is decoded body by body (see decoder_t). */
+static section_t next_section(parser_state_t *state, byte id, u32 size) {
     section_t section;
-
-    byte id = next_byte(state);
-    if (id > 11) THROW_EXCEPTION(EXCEPTION_PARSER_INVALID_SECTION_ID);
     section.id = id;
-
-    u32 size = next_u32(state);
     section.size = size;
 
     switch (section.id) {
@@ -726,9 +716,6 @@ static section_t next_section(parser_state_t *state) {
         case SECTION_TYPE_ELEMENT:
             section.element_section = next_element_section(state);
             break;
-        case SECTION_TYPE_CODE:
-            section.code_section = next_code_section(state);
-            break;
         case SECTION_TYPE_DATA:
             section.data_section = next_data_section(state);
             break;
@@ -780,11 +767,248 @@ static section_t next_section(parser_state_t *state) {
 //    }
 //}
 
-static void _parse(FILE *input_file, module_t **module) {
-    parser_state_t state;
-    state.input = input_file;
+/* Decodes, validates and lowers the body of the function, everything it references is allocated in arena. */
+static void decode_func(module_t *module, func_t *func, arena_t *arena, vec_instruction_t *scratch) {
+    vec_instruction_resize(scratch, 0);
+    parser_state_t state = {
+            .pos = func->body.bytes,
+            .end = func->body.bytes + func->body.length,
+            .arena = arena,
+            .scratch = scratch,
+    };
+    func->locals = next_locals_vec(&state);
+    func->expression = next_expression(&state);
+    if (state.pos != state.end) {
+        THROW_EXCEPTION(EXCEPTION_PARSER_SIZE_MISMATCH);
+    }
+    validate_func(module, func);
+    lower_func(module, func);
+
+    vec_instruction_t *code = func->code;
+    func->code = vec_instruction_create_from(arena, code->_elements, vec_instruction_length(code));
+    vec_instruction_free(code);
+    atomic_store_explicit(&func->decoded, true, memory_order_release);
+}
+
+static pthread_mutex_t lazy_decode_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static exception_t decode_func_once(module_t *module, func_t *func, vec_instruction_t *scratch, char *error_message,
+                                    size_t size) {
+    TRY_CATCH({
+                  if (!atomic_load_explicit(&func->decoded, memory_order_relaxed)) {
+                      decode_func(module, func, module->arena, scratch);
+                  }
+              }, {
+                  snprintf(error_message, size, "%s", message);
+                  return exception;
+              }
+    )
+    return NO_EXCEPTION;
+}
+
+void decode_lazy_func(const module_t *module, func_t *func) {
+    char error_message[256];
+    vec_instruction_t *scratch = vec_instruction_create();
 
-    *module = calloc(1, sizeof(module_t));
+    // the function is decoded exactly once, concurrent callers wait for it; the rest of the module (including its
+    // arena) is only modified while holding the lock
+    pthread_mutex_lock(&lazy_decode_lock);
+    exception_t ex = decode_func_once((module_t *) module, func, scratch, error_message, sizeof(error_message));
+    pthread_mutex_unlock(&lazy_decode_lock);
+    vec_instruction_free(scratch);
+
+    if (ex != NO_EXCEPTION) {
+        THROW_EXCEPTION_WITH_MSG(ex, "%s", error_message);
+    }
+}
+
+void decode_lazy_funcs(const module_t *module) {
+    for (u32 i = 0; module->funcs != NULL && i < vec_func_length(module->funcs); i++) {
+        func_t *func = vec_func_getp(module->funcs, i);
+        if (!atomic_load_explicit(&func->decoded, memory_order_acquire)) {
+            decode_lazy_func(module, func);
+        }
+    }
+}
+
+typedef struct decode_job {
+    module_t *module;
+    pthread_mutex_t lock;
+    u32 next; /* Next function to decode. */
+    bool failed; /* No more functions are handed out after the first error. */
+} decode_job_t;
+
+#define NO_FAILED_FUNC UINT32_MAX
+
+typedef struct decode_worker {
+    decode_job_t *job;
+    pthread_t thread;
+    bool started;
+    arena_t *arena; /* Merged into the arena of the module when the worker is done. */
+    vec_instruction_t *scratch;
+    u32 failed_func; /* The first (and lowest) function this worker failed on. */
+    exception_t ex;
+    char message[256];
+} decode_worker_t;
+
+static void *decode_worker(void *arg) {
+    decode_worker_t *worker = arg;
+    decode_job_t *job = worker->job;
+    u32 count = vec_func_length(job->module->funcs);
+
+    while (worker->failed_func == NO_FAILED_FUNC) {
+        pthread_mutex_lock(&job->lock);
+        u32 idx = job->next;
+        bool done = job->failed || idx >= count;
+        if (!done) {
+            job->next++;
+        }
+        pthread_mutex_unlock(&job->lock);
+        if (done) {
+            break;
+        }
+
+        func_t *func = vec_func_getp(job->module->funcs, idx);
+        TRY_CATCH({
+                      decode_func(job->module, func, worker->arena, worker->scratch);
+                  }, {
+                      worker->failed_func = idx;
+                      worker->ex = exception;
+                      snprintf(worker->message, sizeof(worker->message), "%s", message);
+                      pthread_mutex_lock(&job->lock);
+                      job->failed = true;
+                      pthread_mutex_unlock(&job->lock);
+                  }
+        )
+    }
+    return NULL;
+}
+
+/*
+ * Function bodies are independent of each other once all sections are read, so they are decoded on up to threads
+ * threads (the calling thread included), each function is written to its own slot of module->funcs. Functions are
+ * handed out in order and a failing worker stops handing out more, so every function below the lowest failing one has
+ * been decoded: the error of the lowest failing function is thrown, as when decoding sequentially.
+ */
+static void decode_funcs(module_t *module, u32 threads, vec_instruction_t *scratch) {
+    if (module->funcs == NULL) {
+        return;
+    }
+    u32 count = vec_func_length(module->funcs);
+    if (threads <= 1 || count == 1) {
+        for (u32 i = 0; i < count; i++) {
+            decode_func(module, vec_func_getp(module->funcs, i), module->arena, scratch);
+        }
+        return;
+    }
+    if (threads > count) {
+        threads = count;
+    }
+    decode_worker_t *workers = calloc(threads, sizeof(decode_worker_t));
+    if (workers == NULL) {
+        decode_funcs(module, 1, scratch);
+        return;
+    }
+
+    decode_job_t job = {.module = module, .next = 0, .failed = false};
+    pthread_mutex_init(&job.lock, NULL);
+    for (u32 i = 0; i < threads; i++) {
+        workers[i].job = &job;
+        workers[i].failed_func = NO_FAILED_FUNC;
+        workers[i].arena = create_arena();
+        workers[i].scratch = vec_instruction_create();
+    }
+    // if a thread cannot be created, the others take over its share
+    for (u32 i = 1; i < threads; i++) {
+        workers[i].started = pthread_create(&workers[i].thread, NULL, decode_worker, &workers[i]) == 0;
+    }
+    decode_worker(&workers[0]);
+
+    decode_worker_t *failed = NULL;
+    for (u32 i = 0; i < threads; i++) {
+        if (workers[i].started) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        if (workers[i].failed_func != NO_FAILED_FUNC &&
+            (failed == NULL || workers[i].failed_func < failed->failed_func)) {
+            failed = &workers[i];
+        }
+        arena_merge(module->arena, workers[i].arena);
+        vec_instruction_free(workers[i].scratch);
+    }
+    pthread_mutex_destroy(&job.lock);
+
+    exception_t ex = failed != NULL ? failed->ex : NO_EXCEPTION;
+    char message[sizeof(failed->message)];
+    if (failed != NULL) {
+        memcpy(message, failed->message, sizeof(message));
+    }
+    free(workers);
+    if (ex != NO_EXCEPTION) {
+        THROW_EXCEPTION_WITH_MSG(ex, "%s", message);
+    }
+}
+
+/*
+ * Decodes a module binary incrementally while it arrives: every section is decoded once it is complete, the bodies of
+ * the code section one by one once each of them is complete. parse_bytes runs it over a complete binary.
+ */
+typedef struct decoder {
+    const byte *pos; /* Start of the next unit (header, section or function body). */
+    const byte *end; /* End of the bytes received so far. */
+    bool decode_bodies; /* Decode bodies as they arrive, otherwise they are only recorded. */
+    module_t *module;
+    vec_typeidx_t *functions; /* Function section, the types of the bodies. */
+    bool header_done;
+    u32 last_section; /* Id of the last non-custom section, they must appear in order. */
+    const byte *code_end; /* End of the code section while its bodies are decoded, otherwise NULL. */
+    u32 next_body;
+    vec_instruction_t *scratch; /* See parser_state_t. */
+} decoder_t;
+
+/* The module and everything it references live in the arena of the module. */
+static module_t *create_module() {
+    arena_t *arena = create_arena();
+    module_t *module = arena_alloc(arena, sizeof(module_t));
+    memset(module, 0, sizeof(module_t));
+    module->arena = arena;
+    return module;
+}
+
+static void init_decoder(decoder_t *d, const byte *bytes, size_t length, bool decode_bodies) {
+    *d = (decoder_t) {.pos = bytes, .end = bytes + length, .decode_bodies = decode_bodies};
+    d->module = create_module();
+    d->scratch = vec_instruction_create();
+}
+
+/* Frees the decoder, and the module unless it was handed out. */
+static void free_decoder(decoder_t *d) {
+    free_module(d->module);
+    d->module = NULL;
+    vec_instruction_free(d->scratch);
+    d->scratch = NULL;
+}
+
+/* Whether a complete LEB128 u32, or enough bytes for read_LEB to reject it, starts at pos. */
+static bool has_u32(const byte *pos, const byte *end) {
+    for (const byte *p = pos; p < end && p < pos + 6; p++) {
+        if ((*p & 0x80) == 0) {
+            return true;
+        }
+    }
+    return end - pos >= 6;
+}
+
+/* Returns whether the next unit is complete, throws if it is not but the binary is. */
+static bool unit_complete(bool complete, bool finished) {
+    if (!complete && finished) {
+        THROW_EXCEPTION(EXCEPTION_PARSER_EOF_BEFORE_FINISHED);
+    }
+    return complete;
+}
+
+static void decode_header(decoder_t *d) {
+    parser_state_t state = {.pos = d->pos, .end = d->end};
 
     // Check magic value of module.
     if (next_byte(&state) != 0x00 || next_byte(&state) != 0x61 || next_byte(&state) != 0x73 ||
@@ -798,67 +1022,426 @@ static void _parse(FILE *input_file, module_t **module) {
         THROW_EXCEPTION(EXCEPTION_PARSER_VERSION_NOT_SUPPORTED);
     }
 
-    function_section_t function_section = {0};
-
-    while (1) {
-        int next = fgetc(state.input);
-        if (next == EOF) break;
-        ungetc(next, state.input);
-
-        section_t section = next_section(&state);
-
-        switch (section.id) {
-            case SECTION_TYPE_TYPE:
-                (*module)->types = section.type_section.types;
-                break;
-            case SECTION_TYPE_CUSTOM: // Ignore.
-                break;
-            case SECTION_TYPE_IMPORT:
-                (*module)->imports = section.import_section.imports;
-                break;
-            case SECTION_TYPE_FUNCTION:
-                function_section = section.function_section;
-                break;
-            case SECTION_TYPE_TABLE:
-                (*module)->tables = section.table_section.tables;
-                break;
-            case SECTION_TYPE_MEMORY:
-                (*module)->mems = section.memory_section.memories;
-                break;
-            case SECTION_TYPE_GLOBAL:
-                (*module)->globals = section.global_section.globals;
-                break;
-            case SECTION_TYPE_EXPORT:
-                (*module)->exports = section.export_section.exports;
-                break;
-            case SECTION_TYPE_START:
-                (*module)->has_start = true;
-                (*module)->start = section.start_section.start;
-                break;
-            case SECTION_TYPE_ELEMENT:
-                (*module)->elem = section.element_section.elements;
-                break;
-            case SECTION_TYPE_CODE:
-                (*module)->funcs = section.code_section.funcs;
-                break;
-            case SECTION_TYPE_DATA:
-                (*module)->data = section.data_section.datas;
-                break;
+    d->pos = state.pos;
+    d->header_done = true;
+}
+
+static void add_section(decoder_t *d, section_t *section) {
+    module_t *module = d->module;
+    switch (section->id) {
+        case SECTION_TYPE_TYPE:
+            module->types = section->type_section.types;
+            break;
+        case SECTION_TYPE_CUSTOM: // Ignore.
+            break;
+        case SECTION_TYPE_IMPORT:
+            module->imports = section->import_section.imports;
+            for (u32 i = 0; i < vec_import_length(module->imports); i++) {
+                if (vec_import_getp(module->imports, i)->desc == IMPORTDESC_FUNC) {
+                    module->imported_funcs++;
+                }
+            }
+            break;
+        case SECTION_TYPE_FUNCTION:
+            d->functions = section->function_section.functions;
+            break;
+        case SECTION_TYPE_TABLE:
+            module->tables = section->table_section.tables;
+            break;
+        case SECTION_TYPE_MEMORY:
+            module->mems = section->memory_section.memories;
+            break;
+        case SECTION_TYPE_GLOBAL:
+            module->globals = section->global_section.globals;
+            break;
+        case SECTION_TYPE_EXPORT:
+            module->exports = section->export_section.exports;
+            break;
+        case SECTION_TYPE_START:
+            module->has_start = true;
+            module->start = section->start_section.start;
+            break;
+        case SECTION_TYPE_ELEMENT:
+            module->elem = section->element_section.elements;
+            break;
+        case SECTION_TYPE_CODE: // Decoded body by body.
+            break;
+        case SECTION_TYPE_DATA:
+            module->data = section->data_section.datas;
+            break;
+    }
+}
+
+/* All sections a body refers to precede the code section, so the types of all functions are known from here on. */
+static void begin_code_section(decoder_t *d, u32 count) {
+    u32 function_count = d->functions != NULL ? vec_typeidx_length(d->functions) : 0;
+    if (count != function_count) {
+        THROW_EXCEPTION(EXCEPTION_PARSER_FUNCTION_AND_CODE_SECTION_MISMATCH);
+    }
+    d->module->funcs = vec_func_create_in(d->module->arena, count);
+    for (u32 i = 0; i < count; i++) {
+        vec_func_getp(d->module->funcs, i)->type = vec_typeidx_get(d->functions, i);
+    }
+    d->next_body = 0;
+}
+
+static bool decode_next_section(decoder_t *d, bool finished) {
+    parser_state_t state = {.pos = d->pos, .end = d->end};
+    if (!unit_complete(has_u32(state.pos + 1, state.end), finished)) {
+        return false;
+    }
+    byte id = next_byte(&state);
+    if (id > 11) THROW_EXCEPTION(EXCEPTION_PARSER_INVALID_SECTION_ID);
+    u32 size = next_u32(&state);
+
+    // of the code section only the number of bodies is needed, the bodies follow as separate units
+    bool complete = id == SECTION_TYPE_CODE ? has_u32(state.pos, state.end) : (size_t) (state.end - state.pos) >= size;
+    if (!unit_complete(complete, finished)) {
+        return false;
+    }
+    if (id != SECTION_TYPE_CUSTOM) {
+        if (id <= d->last_section) {
+            THROW_EXCEPTION(EXCEPTION_PARSER_SECTION_OUT_OF_ORDER);
+        }
+        d->last_section = id;
+    }
+
+    if (id == SECTION_TYPE_CODE) {
+        const byte *start = state.pos;
+        u32 count = next_u32(&state);
+        if ((size_t) (state.pos - start) > size) {
+            THROW_EXCEPTION(EXCEPTION_PARSER_SIZE_MISMATCH);
+        }
+        begin_code_section(d, count);
+        d->code_end = start + size;
+        d->pos = state.pos;
+        return true;
+    }
+
+    parser_state_t section_state = {
+            .pos = state.pos,
+            .end = state.pos + size,
+            .arena = d->module->arena,
+            .scratch = d->scratch,
+    };
+    section_t section = next_section(&section_state, id, size);
+    if (section_state.pos != section_state.end) {
+        THROW_EXCEPTION(EXCEPTION_PARSER_SIZE_MISMATCH);
+    }
+    add_section(d, &section);
+    d->pos = section_state.end;
+    return true;
+}
+
+static bool decode_next_body(decoder_t *d, bool finished) {
+    if (d->next_body == vec_func_length(d->module->funcs)) {
+        if (d->pos != d->code_end) {
+            THROW_EXCEPTION(EXCEPTION_PARSER_SIZE_MISMATCH);
+        }
+        d->code_end = NULL;
+        return true;
+    }
+
+    // a body must not extend beyond the code section
+    bool section_received = d->end >= d->code_end;
+    parser_state_t state = {.pos = d->pos, .end = section_received ? d->code_end : d->end};
+    finished = finished || section_received;
+    if (!unit_complete(has_u32(state.pos, state.end), finished)) {
+        return false;
+    }
+    u32 size = next_u32(&state);
+    if (!unit_complete((size_t) (state.end - state.pos) >= size, finished)) {
+        return false;
+    }
+
+    func_t *func = vec_func_getp(d->module->funcs, d->next_body);
+    func->body = next_span(&state, size);
+    d->pos = state.pos;
+    d->next_body++;
+    if (d->decode_bodies) {
+        decode_func(d->module, func, d->module->arena, d->scratch);
+    }
+    return true;
+}
+
+/* Decodes all complete units, finished tells whether the rest of the binary is still to come. */
+static void decode_available(decoder_t *d, bool finished) {
+    while (true) {
+        bool progress;
+        if (!d->header_done) {
+            progress = unit_complete(d->end - d->pos >= 8, finished);
+            if (progress) {
+                decode_header(d);
+            }
+        } else if (d->code_end != NULL) {
+            progress = decode_next_body(d, finished);
+        } else if (d->pos < d->end) {
+            progress = decode_next_section(d, finished);
+        } else {
+            progress = false;
+        }
+        if (!progress) {
+            return;
+        }
+    }
+}
+
+/* Decodes the rest of the binary and completes the module. */
+static void finish_decoding(decoder_t *d, const parse_options_t *options) {
+    decode_available(d, true);
+    if (d->module->funcs == NULL && d->functions != NULL && vec_typeidx_length(d->functions) > 0) {
+        THROW_EXCEPTION(EXCEPTION_PARSER_FUNCTION_AND_CODE_SECTION_MISMATCH);
+    }
+
+    validate_module(d->module);
+    if (!d->decode_bodies && (options == NULL || !options->lazy)) {
+        decode_funcs(d->module, options != NULL ? options->threads : 0, d->scratch);
+    }
+}
+
+static void _parse(decoder_t *d, const byte *bytes, size_t length, const parse_options_t *options) {
+    init_decoder(d, bytes, length, false);
+    finish_decoding(d, options);
+}
+
+exception_t parse_bytes(const byte *bytes, size_t length, const parse_options_t *options, module_t **module) {
+    decoder_t d = {0};
+    *module = NULL;
+    TRY_CATCH({
+                  _parse(&d, bytes, length, options);
+              }, {
+                  free_decoder(&d);
+                  return exception;
+              }
+    )
+    *module = d.module;
+    d.module = NULL;
+    free_decoder(&d);
+    return NO_EXCEPTION;
+}
+
+void free_module(module_t *module) {
+    if (module == NULL) {
+        return;
+    }
+    // the module itself lives in its arena, or in the binary if it was loaded from a module cache
+    byte *binary = module->binary;
+    size_t binary_size = module->binary_size;
+    free_arena(module->arena);
+    if (binary != NULL) {
+        munmap(binary, binary_size);
+    }
+}
+
+/*
+ * The stream parser receives the binary into a reservation of address space which is committed as it fills, so the
+ * received bytes never move and the module can point into them like into a mapped file.
+ */
+#define STREAM_RESERVATION (sizeof(void *) == 8 ? (size_t) 1 << 32 : (size_t) 1 << 28)
+#define STREAM_COMMIT_SIZE ((size_t) 1 << 20)
+#define STREAM_READ_SIZE ((size_t) 1 << 16)
+
+struct stream_parser {
+    decoder_t decoder;
+    parse_options_t options;
+    byte *buffer;
+    size_t committed;
+    size_t length;
+    exception_t error; /* The first error, the parser cannot continue after it. */
+};
+
+exception_t create_stream_parser(const parse_options_t *options, stream_parser_t **parser) {
+    *parser = calloc(1, sizeof(stream_parser_t));
+    if (*parser == NULL) {
+        return EXCEPTION_PARSER_READ_FAILED;
+    }
+    stream_parser_t *p = *parser;
+    p->buffer = mmap(NULL, STREAM_RESERVATION, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p->buffer == MAP_FAILED) {
+        free(p);
+        *parser = NULL;
+        return EXCEPTION_PARSER_READ_FAILED;
+    }
+    if (options != NULL) {
+        p->options = *options;
+    }
+    // bodies are decoded while the rest of the binary is received, unless they are decoded on first call
+    TRY_CATCH({
+                  init_decoder(&p->decoder, p->buffer, 0, !p->options.lazy);
+              }, {
+                  free_stream_parser(p);
+                  *parser = NULL;
+                  return exception;
+              }
+    )
+    return NO_EXCEPTION;
+}
+
+/* Returns room for at least length more bytes at the end of the received bytes. */
+static byte *stream_parser_space(stream_parser_t *p, size_t length) {
+    if (length > STREAM_RESERVATION - p->length) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_PARSER_READ_FAILED, "module is larger than %zu bytes", STREAM_RESERVATION);
+    }
+    if (p->length + length > p->committed) {
+        size_t committed = (p->length + length + STREAM_COMMIT_SIZE - 1) / STREAM_COMMIT_SIZE * STREAM_COMMIT_SIZE;
+        if (committed > STREAM_RESERVATION) {
+            committed = STREAM_RESERVATION;
+        }
+        if (mprotect(p->buffer + p->committed, committed - p->committed, PROT_READ | PROT_WRITE) != 0) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_PARSER_READ_FAILED, "out of memory");
         }
+        p->committed = committed;
+    }
+    return p->buffer + p->length;
+}
+
+/* Decodes whatever became complete through length new bytes at the end. */
+static void stream_parser_received(stream_parser_t *p, size_t length) {
+    p->length += length;
+    p->decoder.end = p->buffer + p->length;
+    decode_available(&p->decoder, false);
+}
+
+static void _stream_parser_feed(stream_parser_t *p, const byte *bytes, size_t length) {
+    memcpy(stream_parser_space(p, length), bytes, length);
+    stream_parser_received(p, length);
+}
+
+exception_t stream_parser_feed(stream_parser_t *parser, const byte *bytes, size_t length) {
+    if (parser->error != NO_EXCEPTION) {
+        return parser->error;
+    }
+    TRY_CATCH({
+                  _stream_parser_feed(parser, bytes, length);
+              }, {
+                  parser->error = exception;
+              }
+    )
+    return parser->error;
+}
+
+static void _stream_parser_finish(stream_parser_t *p) {
+    finish_decoding(&p->decoder, &p->options);
+
+    // the module owns the received bytes from now on, the rest of the reservation is released
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t used = (p->length + page_size - 1) / page_size * page_size;
+    mprotect(p->buffer, used, PROT_READ);
+    munmap(p->buffer + used, STREAM_RESERVATION - used);
+    p->decoder.module->binary = p->buffer;
+    p->decoder.module->binary_size = p->length;
+    p->buffer = NULL;
+}
+
+exception_t stream_parser_finish(stream_parser_t *parser, module_t **module) {
+    *module = NULL;
+    if (parser->error == NO_EXCEPTION) {
+        TRY_CATCH({
+                      _stream_parser_finish(parser);
+                  }, {
+                      parser->error = exception;
+                  }
+        )
     }
+    if (parser->error != NO_EXCEPTION) {
+        return parser->error;
+    }
+    *module = parser->decoder.module;
+    parser->decoder.module = NULL;
+    return NO_EXCEPTION;
+}
 
-    for (u32 i = 0; i < vec_typeidx_length(function_section.functions); i++) {
-        vec_func_getp((*module)->funcs, i)->type = vec_typeidx_get(function_section.functions, i);
+void free_stream_parser(stream_parser_t *parser) {
+    if (parser == NULL) {
+        return;
+    }
+    free_decoder(&parser->decoder);
+    if (parser->buffer != NULL) {
+        munmap(parser->buffer, STREAM_RESERVATION);
+    }
+    free(parser);
+}
+
+/* Reads into the stream parser until end of file, from input_file if it is not NULL, otherwise from fd. */
+static void _stream_parse(stream_parser_t *p, FILE *input_file, int fd) {
+    while (true) {
+        // the bytes are read in place and decoded as far as they are complete
+        byte *space = stream_parser_space(p, STREAM_READ_SIZE);
+        ssize_t n = input_file != NULL ? (ssize_t) fread(space, 1, STREAM_READ_SIZE, input_file)
+                                       : read(fd, space, STREAM_READ_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 || (input_file != NULL && ferror(input_file))) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_PARSER_READ_FAILED, "could not read module: %s", strerror(errno));
+        }
+        if (n == 0) {
+            return;
+        }
+        stream_parser_received(p, n);
     }
 }
 
-exception_t parse(FILE *input_file, module_t **module) {
-    exception_t ex = NO_EXCEPTION;
+static exception_t stream_parse(stream_parser_t *parser, FILE *input_file, int fd, module_t **module) {
     TRY_CATCH({
-                  _parse(input_file, module);
+                  _stream_parse(parser, input_file, fd);
               }, {
-                  ex = exception;
+                  parser->error = exception;
               }
     )
+    return stream_parser_finish(parser, module);
+}
+
+/* Maps the input if it is a regular file, the module owns the mapping. */
+static bool map_input(int fd, off_t offset, const parse_options_t *options, module_t **module, exception_t *ex) {
+    struct stat st;
+    if (fd < 0 || offset < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= offset) {
+        return false;
+    }
+    byte *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    *ex = parse_bytes(mapping + offset, st.st_size - offset, options, module);
+    if (*ex != NO_EXCEPTION) {
+        munmap(mapping, st.st_size);
+        return true;
+    }
+    // names, data segments and bodies point into the binary, so the module keeps it
+    (*module)->binary = mapping;
+    (*module)->binary_size = st.st_size;
+    return true;
+}
+
+exception_t parse(FILE *input_file, const parse_options_t *options, module_t **module) {
+    exception_t ex;
+    if (map_input(fileno(input_file), ftello(input_file), options, module, &ex)) {
+        fseeko(input_file, 0, SEEK_END);
+        return ex;
+    }
+
+    stream_parser_t *parser;
+    ex = create_stream_parser(options, &parser);
+    if (ex == NO_EXCEPTION) {
+        ex = stream_parse(parser, input_file, -1, module);
+        free_stream_parser(parser);
+    }
+    return ex;
+}
+
+exception_t parse_fd(int fd, const parse_options_t *options, module_t **module) {
+    exception_t ex;
+    if (map_input(fd, lseek(fd, 0, SEEK_CUR), options, module, &ex)) {
+        lseek(fd, 0, SEEK_END);
+        return ex;
+    }
+
+    stream_parser_t *parser;
+    ex = create_stream_parser(options, &parser);
+    if (ex == NO_EXCEPTION) {
+        ex = stream_parse(parser, NULL, fd, module);
+        free_stream_parser(parser);
+    }
     return ex;
 }
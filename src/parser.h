@@ -7,6 +7,60 @@
 
 typedef void (*parse_error_f)(char *msg);
 
-exception_t parse(FILE *input_file, module_t **module);
+typedef struct parse_options {
+    /* Function bodies are decoded, validated and lowered on this many threads, 0 or 1 uses the calling thread only. */
+    u32 threads;
+    /*
+     * Function bodies are only decoded, validated and lowered when they are called for the first time (see
+     * decode_lazy_func), which saves startup time and memory if most functions are never called. Invalid bodies are
+     * then reported by the call instead of by parse.
+     */
+    bool lazy;
+} parse_options_t;
+
+/*
+ * Parses, validates and lowers a module from the byte span, which is decoded in place: names and data segments of the
+ * module point into it, so the bytes must outlive the module. options may be NULL for the defaults.
+ */
+exception_t parse_bytes(const byte *bytes, size_t length, const parse_options_t *options, module_t **module);
+
+/*
+ * Parses the rest of the file, which is mapped and owned by the module. Input which cannot be mapped (e.g. a pipe) is
+ * parsed with a stream parser.
+ */
+exception_t parse(FILE *input_file, const parse_options_t *options, module_t **module);
+
+exception_t parse_fd(int fd, const parse_options_t *options, module_t **module);
+
+/* Frees the module and everything it owns (its arena and binary), instances of it must be freed before. */
+void free_module(module_t *module);
+
+/*
+ * Parses a module while it arrives, e.g. over a socket: sections are decoded as soon as they are complete and function
+ * bodies (unless options->lazy) as soon as each body is complete, so decoding overlaps with receiving. Bodies are
+ * validated before validate_module runs, which only happens once the binary is complete. The received bytes are
+ * kept in place and owned by the module.
+ *
+ * feed returns the first error of the module, after which the parser only needs to be freed. finish completes the
+ * module once all bytes were fed.
+ */
+typedef struct stream_parser stream_parser_t;
+
+exception_t create_stream_parser(const parse_options_t *options, stream_parser_t **parser);
+
+exception_t stream_parser_feed(stream_parser_t *parser, const byte *bytes, size_t length);
+
+exception_t stream_parser_finish(stream_parser_t *parser, module_t **module);
+
+void free_stream_parser(stream_parser_t *parser);
+
+/*
+ * Decodes, validates and lowers the body of a function of a lazily parsed module unless that already happened, throws
+ * if the body is invalid. Safe to call concurrently, each body is decoded exactly once.
+ */
+void decode_lazy_func(const module_t *module, func_t *func);
+
+/* Decodes all bodies of a lazily parsed module which have not been called yet. */
+void decode_lazy_funcs(const module_t *module);
 
 #endif // PARSER_H
@@ -0,0 +1,176 @@
+#include <unistd.h>
+
+#include "pool.h"
+#include "interpreter.h"
+#include "memory.h"
+#include "parser.h"
+
+static vec_global_entry_t *copy_globals(vec_global_entry_t *globals) {
+    vec_global_entry_t *copy = vec_global_entry_create();
+    vec_global_entry_iterator_t it = vec_global_entry_iterator(globals, IT_FORWARDS);
+    while (vec_global_entry_has_next(&it)) {
+        vec_global_entry_add(copy, vec_global_entry_next(&it));
+    }
+    return copy;
+}
+
+static vec_table_entry_t *copy_table(vec_table_entry_t *table) {
+    vec_table_entry_t *copy = vec_table_entry_create();
+    vec_table_entry_iterator_t it = vec_table_entry_iterator(table, IT_FORWARDS);
+    while (vec_table_entry_has_next(&it)) {
+        vec_table_entry_add(copy, vec_table_entry_next(&it));
+    }
+    return copy;
+}
+
+static void restore_pooled_memory(instance_pool_t *pool, eval_state_t *instance) {
+    if (!restore_memory(instance, instance->memory, pool->memory_fd, 0, pool->memory_size)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_MEMORY, "could not restore memory snapshot");
+    }
+}
+
+/* Puts the instance back into the state right after initialization, the table is never written. */
+static void reset_instance(instance_pool_t *pool, eval_state_t *instance) {
+    if (pool->writes_globals) {
+        for (u32 i = 0; i < vec_global_entry_length(pool->globals); i++) {
+            vec_global_entry_set(instance->globals, i, vec_global_entry_get(pool->globals, i));
+        }
+    }
+    if (pool->has_memory && pool->writes_memory) {
+        restore_pooled_memory(pool, instance);
+    }
+}
+
+/* Creates an instance from the snapshot without running any initialization code. */
+static eval_state_t *create_pooled_instance(instance_pool_t *pool) {
+    eval_state_t *instance = create_interpreter();
+    instance->module = pool->module;
+    vec_table_entry_free(instance->table);
+    instance->table = copy_table(pool->table);
+    instance->globals = copy_globals(pool->globals);
+    if (pool->has_memory) {
+        use_memory(instance, create_memory((limits_t) {.min = 0, .max = pool->memory_max_size, .has_max = true}));
+        restore_pooled_memory(pool, instance);
+    }
+    return instance;
+}
+
+/* Looks for instructions writing globals or memory, assumes both if a lazily parsed body cannot be decoded. */
+static void find_writes(instance_pool_t *pool) {
+    const module_t *module = pool->module;
+    pool->writes_globals = true;
+    pool->writes_memory = true;
+    TRY_CATCH({
+                  decode_lazy_funcs(module);
+              }, {
+                  return;
+              }
+    )
+    pool->writes_globals = false;
+    pool->writes_memory = false;
+    for (u32 i = 0; module->funcs != NULL && i < vec_func_length(module->funcs); i++) {
+        vec_instruction_t *code = vec_func_getp(module->funcs, i)->code;
+        for (u32 j = 0; j < vec_instruction_length(code); j++) {
+            opcode_t opcode = vec_instruction_getp(code, j)->opcode;
+            if (opcode == OP_GLOBAL_SET) {
+                pool->writes_globals = true;
+            } else if (opcode == OP_MEMORY_GROW || (opcode >= OP_I32_STORE && opcode <= OP_I64_STORE32)) {
+                pool->writes_memory = true;
+            }
+        }
+    }
+}
+
+exception_t create_instance_pool(const module_t *module, instance_pool_t **pool) {
+    eval_state_t *template;
+    exception_t ex = instantiate(module, &template);
+    if (ex != NO_EXCEPTION) {
+        *pool = NULL;
+        return ex;
+    }
+
+    instance_pool_t *p = calloc(sizeof(instance_pool_t), 1);
+    p->module = module;
+    p->globals = copy_globals(template->globals);
+    p->table = copy_table(template->table);
+    p->memory_fd = -1;
+    pthread_mutex_init(&p->lock, NULL);
+    p->free = vec_instance_ref_create();
+    find_writes(p);
+
+    if (template->memory != NULL) {
+        p->has_memory = true;
+        p->memory_max_size = template->memory->max_size;
+        p->memory_size = template->memory->size;
+        p->memory_fd = snapshot_memory(template->memory);
+        if (p->memory_fd < 0 || !restore_memory(template, template->memory, p->memory_fd, 0, p->memory_size)) {
+            free_interpreter(template);
+            free_instance_pool(p);
+            *pool = NULL;
+            return EXCEPTION_INTERPRETER_INVALID_MEMORY;
+        }
+    }
+
+    // the template is in its initial state and becomes the first pooled instance
+    vec_instance_ref_push(p->free, template);
+    *pool = p;
+    return NO_EXCEPTION;
+}
+
+exception_t acquire_instance(instance_pool_t *pool, eval_state_t **instance) {
+    pthread_mutex_lock(&pool->lock);
+    eval_state_t *reused = vec_instance_ref_pop_or(pool->free, NULL);
+    pthread_mutex_unlock(&pool->lock);
+    if (reused != NULL) {
+        *instance = reused;
+        return NO_EXCEPTION;
+    }
+
+    TRY_CATCH({
+                  *instance = create_pooled_instance(pool);
+              }, {
+                  *instance = NULL;
+                  return exception;
+              }
+    )
+    return NO_EXCEPTION;
+}
+
+void release_instance(instance_pool_t *pool, eval_state_t *instance) {
+    TRY_CATCH({
+                  reset_instance(pool, instance);
+              }, {
+                  // an instance which cannot be reset is not reused
+                  free_interpreter(instance);
+                  return;
+              }
+    )
+    pthread_mutex_lock(&pool->lock);
+    vec_instance_ref_push(pool->free, instance);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+exception_t reset_pooled_instance(instance_pool_t *pool, eval_state_t *instance) {
+    TRY_CATCH({
+                  reset_instance(pool, instance);
+              }, {
+                  return exception;
+              }
+    )
+    return NO_EXCEPTION;
+}
+
+void free_instance_pool(instance_pool_t *pool) {
+    vec_instance_ref_iterator_t it = vec_instance_ref_iterator(pool->free, IT_FORWARDS);
+    while (vec_instance_ref_has_next(&it)) {
+        free_interpreter(vec_instance_ref_next(&it));
+    }
+    vec_instance_ref_free(pool->free);
+    vec_global_entry_free(pool->globals);
+    vec_table_entry_free(pool->table);
+    if (pool->memory_fd >= 0) {
+        close(pool->memory_fd);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
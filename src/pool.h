@@ -0,0 +1,56 @@
+#ifndef WASM_INTERPRETER_POOL_H
+#define WASM_INTERPRETER_POOL_H
+
+#include <pthread.h>
+
+#include "eval_types.h"
+#include "exception.h"
+
+typedef eval_state_t *instance_ref_t;
+
+CREATE_VEC(instance_ref_t, instance_ref)
+
+/*
+ * Pool of instances of one module. The module is instantiated once (including the start function) and the resulting
+ * globals, table and memory are kept as snapshot. The memory snapshot lives in a memfd which every instance maps
+ * copy-on-write, so acquiring and releasing an instance only remaps the memory and copies globals and table back,
+ * no initialization code runs again. Globals and memory are only reset if some function of the module can write them
+ * (the MVP has no instruction writing the table). The pool can be used from several threads.
+ */
+typedef struct instance_pool {
+    const module_t *module;
+    vec_global_entry_t *globals;  /* Globals after initialization. */
+    vec_table_entry_t *table;  /* Table after initialization. */
+    bool has_memory;
+    u32 memory_max_size;  /* Maximum memory size in pages. */
+    u32 memory_size;  /* Memory size in pages after initialization. */
+    int memory_fd;  /* memfd holding the memory contents after initialization, -1 without memory. */
+    bool writes_globals;  /* Some function contains global.set. */
+    bool writes_memory;  /* Some function contains a store or memory.grow. */
+    pthread_mutex_t lock;  /* Protects free. */
+    vec_instance_ref_t *free;  /* Instances ready to be acquired. */
+} instance_pool_t;
+
+exception_t create_instance_pool(const module_t *module, instance_pool_t **pool);
+
+/* Returns an instance in its initial state, reusing a released one if possible. */
+exception_t acquire_instance(instance_pool_t *pool, eval_state_t **instance);
+
+/* Resets the instance to the snapshot and returns it to the pool. */
+void release_instance(instance_pool_t *pool, eval_state_t *instance);
+
+/*
+ * Resets an acquired instance to the snapshot without returning it, e.g. between independent calls on one thread. A
+ * no-op if calls cannot modify instances of the module (see pool_writes_state).
+ */
+exception_t reset_pooled_instance(instance_pool_t *pool, eval_state_t *instance);
+
+/* Whether a call can leave an instance of the pool in another state than the snapshot. */
+static inline SILENCE_UNUSED bool pool_writes_state(const instance_pool_t *pool) {
+    return pool->writes_globals || pool->writes_memory;
+}
+
+/* Frees the pool and all released instances, acquired instances have to be released before. */
+void free_instance_pool(instance_pool_t *pool);
+
+#endif // WASM_INTERPRETER_POOL_H
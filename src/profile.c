@@ -0,0 +1,360 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PROFILE_OPCODE_CYCLES
+#include <x86intrin.h>
+#endif
+
+#include "profile.h"
+#include "control.h"
+#include "stack.h"
+#include "strings.h"
+
+#define NUM_OPCODES 256
+#define NO_OPCODE NUM_OPCODES /* Previous opcode at the start of a sequence. */
+#define NO_FUNC UINT32_MAX /* Site outside of a function body, e.g. an initializer expression. */
+#define PROFILE_TOP 25 /* Number of sites and bigrams in the report. */
+
+typedef struct profile_site {
+    const instruction_t *instr; /* NULL for free slots. */
+    u32 func;
+    u32 offset;
+    opcode_t opcode;
+    u64 count;
+    u64 cycles;
+} profile_site_t;
+
+typedef struct profile_bigram {
+    u32 first;
+    u32 second;
+    u64 count;
+} profile_bigram_t;
+
+/* Counters of one thread, only written by it. */
+typedef struct profile_buffer {
+    u64 counts[NUM_OPCODES];
+    u64 cycles[NUM_OPCODES];
+    u64 bigrams[NUM_OPCODES][NUM_OPCODES];
+    profile_site_t *sites; /* Open addressing hash table keyed by the instruction address. */
+    u32 site_capacity; /* Power of two. */
+    u32 site_count;
+    u32 previous; /* Opcode of the previous instruction, NO_OPCODE at the start of a sequence. */
+    opcode_t current;
+    profile_site_t *current_site;
+    u64 start; /* Timestamp before the handler of the current instruction. */
+    struct profile_buffer *next;
+} profile_buffer_t;
+
+static _Thread_local profile_buffer_t *thread_buffer = NULL;
+static profile_buffer_t *buffers = NULL;
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t register_once = PTHREAD_ONCE_INIT;
+
+static void dump_profile();
+
+static void register_dump() {
+    atexit(dump_profile);
+}
+
+static profile_buffer_t *get_buffer() {
+    if (thread_buffer != NULL) {
+        return thread_buffer;
+    }
+    profile_buffer_t *buffer = calloc(1, sizeof(profile_buffer_t));
+    if (buffer == NULL) {
+        fprintf(stderr, "profile: out of memory\n");
+        abort();
+    }
+    buffer->previous = NO_OPCODE;
+    pthread_once(&register_once, register_dump);
+    pthread_mutex_lock(&buffers_lock);
+    buffer->next = buffers;
+    buffers = buffer;
+    pthread_mutex_unlock(&buffers_lock);
+    thread_buffer = buffer;
+    return buffer;
+}
+
+static u32 site_slot(const instruction_t *instr, u32 capacity) {
+    return (u32) (((u64) (uintptr_t) instr * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1);
+}
+
+static void grow_sites(profile_buffer_t *buffer) {
+    u32 capacity = buffer->site_capacity == 0 ? 1024 : buffer->site_capacity * 2;
+    profile_site_t *sites = calloc(capacity, sizeof(profile_site_t));
+    if (sites == NULL) {
+        fprintf(stderr, "profile: out of memory\n");
+        abort();
+    }
+    for (u32 i = 0; i < buffer->site_capacity; i++) {
+        profile_site_t *site = &buffer->sites[i];
+        if (site->instr == NULL) {
+            continue;
+        }
+        u32 slot = site_slot(site->instr, capacity);
+        while (sites[slot].instr != NULL) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        sites[slot] = *site;
+    }
+    free(buffer->sites);
+    buffer->sites = sites;
+    buffer->site_capacity = capacity;
+}
+
+/* Finds the function and offset of a new site, only done once per site and thread. */
+static void locate_site(eval_state_t *eval_state, profile_site_t *site) {
+    site->func = NO_FUNC;
+    site->offset = 0;
+    frame_t *frame = current_frame(eval_state->frames);
+    funcidx func;
+    if (frame == NULL || !find_func_by_code(eval_state->module, frame->code, &func)) {
+        return;
+    }
+    vec_instruction_t *code = vec_func_getp(eval_state->module->funcs, func - eval_state->module->imported_funcs)->code;
+    if (site->instr < frame->code || site->instr >= frame->code + vec_instruction_length(code)) {
+        return;
+    }
+    site->func = func;
+    site->offset = site->instr - frame->code;
+}
+
+static profile_site_t *find_site(profile_buffer_t *buffer, eval_state_t *eval_state, const instruction_t *instr) {
+    if (buffer->site_capacity == 0) {
+        grow_sites(buffer);
+    }
+    u32 slot = site_slot(instr, buffer->site_capacity);
+    while (buffer->sites[slot].instr != NULL) {
+        if (buffer->sites[slot].instr == instr) {
+            return &buffer->sites[slot];
+        }
+        slot = (slot + 1) & (buffer->site_capacity - 1);
+    }
+    // at most half full, so probes stay short
+    if (2 * (buffer->site_count + 1) > buffer->site_capacity) {
+        grow_sites(buffer);
+        return find_site(buffer, eval_state, instr);
+    }
+    profile_site_t *site = &buffer->sites[slot];
+    *site = (profile_site_t) {.instr = instr, .opcode = instr->opcode};
+    locate_site(eval_state, site);
+    buffer->site_count++;
+    return site;
+}
+
+void profile_enter(eval_state_t *eval_state, const instruction_t *instr) {
+    profile_buffer_t *buffer = get_buffer();
+    opcode_t opcode = instr->opcode;
+    buffer->counts[opcode]++;
+    if (buffer->previous != NO_OPCODE) {
+        buffer->bigrams[buffer->previous][opcode]++;
+    }
+    buffer->previous = opcode;
+    buffer->current = opcode;
+    buffer->current_site = find_site(buffer, eval_state, instr);
+    buffer->current_site->count++;
+#ifdef PROFILE_OPCODE_CYCLES
+    buffer->start = __rdtsc();
+#endif
+}
+
+void profile_exit() {
+#ifdef PROFILE_OPCODE_CYCLES
+    u64 end = __rdtsc();
+    profile_buffer_t *buffer = thread_buffer;
+    u64 cycles = end - buffer->start;
+    buffer->cycles[buffer->current] += cycles;
+    buffer->current_site->cycles += cycles;
+#endif
+}
+
+void profile_sequence_start() {
+    get_buffer()->previous = NO_OPCODE;
+}
+
+static const u64 *sort_counts; /* Counts compare_opcode_counts sorts by, only used while dumping. */
+
+static int compare_opcode_counts(const void *a, const void *b) {
+    u64 count_a = sort_counts[*(const u32 *) a], count_b = sort_counts[*(const u32 *) b];
+    return count_a < count_b ? 1 : count_a > count_b ? -1 : 0;
+}
+
+static int compare_site_addresses(const void *a, const void *b) {
+    const instruction_t *instr_a = ((const profile_site_t *) a)->instr, *instr_b = ((const profile_site_t *) b)->instr;
+    return instr_a < instr_b ? -1 : instr_a > instr_b ? 1 : 0;
+}
+
+static int compare_site_counts(const void *a, const void *b) {
+    u64 count_a = ((const profile_site_t *) a)->count, count_b = ((const profile_site_t *) b)->count;
+    return count_a < count_b ? 1 : count_a > count_b ? -1 : 0;
+}
+
+static int compare_bigram_counts(const void *a, const void *b) {
+    u64 count_a = ((const profile_bigram_t *) a)->count, count_b = ((const profile_bigram_t *) b)->count;
+    return count_a < count_b ? 1 : count_a > count_b ? -1 : 0;
+}
+
+static double percent(u64 part, u64 total) {
+    return total == 0 ? 0 : (double) part * 100 / (double) total;
+}
+
+static void print_histogram(FILE *out, profile_buffer_t *total, u64 instructions) {
+    u32 order[NUM_OPCODES];
+    for (u32 i = 0; i < NUM_OPCODES; i++) {
+        order[i] = i;
+    }
+    sort_counts = total->counts;
+    qsort(order, NUM_OPCODES, sizeof(u32), compare_opcode_counts);
+
+    fprintf(out, "%-20s %14s %7s %7s", "opcode", "count", "%", "cum %");
+#ifdef PROFILE_OPCODE_CYCLES
+    fprintf(out, " %16s %7s %10s", "cycles", "%", "cycles/op");
+    u64 cycles = 0;
+    for (u32 i = 0; i < NUM_OPCODES; i++) {
+        cycles += total->cycles[i];
+    }
+#endif
+    fprintf(out, "\n");
+    u64 cumulative = 0;
+    for (u32 i = 0; i < NUM_OPCODES && total->counts[order[i]] > 0; i++) {
+        u32 opcode = order[i];
+        cumulative += total->counts[opcode];
+        fprintf(out, "%-20s %14lu %7.2f %7.2f", opcode2str(opcode), total->counts[opcode],
+                percent(total->counts[opcode], instructions), percent(cumulative, instructions));
+#ifdef PROFILE_OPCODE_CYCLES
+        fprintf(out, " %16lu %7.2f %10.1f", total->cycles[opcode], percent(total->cycles[opcode], cycles),
+                (double) total->cycles[opcode] / (double) total->counts[opcode]);
+#endif
+        fprintf(out, "\n");
+    }
+}
+
+static void print_sites(FILE *out, u64 instructions) {
+    u32 count = 0;
+    for (profile_buffer_t *buffer = buffers; buffer != NULL; buffer = buffer->next) {
+        count += buffer->site_count;
+    }
+    profile_site_t *sites = malloc((count + 1) * sizeof(profile_site_t));
+    if (sites == NULL) {
+        return;
+    }
+    u32 n = 0;
+    for (profile_buffer_t *buffer = buffers; buffer != NULL; buffer = buffer->next) {
+        for (u32 i = 0; i < buffer->site_capacity; i++) {
+            if (buffer->sites[i].instr != NULL) {
+                sites[n++] = buffer->sites[i];
+            }
+        }
+    }
+    // the same site executed by several threads is merged
+    qsort(sites, n, sizeof(profile_site_t), compare_site_addresses);
+    u32 merged = 0;
+    for (u32 i = 0; i < n; i++) {
+        if (merged > 0 && sites[merged - 1].instr == sites[i].instr) {
+            sites[merged - 1].count += sites[i].count;
+            sites[merged - 1].cycles += sites[i].cycles;
+        } else {
+            sites[merged++] = sites[i];
+        }
+    }
+    qsort(sites, merged, sizeof(profile_site_t), compare_site_counts);
+
+    fprintf(out, "\n%u sites, hottest:\n%-10s %8s %-20s %14s %7s", merged, "func", "offset", "opcode", "count", "%");
+#ifdef PROFILE_OPCODE_CYCLES
+    fprintf(out, " %16s %10s", "cycles", "cycles/op");
+#endif
+    fprintf(out, "\n");
+    for (u32 i = 0; i < merged && i < PROFILE_TOP; i++) {
+        profile_site_t *site = &sites[i];
+        if (site->func == NO_FUNC) {
+            fprintf(out, "%-10s %8s", "-", "-");
+        } else {
+            fprintf(out, "%-10u %8u", site->func, site->offset);
+        }
+        fprintf(out, " %-20s %14lu %7.2f", opcode2str(site->opcode), site->count, percent(site->count, instructions));
+#ifdef PROFILE_OPCODE_CYCLES
+        fprintf(out, " %16lu %10.1f", site->cycles, (double) site->cycles / (double) site->count);
+#endif
+        fprintf(out, "\n");
+    }
+    free(sites);
+}
+
+static void print_bigrams(FILE *out, profile_buffer_t *total) {
+    u32 count = 0;
+    u64 pairs = 0;
+    for (u32 i = 0; i < NUM_OPCODES; i++) {
+        for (u32 j = 0; j < NUM_OPCODES; j++) {
+            count += total->bigrams[i][j] > 0;
+            pairs += total->bigrams[i][j];
+        }
+    }
+    profile_bigram_t *bigrams = malloc((count + 1) * sizeof(profile_bigram_t));
+    if (bigrams == NULL) {
+        return;
+    }
+    u32 n = 0;
+    for (u32 i = 0; i < NUM_OPCODES; i++) {
+        for (u32 j = 0; j < NUM_OPCODES; j++) {
+            if (total->bigrams[i][j] > 0) {
+                bigrams[n++] = (profile_bigram_t) {.first = i, .second = j, .count = total->bigrams[i][j]};
+            }
+        }
+    }
+    qsort(bigrams, n, sizeof(profile_bigram_t), compare_bigram_counts);
+
+    fprintf(out, "\n%u bigrams, most frequent:\n%-20s %-20s %14s %7s %12s\n", n, "first", "second", "count", "%",
+            "% of first");
+    for (u32 i = 0; i < n && i < PROFILE_TOP; i++) {
+        profile_bigram_t *bigram = &bigrams[i];
+        // how often the first opcode is followed by the second one, the candidates for superinstructions
+        fprintf(out, "%-20s %-20s %14lu %7.2f %12.2f\n", opcode2str(bigram->first), opcode2str(bigram->second),
+                bigram->count, percent(bigram->count, pairs), percent(bigram->count, total->counts[bigram->first]));
+    }
+    free(bigrams);
+}
+
+/*
+ * Runs at exit, other threads may still be counting (e.g. detached server connections), so their last instructions
+ * may be missing from the report.
+ */
+static void dump_profile() {
+    profile_buffer_t *total = calloc(1, sizeof(profile_buffer_t));
+    if (total == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&buffers_lock);
+    u32 threads = 0;
+    for (profile_buffer_t *buffer = buffers; buffer != NULL; buffer = buffer->next) {
+        threads++;
+        for (u32 i = 0; i < NUM_OPCODES; i++) {
+            total->counts[i] += buffer->counts[i];
+            total->cycles[i] += buffer->cycles[i];
+            for (u32 j = 0; j < NUM_OPCODES; j++) {
+                total->bigrams[i][j] += buffer->bigrams[i][j];
+            }
+        }
+    }
+    u64 instructions = 0;
+    for (u32 i = 0; i < NUM_OPCODES; i++) {
+        instructions += total->counts[i];
+    }
+
+    const char *path = getenv("WASM_PROFILE");
+    FILE *out = path != NULL && *path != '\0' ? fopen(path, "w") : stderr;
+    if (out == NULL) {
+        fprintf(stderr, "profile: cannot write %s\n", path);
+        out = stderr;
+    }
+    fprintf(out, "opcode profile: %lu instructions, %u threads\n", instructions, threads);
+    print_histogram(out, total, instructions);
+    print_sites(out, instructions);
+    print_bigrams(out, total);
+    if (out != stderr) {
+        fclose(out);
+    }
+    pthread_mutex_unlock(&buffers_lock);
+    free(total);
+}
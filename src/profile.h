@@ -0,0 +1,46 @@
+#ifndef WASM_INTERPRETER_PROFILE_H
+#define WASM_INTERPRETER_PROFILE_H
+
+#include "eval_types.h"
+#include "instruction.h"
+
+/*
+ * Opcode profiler, only built with PROFILE_OPCODES (cmake -DPROFILE_OPCODES=ON). Both dispatch loops count every
+ * executed instruction per opcode, per static instruction site (function and offset in its lowered code) and per pair
+ * of consecutive opcodes. With PROFILE_OPCODE_CYCLES the handlers are also timed with rdtsc (x86 only); the cycles
+ * include the profiler itself, so they are good for comparing handlers, not as absolute costs.
+ *
+ * Every thread counts into its own buffers. On exit they are merged and the histogram, the hottest sites and bigrams
+ * are written to stderr, or to the file named by the WASM_PROFILE environment variable. Sites are identified by the
+ * address of the instruction, so the sites of a process which frees a module and loads another one may mix.
+ *
+ * In normal builds the macros below expand to nothing.
+ */
+#ifdef PROFILE_OPCODES
+
+/* Counts the instruction, called right before its handler. */
+void profile_enter(eval_state_t *eval_state, const instruction_t *instr);
+
+/* Adds the cycles of the handler called after the last profile_enter. */
+void profile_exit();
+
+/* Starts a new sequence of instructions, so no bigram spans two calls from the host. */
+void profile_sequence_start();
+
+#define PROFILE_ENTER(eval_state, instr) profile_enter(eval_state, instr)
+#ifdef PROFILE_OPCODE_CYCLES
+#define PROFILE_EXIT() profile_exit()
+#else
+#define PROFILE_EXIT()
+#endif
+#define PROFILE_SEQUENCE_START() profile_sequence_start()
+
+#else
+
+#define PROFILE_ENTER(eval_state, instr)
+#define PROFILE_EXIT()
+#define PROFILE_SEQUENCE_START()
+
+#endif // PROFILE_OPCODES
+
+#endif // WASM_INTERPRETER_PROFILE_H
@@ -0,0 +1,238 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "interpreter.h"
+#include "pool.h"
+
+typedef struct connection {
+    instance_pool_t *pool;
+    int fd;
+} connection_t;
+
+/* false on end of file and errors. */
+static bool read_full(int fd, void *buffer, size_t size) {
+    byte *pos = buffer;
+    while (size > 0) {
+        ssize_t n = read(fd, pos, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        pos += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const void *buffer, size_t size) {
+    const byte *pos = buffer;
+    while (size > 0) {
+        // a peer which went away must not kill the server with SIGPIPE
+        ssize_t n = send(fd, pos, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        pos += n;
+        size -= n;
+    }
+    return true;
+}
+
+static server_value_t to_server_value(valtype_t type, val_t val) {
+    bool is_32 = type == VALTYPE_I32 || type == VALTYPE_F32;
+    return (server_value_t) {.type = type, .bits = is_32 ? (u32) val.i32 : (u64) val.i64};
+}
+
+static parameter_value_t from_server_value(server_value_t value) {
+    parameter_value_t param = {.type = value.type};
+    if (value.type == VALTYPE_I32 || value.type == VALTYPE_F32) {
+        param.val.i32 = (i32) value.bits;
+    } else {
+        param.val.i64 = (i64) value.bits;
+    }
+    return param;
+}
+
+/* Reads the next request into name and parameters, false if the connection is closed or the request is malformed. */
+static bool read_request(int fd, char **name, u32 *name_capacity, vec_parameter_value_t *parameters) {
+    server_request_t request;
+    if (!read_full(fd, &request, sizeof(request))
+        || request.name_length > SERVER_MAX_NAME_LENGTH || request.arg_count > SERVER_MAX_ARGS) {
+        return false;
+    }
+    if (request.name_length + 1 > *name_capacity) {
+        char *grown = realloc(*name, request.name_length + 1);
+        if (grown == NULL) {
+            return false;
+        }
+        *name = grown;
+        *name_capacity = request.name_length + 1;
+    }
+    if (!read_full(fd, *name, request.name_length)) {
+        return false;
+    }
+    (*name)[request.name_length] = '\0';
+
+    vec_parameter_value_resize(parameters, 0);
+    for (u32 i = 0; i < request.arg_count; i++) {
+        server_value_t value;
+        if (!read_full(fd, &value, sizeof(value))) {
+            return false;
+        }
+        vec_parameter_value_add(parameters, from_server_value(value));
+    }
+    return true;
+}
+
+static void *serve_connection(void *arg) {
+    connection_t *connection = arg;
+    eval_state_t *instance = NULL;
+    // without an instance every call is answered with the exception of instantiating
+    exception_t instance_ex = acquire_instance(connection->pool, &instance);
+
+    vec_parameter_value_t *parameters = vec_parameter_value_create();
+    char *name = NULL;
+    u32 name_capacity = 0;
+    while (read_request(connection->fd, &name, &name_capacity, parameters)) {
+        server_response_t response = {.exception = instance_ex};
+        if (instance != NULL) {
+            return_value_t ret;
+            response.exception = interpret_function(instance, name, parameters, &ret);
+            if (response.exception == NO_EXCEPTION && !ret.is_void) {
+                response.result = to_server_value(ret.type, ret.val);
+            }
+        }
+        if (!write_full(connection->fd, &response, sizeof(response))) {
+            break;
+        }
+    }
+
+    free(name);
+    vec_parameter_value_free(parameters);
+    if (instance != NULL) {
+        release_instance(connection->pool, instance);
+    }
+    close(connection->fd);
+    free(connection);
+    return NULL;
+}
+
+static exception_t socket_address(const char *socket_path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {
+        return EXCEPTION_SERVER_SOCKET_FAILED;
+    }
+    strcpy(address->sun_path, socket_path);
+    return NO_EXCEPTION;
+}
+
+exception_t run_server(const module_t *module, const char *socket_path) {
+    struct sockaddr_un address;
+    if (socket_address(socket_path, &address) != NO_EXCEPTION) {
+        return EXCEPTION_SERVER_SOCKET_FAILED;
+    }
+    instance_pool_t *pool;
+    exception_t ex = create_instance_pool(module, &pool);
+    if (ex != NO_EXCEPTION) {
+        return ex;
+    }
+
+    // a socket left behind by an earlier server is replaced, any other file is not
+    struct stat st;
+    if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(socket_path);
+    }
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &address, sizeof(address)) != 0
+        || listen(listen_fd, SOMAXCONN) != 0) {
+        if (listen_fd >= 0) {
+            close(listen_fd);
+        }
+        free_instance_pool(pool);
+        return EXCEPTION_SERVER_SOCKET_FAILED;
+    }
+
+    while (true) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        connection_t *connection = malloc(sizeof(connection_t));
+        pthread_t thread;
+        if (connection == NULL) {
+            close(fd);
+            continue;
+        }
+        *connection = (connection_t) {.pool = pool, .fd = fd};
+        if (pthread_create(&thread, NULL, serve_connection, connection) != 0) {
+            close(fd);
+            free(connection);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+exception_t connect_server(const char *socket_path, int *fd) {
+    struct sockaddr_un address;
+    if (socket_address(socket_path, &address) != NO_EXCEPTION) {
+        return EXCEPTION_SERVER_SOCKET_FAILED;
+    }
+    *fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (*fd < 0) {
+        return EXCEPTION_SERVER_SOCKET_FAILED;
+    }
+    if (connect(*fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        close(*fd);
+        *fd = -1;
+        return EXCEPTION_SERVER_SOCKET_FAILED;
+    }
+    return NO_EXCEPTION;
+}
+
+exception_t server_call(int fd, const char *func_name, vec_parameter_value_t *parameters, return_value_t *ret) {
+    server_request_t request = {
+            .name_length = strlen(func_name),
+            .arg_count = vec_parameter_value_length(parameters),
+    };
+    // the request is sent with a single write
+    size_t size = sizeof(request) + request.name_length + request.arg_count * sizeof(server_value_t);
+    byte *buffer = malloc(size);
+    if (buffer == NULL) {
+        return EXCEPTION_SERVER_CONNECTION_CLOSED;
+    }
+    memcpy(buffer, &request, sizeof(request));
+    memcpy(buffer + sizeof(request), func_name, request.name_length);
+    byte *values = buffer + sizeof(request) + request.name_length;
+    for (u32 i = 0; i < request.arg_count; i++) {
+        parameter_value_t param = vec_parameter_value_get(parameters, i);
+        server_value_t value = to_server_value(param.type, param.val);
+        memcpy(values + i * sizeof(value), &value, sizeof(value));
+    }
+    bool sent = write_full(fd, buffer, size);
+    free(buffer);
+
+    server_response_t response;
+    if (!sent || !read_full(fd, &response, sizeof(response))) {
+        return EXCEPTION_SERVER_CONNECTION_CLOSED;
+    }
+    if (response.exception != NO_EXCEPTION) {
+        return response.exception;
+    }
+    ret->is_void = response.result.type == VALTYPE_UNKNOWN;
+    ret->type = response.result.type;
+    ret->val = from_server_value(response.result).val;
+    return NO_EXCEPTION;
+}
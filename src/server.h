@@ -0,0 +1,47 @@
+#ifndef WASM_INTERPRETER_SERVER_H
+#define WASM_INTERPRETER_SERVER_H
+
+#include "eval_types.h"
+#include "exception.h"
+
+/*
+ * Server mode keeps a module loaded and serves calls of its exports over a Unix domain socket. Every connection gets
+ * its own instance from an instance pool (see pool.h): calls on one connection share the instance state, a new
+ * connection starts from the initialized state again. Connections are served concurrently, one thread each.
+ *
+ * The protocol is binary, in host byte order as both sides run on the same machine. A request is a server_request_t
+ * followed by name_length bytes of the export name and arg_count server_value_t arguments, it is answered with one
+ * server_response_t. Requests on one connection are answered in order. Malformed requests close the connection.
+ */
+#define SERVER_MAX_NAME_LENGTH (64 * 1024)
+#define SERVER_MAX_ARGS 1024
+
+typedef struct server_request {
+    u32 name_length;
+    u32 arg_count;
+} server_request_t;
+
+typedef struct server_value {
+    u32 type; /* valtype_t, VALTYPE_UNKNOWN for the result of functions without one */
+    u32 reserved;
+    u64 bits; /* i32 and f32 in the low 32 bits */
+} server_value_t;
+
+typedef struct server_response {
+    u32 exception; /* exception_t of the call, e.g. the trap code, NO_EXCEPTION if it returned */
+    u32 reserved;
+    server_value_t result;
+} server_response_t;
+
+/* Serves calls until the process is terminated, only returns if the socket cannot be set up. */
+exception_t run_server(const module_t *module, const char *socket_path);
+
+exception_t connect_server(const char *socket_path, int *fd);
+
+/*
+ * Calls an export on the instance of the connection. Returns the exception of the call, or
+ * EXCEPTION_SERVER_CONNECTION_CLOSED if the server could not be reached.
+ */
+exception_t server_call(int fd, const char *func_name, vec_parameter_value_t *parameters, return_value_t *ret);
+
+#endif // WASM_INTERPRETER_SERVER_H
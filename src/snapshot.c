@@ -0,0 +1,202 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+#include "interpreter.h"
+#include "memory.h"
+
+#define SNAPSHOT_MAGIC 0x504e5357 // "WSNP"
+#define SNAPSHOT_VERSION 1
+
+typedef struct snapshot_header {
+    u32 magic;
+    u32 version;
+    u64 module_key;
+    u32 global_entry_size;  /* sizeof(global_entry_t) and sizeof(table_entry_t) of the writer, guards the raw layout. */
+    u32 table_entry_size;
+    u32 global_count;
+    u32 table_length;
+    u32 has_memory;
+    u32 memory_size;  /* Pages. */
+    u32 memory_max_size;  /* Pages. */
+    u32 padding;
+    u64 memory_offset;  /* File offset of the memory contents, a multiple of PAGE_SIZE. */
+} snapshot_header_t;
+
+static void write_all(int fd, const void *data, size_t length) {
+    const byte *bytes = data;
+    while (length > 0) {
+        ssize_t n = write(fd, bytes, length);
+        if (n <= 0) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SNAPSHOT, "could not write snapshot");
+        }
+        bytes += n;
+        length -= n;
+    }
+}
+
+static void read_all(int fd, void *data, size_t length) {
+    byte *bytes = data;
+    while (length > 0) {
+        ssize_t n = read(fd, bytes, length);
+        if (n <= 0) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SNAPSHOT, "snapshot is truncated");
+        }
+        bytes += n;
+        length -= n;
+    }
+}
+
+static void _write_snapshot(eval_state_t *instance, u64 module_key, int fd) {
+    u32 global_count = vec_global_entry_length(instance->globals);
+    u32 table_length = vec_table_entry_length(instance->table);
+    size_t entries_end = sizeof(snapshot_header_t) + global_count * sizeof(global_entry_t) +
+                         table_length * sizeof(table_entry_t);
+
+    snapshot_header_t header = {
+            .magic = SNAPSHOT_MAGIC,
+            .version = SNAPSHOT_VERSION,
+            .module_key = module_key,
+            .global_entry_size = sizeof(global_entry_t),
+            .table_entry_size = sizeof(table_entry_t),
+            .global_count = global_count,
+            .table_length = table_length,
+            .has_memory = instance->memory != NULL,
+            .memory_size = instance->memory != NULL ? instance->memory->size : 0,
+            .memory_max_size = instance->memory != NULL ? instance->memory->max_size : 0,
+            .memory_offset = (entries_end + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE,
+    };
+    write_all(fd, &header, sizeof(header));
+    for (u32 i = 0; i < global_count; i++) {
+        write_all(fd, vec_global_entry_getp(instance->globals, i), sizeof(global_entry_t));
+    }
+    for (u32 i = 0; i < table_length; i++) {
+        write_all(fd, vec_table_entry_getp(instance->table, i), sizeof(table_entry_t));
+    }
+
+    if (header.has_memory) {
+        if (lseek(fd, header.memory_offset, SEEK_SET) < 0) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SNAPSHOT, "could not write snapshot");
+        }
+        write_all(fd, instance->memory->data, (size_t) header.memory_size * PAGE_SIZE);
+    }
+}
+
+exception_t write_snapshot(eval_state_t *instance, u64 module_key, const char *path) {
+    // written to a temporary file and renamed, so concurrent readers never see a partial snapshot
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, getpid());
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return EXCEPTION_INTERPRETER_INVALID_SNAPSHOT;
+    }
+
+    exception_t ex = NO_EXCEPTION;
+    TRY_CATCH({
+                  _write_snapshot(instance, module_key, fd);
+              }, {
+                  ex = exception;
+              }
+    )
+    if (close(fd) != 0 && ex == NO_EXCEPTION) {
+        ex = EXCEPTION_INTERPRETER_INVALID_SNAPSHOT;
+    }
+    if (ex == NO_EXCEPTION && rename(tmp_path, path) != 0) {
+        ex = EXCEPTION_INTERPRETER_INVALID_SNAPSHOT;
+    }
+    if (ex != NO_EXCEPTION) {
+        unlink(tmp_path);
+    }
+    return ex;
+}
+
+/* Length of the table init_tables creates, tables never grow. */
+static u32 module_table_length(const module_t *module) {
+    if (module->tables == NULL || module->elem == NULL || vec_tabletype_length(module->tables) == 0) {
+        return 0;
+    }
+    return vec_tabletype_get(module->tables, 0).lim.min;
+}
+
+static void _instantiate_snapshot(eval_state_t *instance, u64 module_key, int fd) {
+    const module_t *module = instance->module;
+
+    snapshot_header_t header;
+    read_all(fd, &header, sizeof(header));
+    if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION ||
+        header.global_entry_size != sizeof(global_entry_t) || header.table_entry_size != sizeof(table_entry_t)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SNAPSHOT, "not a snapshot of this interpreter version");
+    }
+    if (header.module_key != module_key) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SNAPSHOT, "snapshot belongs to another module");
+    }
+    u32 global_count = module->globals != NULL ? vec_global_length(module->globals) : 0;
+    if (header.global_count != global_count || header.table_length != module_table_length(module)
+        || header.has_memory != (module->mems != NULL)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SNAPSHOT, "snapshot does not match the module");
+    }
+    if (header.has_memory) {
+        // the limits are checked here, memory.grow relies on size <= max_size
+        limits_t lim = vec_memtype_get(module->mems, 0).lim;
+        if (header.memory_max_size != (lim.has_max ? lim.max : MAX_MEMORY_PAGES)
+            || header.memory_size < lim.min || header.memory_size > header.memory_max_size) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SNAPSHOT, "snapshot does not match the module");
+        }
+    }
+
+    instance->globals = vec_global_entry_create();
+    for (u32 i = 0; i < header.global_count; i++) {
+        global_entry_t global;
+        read_all(fd, &global, sizeof(global));
+        vec_global_entry_add(instance->globals, global);
+    }
+    for (u32 i = 0; i < header.table_length; i++) {
+        table_entry_t entry;
+        read_all(fd, &entry, sizeof(entry));
+        if (entry.initialized && entry.funcidx >= module->imported_funcs
+            && get_defined_func(module, entry.funcidx) == NULL) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SNAPSHOT, "snapshot does not match the module");
+        }
+        vec_table_entry_add(instance->table, entry);
+    }
+
+    if (header.has_memory) {
+        struct stat st;
+        if (fstat(fd, &st) != 0 ||
+            (u64) st.st_size < header.memory_offset + (u64) header.memory_size * PAGE_SIZE) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SNAPSHOT, "snapshot is truncated");
+        }
+        use_memory(instance, create_memory((limits_t) {.min = 0, .max = header.memory_max_size, .has_max = true}));
+        if (!restore_memory(instance, instance->memory, fd, header.memory_offset, header.memory_size)) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_INTERPRETER_INVALID_SNAPSHOT, "could not map snapshot memory");
+        }
+    }
+}
+
+exception_t instantiate_snapshot(const module_t *module, u64 module_key, const char *path, eval_state_t **instance) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        *instance = NULL;
+        return EXCEPTION_INTERPRETER_INVALID_SNAPSHOT;
+    }
+
+    eval_state_t *eval_state = create_interpreter();
+    eval_state->module = module;
+    exception_t ex = NO_EXCEPTION;
+    TRY_CATCH({
+                  _instantiate_snapshot(eval_state, module_key, fd);
+              }, {
+                  ex = exception;
+              }
+    )
+    // the memory mapping stays valid after closing
+    close(fd);
+    if (ex != NO_EXCEPTION) {
+        free_interpreter(eval_state);
+        eval_state = NULL;
+    }
+    *instance = eval_state;
+    return ex;
+}
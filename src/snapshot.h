@@ -0,0 +1,19 @@
+#ifndef WASM_INTERPRETER_SNAPSHOT_H
+#define WASM_INTERPRETER_SNAPSHOT_H
+
+#include "eval_types.h"
+#include "exception.h"
+
+/*
+ * Snapshots store the globals, table and memory of an initialized instance (after the start function ran), so later
+ * processes can skip initialization. The memory contents are stored page aligned and mapped copy-on-write from the
+ * file, pages are only read once touched.
+ *
+ * module_key identifies the module the snapshot belongs to (e.g. a hash of the module file), a snapshot is rejected
+ * with EXCEPTION_INTERPRETER_INVALID_SNAPSHOT if it was written for another key or another layout.
+ */
+exception_t write_snapshot(eval_state_t *instance, u64 module_key, const char *path);
+
+exception_t instantiate_snapshot(const module_t *module, u64 module_key, const char *path, eval_state_t **instance);
+
+#endif // WASM_INTERPRETER_SNAPSHOT_H
@@ -0,0 +1,54 @@
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "stack.h"
+
+/* Maps size bytes followed by a PROT_NONE guard page, physical pages are only committed once touched. */
+static void *map_guarded(size_t size) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size = (size + page_size - 1) & ~(page_size - 1);
+
+    char *mem = mmap(NULL, size + page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                     -1, 0);
+    if (mem == MAP_FAILED) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VECTOR_EXCEPTION, "mmap of %zu bytes failed", size + page_size);
+    }
+    if (mprotect(mem + size, page_size, PROT_NONE) != 0) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VECTOR_EXCEPTION, "mprotect of guard page failed");
+    }
+    return mem;
+}
+
+static void unmap_guarded(void *mem, size_t size) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size = (size + page_size - 1) & ~(page_size - 1);
+    munmap(mem, size + page_size);
+}
+
+opd_stack_t *create_opd_stack() {
+    opd_stack_t *stack = calloc(sizeof(opd_stack_t), 1);
+    stack->base = map_guarded(sizeof(stack_entry_t) * OPD_STACK_SIZE);
+    stack->top = stack->base;
+    stack->limit = stack->base + OPD_STACK_SIZE;
+    return stack;
+}
+
+void free_opd_stack(opd_stack_t *stack) {
+    if (stack == NULL) return;
+    unmap_guarded(stack->base, sizeof(stack_entry_t) * OPD_STACK_SIZE);
+    free(stack);
+}
+
+call_stack_t *create_call_stack() {
+    call_stack_t *stack = calloc(sizeof(call_stack_t), 1);
+    stack->base = map_guarded(sizeof(frame_t) * CALL_STACK_SIZE);
+    stack->top = stack->base;
+    stack->limit = stack->base + CALL_STACK_SIZE;
+    return stack;
+}
+
+void free_call_stack(call_stack_t *stack) {
+    if (stack == NULL) return;
+    unmap_guarded(stack->base, sizeof(frame_t) * CALL_STACK_SIZE);
+    free(stack);
+}
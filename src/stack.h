@@ -2,186 +2,171 @@
 #define WASM_INTERPRETER_STACK_H
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <assert.h>
 
 #include "type.h"
 #include "eval_types.h"
 #include "interpreter.h"
 
-static SILENCE_UNUSED void push_i32(opd_stack_t *stack, i32 value) {
-    vec_stack_entry_add(stack, (stack_entry_t) {
-            .valtype = VALTYPE_I32,
-            .value = (val_t) {
-                    .i32 = value,
-            },
-            .marker = MARKER_VALUE,
-    });
-}
+#ifdef TYPED_OPERAND_STACK
+#define STACK_ENTRY_SET_TYPE(entry, type) ((entry)->valtype = (type))
+#define STACK_ENTRY_ASSERT_TYPE(entry, type) assert((entry)->valtype == (type))
+#define STACK_ASSERT_NOT_EMPTY(stack) assert((stack)->top > (stack)->base)
+#else
+#define STACK_ENTRY_SET_TYPE(entry, type) ((void) (type))
+#define STACK_ENTRY_ASSERT_TYPE(entry, type) ((void) (type))
+#define STACK_ASSERT_NOT_EMPTY(stack) ((void) 0)
+#endif
 
-static SILENCE_UNUSED void push_i64(opd_stack_t *stack, i64 value) {
-    vec_stack_entry_add(stack, (stack_entry_t) {
-            .valtype = VALTYPE_I64,
-            .value = (val_t) {
-                    .i64 = value,
-            },
-            .marker = MARKER_VALUE,
-    });
-}
+/*
+ * The operand stack and the call stack have a fixed capacity and are followed by a PROT_NONE guard page, running
+ * into it raises EXCEPTION_INTERPRETER_CALL_STACK_EXHAUSTED (see fault.h). eval_call additionally checks that the
+ * operand stack can hold the maximum stack height of the callee, so pushes need no bounds check.
+ */
+#define OPD_STACK_SIZE (1 << 20)
+#define CALL_STACK_SIZE (1 << 16)
+
+opd_stack_t *create_opd_stack();
+
+void free_opd_stack(opd_stack_t *stack);
+
+call_stack_t *create_call_stack();
+
+void free_call_stack(call_stack_t *stack);
 
-static SILENCE_UNUSED void push_f32(opd_stack_t *stack, f32 value) {
-    vec_stack_entry_add(stack, (stack_entry_t) {
-            .valtype = VALTYPE_F32,
-            .value = (val_t) {
-                    .f32 = value,
-            },
-            .marker = MARKER_VALUE,
-    });
+static inline SILENCE_UNUSED u32 stack_height(opd_stack_t *stack) {
+    return stack->top - stack->base;
 }
 
-static SILENCE_UNUSED void push_f64(opd_stack_t *stack, f64 value) {
-    vec_stack_entry_add(stack, (stack_entry_t) {
-            .valtype = VALTYPE_F64,
-            .value = (val_t) {
-                    .f64 = value,
-            },
-            .marker = MARKER_VALUE,
-    });
+static inline SILENCE_UNUSED stack_entry_t *push_entry(opd_stack_t *stack) {
+    return stack->top++;
 }
 
-static SILENCE_UNUSED void push_generic(opd_stack_t *stack, valtype_t valtype, val_t val) {
-    vec_stack_entry_add(stack, (stack_entry_t) {
-            .valtype = valtype,
-            .value = val,
-            .marker = MARKER_VALUE,
-    });
+static inline SILENCE_UNUSED stack_entry_t *pop_entry(opd_stack_t *stack) {
+    STACK_ASSERT_NOT_EMPTY(stack);
+    return --stack->top;
 }
 
-static SILENCE_UNUSED i32 pop_i32(opd_stack_t *stack) {
-    stack_entry_t entry = vec_stack_entry_pop(stack);
-    assert(entry.marker == MARKER_VALUE);
-    assert(entry.valtype == VALTYPE_I32);
-    return entry.value.i32;
+static inline SILENCE_UNUSED stack_entry_t *peek_entry(opd_stack_t *stack) {
+    STACK_ASSERT_NOT_EMPTY(stack);
+    return stack->top - 1;
 }
 
-static SILENCE_UNUSED i64 pop_i64(opd_stack_t *stack) {
-    stack_entry_t entry = vec_stack_entry_pop(stack);
-    assert(entry.marker == MARKER_VALUE);
-    assert(entry.valtype == VALTYPE_I64);
-    return entry.value.i64;
+static inline SILENCE_UNUSED void push_i32(opd_stack_t *stack, i32 value) {
+    stack_entry_t *entry = push_entry(stack);
+    entry->value.i32 = value;
+    STACK_ENTRY_SET_TYPE(entry, VALTYPE_I32);
 }
 
-static SILENCE_UNUSED f32 pop_f32(opd_stack_t *stack) {
-    stack_entry_t entry = vec_stack_entry_pop(stack);
-    assert(entry.marker == MARKER_VALUE);
-    assert(entry.valtype == VALTYPE_F32);
-    return entry.value.f32;
+static inline SILENCE_UNUSED void push_i64(opd_stack_t *stack, i64 value) {
+    stack_entry_t *entry = push_entry(stack);
+    entry->value.i64 = value;
+    STACK_ENTRY_SET_TYPE(entry, VALTYPE_I64);
 }
 
-static SILENCE_UNUSED f64 pop_f64(opd_stack_t *stack) {
-    stack_entry_t entry = vec_stack_entry_pop(stack);
-    assert(entry.marker == MARKER_VALUE);
-    assert(entry.valtype == VALTYPE_F64);
-    return entry.value.f64;
+static inline SILENCE_UNUSED void push_f32(opd_stack_t *stack, f32 value) {
+    stack_entry_t *entry = push_entry(stack);
+    entry->value.f32 = value;
+    STACK_ENTRY_SET_TYPE(entry, VALTYPE_F32);
 }
 
-static SILENCE_UNUSED void pop_generic(opd_stack_t *stack, valtype_t *valtype, val_t *val) {
-    stack_entry_t entry = vec_stack_entry_pop(stack);
-    assert(entry.marker == MARKER_VALUE);
-    *valtype = entry.valtype;
-    *val = entry.value;
+static inline SILENCE_UNUSED void push_f64(opd_stack_t *stack, f64 value) {
+    stack_entry_t *entry = push_entry(stack);
+    entry->value.f64 = value;
+    STACK_ENTRY_SET_TYPE(entry, VALTYPE_F64);
 }
 
-static SILENCE_UNUSED void pop_generic_assert_type(opd_stack_t *stack, valtype_t valtype, val_t *val) {
-    stack_entry_t entry = vec_stack_entry_pop(stack);
-    assert(entry.marker == MARKER_VALUE);
-    assert(entry.valtype == valtype);
-    *val = entry.value;
+static inline SILENCE_UNUSED void push_generic(opd_stack_t *stack, valtype_t valtype, val_t val) {
+    stack_entry_t *entry = push_entry(stack);
+    entry->value = val;
+    STACK_ENTRY_SET_TYPE(entry, valtype);
 }
 
-static SILENCE_UNUSED i32 peek_i32(opd_stack_t *stack) {
-    stack_entry_t entry = vec_stack_entry_peek(stack);
-    assert(entry.marker == MARKER_VALUE);
-    assert(entry.valtype == VALTYPE_I32);
-    return entry.value.i32;
+static inline SILENCE_UNUSED i32 pop_i32(opd_stack_t *stack) {
+    stack_entry_t *entry = pop_entry(stack);
+    STACK_ENTRY_ASSERT_TYPE(entry, VALTYPE_I32);
+    return entry->value.i32;
 }
 
-static SILENCE_UNUSED i64 peek_i64(opd_stack_t *stack) {
-    stack_entry_t entry = vec_stack_entry_peek(stack);
-    assert(entry.marker == MARKER_VALUE);
-    assert(entry.valtype == VALTYPE_I64);
-    return entry.value.i64;
+static inline SILENCE_UNUSED i64 pop_i64(opd_stack_t *stack) {
+    stack_entry_t *entry = pop_entry(stack);
+    STACK_ENTRY_ASSERT_TYPE(entry, VALTYPE_I64);
+    return entry->value.i64;
 }
 
-static SILENCE_UNUSED f32 peek_f32(opd_stack_t *stack) {
-    stack_entry_t entry = vec_stack_entry_peek(stack);
-    assert(entry.marker == MARKER_VALUE);
-    assert(entry.valtype == VALTYPE_F32);
-    return entry.value.f32;
+static inline SILENCE_UNUSED f32 pop_f32(opd_stack_t *stack) {
+    stack_entry_t *entry = pop_entry(stack);
+    STACK_ENTRY_ASSERT_TYPE(entry, VALTYPE_F32);
+    return entry->value.f32;
 }
 
-static SILENCE_UNUSED f64 peek_f64(opd_stack_t *stack) {
-    stack_entry_t entry = vec_stack_entry_peek(stack);
-    assert(entry.marker == MARKER_VALUE);
-    assert(entry.valtype == VALTYPE_F64);
-    return entry.value.f64;
+static inline SILENCE_UNUSED f64 pop_f64(opd_stack_t *stack) {
+    stack_entry_t *entry = pop_entry(stack);
+    STACK_ENTRY_ASSERT_TYPE(entry, VALTYPE_F64);
+    return entry->value.f64;
 }
 
-static SILENCE_UNUSED void peek_generic(opd_stack_t *stack, valtype_t *valtype, val_t *val) {
-    stack_entry_t entry = vec_stack_entry_peek(stack);
-    assert(entry.marker == MARKER_VALUE);
-    *valtype = entry.valtype;
-    *val = entry.value;
+static inline SILENCE_UNUSED void pop_generic_assert_type(opd_stack_t *stack, valtype_t valtype, val_t *val) {
+    stack_entry_t *entry = pop_entry(stack);
+    STACK_ENTRY_ASSERT_TYPE(entry, valtype);
+    *val = entry->value;
 }
 
-static SILENCE_UNUSED void peek_generic_assert_type(opd_stack_t *stack, valtype_t valtype, val_t *val) {
-    stack_entry_t entry = vec_stack_entry_peek(stack);
-    assert(entry.marker == MARKER_VALUE);
-    assert(entry.valtype == valtype);
-    *val = entry.value;
+static inline SILENCE_UNUSED i32 peek_i32(opd_stack_t *stack) {
+    stack_entry_t *entry = peek_entry(stack);
+    STACK_ENTRY_ASSERT_TYPE(entry, VALTYPE_I32);
+    return entry->value.i32;
 }
 
-static SILENCE_UNUSED valtype_t peek_valtype(opd_stack_t *stack) {
-    stack_entry_t entry = vec_stack_entry_peek(stack);
-    assert(entry.marker == MARKER_VALUE);
-    return entry.valtype;
+static inline SILENCE_UNUSED i64 peek_i64(opd_stack_t *stack) {
+    stack_entry_t *entry = peek_entry(stack);
+    STACK_ENTRY_ASSERT_TYPE(entry, VALTYPE_I64);
+    return entry->value.i64;
 }
 
-static SILENCE_UNUSED marker_t peek_marker(opd_stack_t *stack) {
-    stack_entry_t entry = vec_stack_entry_peek(stack);
-    return entry.marker;
+static inline SILENCE_UNUSED f32 peek_f32(opd_stack_t *stack) {
+    stack_entry_t *entry = peek_entry(stack);
+    STACK_ENTRY_ASSERT_TYPE(entry, VALTYPE_F32);
+    return entry->value.f32;
 }
 
-static SILENCE_UNUSED void push_marker_label(opd_stack_t *stack) {
-    vec_stack_entry_add(stack, (stack_entry_t) {
-            .marker = MARKER_LABEL,
-    });
+static inline SILENCE_UNUSED f64 peek_f64(opd_stack_t *stack) {
+    stack_entry_t *entry = peek_entry(stack);
+    STACK_ENTRY_ASSERT_TYPE(entry, VALTYPE_F64);
+    return entry->value.f64;
 }
 
-static SILENCE_UNUSED bool pop_marker_label(opd_stack_t *stack) {
-    return vec_stack_entry_pop(stack).marker == MARKER_LABEL;
+static inline SILENCE_UNUSED void peek_generic_assert_type(opd_stack_t *stack, valtype_t valtype, val_t *val) {
+    stack_entry_t *entry = peek_entry(stack);
+    STACK_ENTRY_ASSERT_TYPE(entry, valtype);
+    *val = entry->value;
 }
 
-static SILENCE_UNUSED void push_marker_func(opd_stack_t *stack) {
-    vec_stack_entry_add(stack, (stack_entry_t) {
-            .marker = MARKER_FUNCTION,
-    });
+static inline SILENCE_UNUSED void drop(opd_stack_t *stack) {
+    pop_entry(stack);
 }
 
-static SILENCE_UNUSED bool pop_marker_func(opd_stack_t *stack) {
-    return vec_stack_entry_pop(stack).marker == MARKER_FUNCTION;
+/* Truncates the stack to the given height, keeping the topmost arity (<= 1) values. */
+static inline SILENCE_UNUSED void unwind(opd_stack_t *stack, u32 height, u32 arity) {
+    stack_entry_t *top = stack->base + height;
+    if (arity > 0) {
+        *top++ = *peek_entry(stack);
+    }
+    stack->top = top;
 }
 
-static SILENCE_UNUSED bool pop_marker_label_or_func(opd_stack_t *stack) {
-    marker_t marker = vec_stack_entry_pop(stack).marker;
-    return marker == MARKER_FUNCTION || marker == MARKER_LABEL;
+static inline SILENCE_UNUSED frame_t *push_frame(call_stack_t *stack) {
+    return stack->top++;
 }
 
-static SILENCE_UNUSED stack_entry_t *peek(opd_stack_t *stack) {
-    return vec_stack_entry_peekp_or(stack, NULL);
+static inline SILENCE_UNUSED void pop_frame(call_stack_t *stack) {
+    stack->top--;
 }
 
-static SILENCE_UNUSED void drop(opd_stack_t *stack) {
-    vec_stack_entry_pop(stack);
+/* Returns NULL if there is no active call. */
+static inline SILENCE_UNUSED frame_t *current_frame(call_stack_t *stack) {
+    return stack->top == stack->base ? NULL : stack->top - 1;
 }
 
 #endif //WASM_INTERPRETER_STACK_H
@@ -18,6 +18,8 @@ static SILENCE_UNUSED const char *opcode2str(opcode_t opcode) {
             return "if";
         case OP_ELSE:
             return "else";
+        case OP_END:
+            return "end";
         case OP_BR:
             return "br";
         case OP_BR_IF:
@@ -353,4 +355,19 @@ static SILENCE_UNUSED const char *opcode2str(opcode_t opcode) {
     }
 }
 
+static SILENCE_UNUSED const char *valtype2str(valtype_t valtype) {
+    switch (valtype) {
+        case VALTYPE_I32:
+            return "i32";
+        case VALTYPE_I64:
+            return "i64";
+        case VALTYPE_F32:
+            return "f32";
+        case VALTYPE_F64:
+            return "f64";
+        default:
+            return "unknown";
+    }
+}
+
 #endif // STRINGS_H
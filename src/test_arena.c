@@ -0,0 +1,128 @@
+#include <stdlib.h>
+
+#include "test_compare.h"
+#include "arena.h"
+
+#ifndef WASM_BENCH_DIR
+#define WASM_BENCH_DIR "bench"
+#endif
+
+#define ALLOCATIONS 2000
+
+typedef struct allocation {
+    byte *ptr;
+    size_t size;
+} allocation_t;
+
+/* Sizes from 0 bytes up to allocations which get a chunk of their own. */
+static size_t allocation_size(u32 i) {
+    if (i % 97 == 0) {
+        return ARENA_CHUNK_SIZE / 4 + i;
+    }
+    if (i % 501 == 0) {
+        return 3 * ARENA_CHUNK_SIZE;
+    }
+    return i % 67;
+}
+
+/* Allocates and fills allocations [from, to), every allocation gets its own pattern. */
+static void allocate(arena_t *arena, allocation_t *allocations, u32 from, u32 to) {
+    for (u32 i = from; i < to; i++) {
+        allocations[i].size = allocation_size(i);
+        allocations[i].ptr = arena_alloc(arena, allocations[i].size);
+        CHECK(allocations[i].ptr != NULL, "allocation %u failed", i);
+        CHECK((uintptr_t) allocations[i].ptr % ARENA_ALIGNMENT == 0, "allocation %u is not aligned", i);
+        memset(allocations[i].ptr, (int) (i % 251), allocations[i].size);
+    }
+}
+
+/* Allocations must not overlap, so each one still holds its pattern. */
+static void check_allocations(const allocation_t *allocations, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        for (size_t j = 0; j < allocations[i].size; j++) {
+            CHECK(allocations[i].ptr[j] == (byte) (i % 251), "allocation %u was overwritten", i);
+        }
+    }
+}
+
+void test_alloc() {
+    static allocation_t allocations[ALLOCATIONS];
+    arena_t *arena = create_arena();
+    allocate(arena, allocations, 0, ALLOCATIONS);
+    check_allocations(allocations, ALLOCATIONS);
+    free_arena(arena);
+    free_arena(NULL);
+}
+
+void test_merge() {
+    static allocation_t allocations[ALLOCATIONS];
+    arena_t *dst = create_arena();
+    arena_t *src = create_arena();
+    allocate(dst, allocations, 0, ALLOCATIONS / 4);
+    allocate(src, allocations, ALLOCATIONS / 4, ALLOCATIONS / 2);
+    arena_merge(dst, src);
+    // dst keeps allocating after the merge
+    allocate(dst, allocations, ALLOCATIONS / 2, 3 * ALLOCATIONS / 4);
+
+    // merging into an empty arena, and merging an empty one
+    arena_t *empty = create_arena();
+    src = create_arena();
+    allocate(src, allocations, 3 * ALLOCATIONS / 4, ALLOCATIONS - 1);
+    arena_merge(empty, src);
+    allocate(empty, allocations, ALLOCATIONS - 1, ALLOCATIONS);
+    arena_merge(dst, empty);
+    arena_merge(dst, create_arena());
+
+    check_allocations(allocations, ALLOCATIONS);
+    free_arena(dst);
+}
+
+void test_vec() {
+    arena_t *arena = create_arena();
+    u32 elements[] = {1, 2, 3};
+    vec_funcidx_t *vec = vec_funcidx_create_from(arena, elements, 3);
+    vec_funcidx_t *empty = vec_funcidx_create_in(arena, 0);
+    CHECK(vec_funcidx_length(vec) == 3 && vec_funcidx_get(vec, 2) == 3, "vec created from elements differs");
+    CHECK(vec_funcidx_length(empty) == 0, "empty vec is not empty");
+    free_arena(arena);
+}
+
+/* Parsing on several threads merges their arenas into the one of the module, the module is the same. */
+void test_parse(const char *path) {
+    FILE *input = fopen(path, "r");
+    CHECK(input != NULL, "cannot open %s", path);
+    fseek(input, 0, SEEK_END);
+    size_t length = ftell(input);
+    rewind(input);
+    byte *bytes = malloc(length);
+    CHECK(fread(bytes, 1, length, input) == length, "cannot read %s", path);
+    fclose(input);
+
+    module_t *expected;
+    CHECK(parse_bytes(bytes, length, NULL, &expected) == NO_EXCEPTION, "parsing %s failed", path);
+    CHECK(expected->arena != NULL, "the module has no arena");
+    for (u32 threads = 2; threads <= 8; threads *= 2) {
+        module_t *module;
+        CHECK(parse_bytes(bytes, length, &(parse_options_t) {.threads = threads}, &module) == NO_EXCEPTION,
+              "parsing %s on %u threads failed", path, threads);
+        check_modules_equal(module, expected);
+        free_module(module);
+    }
+    free_module(expected);
+
+    // the arena of a module which fails to parse is freed as well
+    module_t *module;
+    CHECK(parse_bytes(bytes, length - 1, NULL, &module) != NO_EXCEPTION, "truncated %s was accepted", path);
+    free(bytes);
+}
+
+int main() {
+    test_alloc();
+    test_merge();
+    test_vec();
+    test_parse(WASM_EXAMPLES_DIR "/state.wasm");
+    test_parse(WASM_BENCH_DIR "/call_indirect.wasm");
+    test_parse(WASM_BENCH_DIR "/matmul.wasm");
+    free_module(NULL);
+    return 0;
+}
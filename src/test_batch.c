@@ -0,0 +1,177 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "batch.h"
+
+#ifndef WASM_EXAMPLES_DIR
+#define WASM_EXAMPLES_DIR "examples"
+#endif
+
+/* Runs the script and compares everything it printed, returns the number of failed commands. */
+int check_batch(const char *script, const char *expected) {
+    FILE *input = fmemopen((void *) script, strlen(script), "r");
+    char *output = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&output, &length);
+    assert(input != NULL && out != NULL);
+
+    int failed = run_batch(input, out, NULL);
+    fclose(input);
+    fclose(out);
+    if (strcmp(output, expected) != 0) {
+        fprintf(stderr, "Script:\n%s\nExpected:\n%s\nGot:\n%s\n", script, expected, output);
+        exit(1);
+    }
+    free(output);
+    return failed;
+}
+
+void test_parse_value() {
+    parameter_value_t value;
+    assert(parse_value("i32:42", &value) && value.type == VALTYPE_I32 && value.val.i32 == 42);
+    assert(parse_value("i32:4294967295", &value) && value.val.i32 == UINT32_MAX);
+    assert(parse_value("i64:18446744073709551615", &value) && value.type == VALTYPE_I64 && value.val.i64 == UINT64_MAX);
+    assert(parse_value("f32:1065353216", &value) && value.type == VALTYPE_F32 && value.val.f32 == 1.0f);
+    assert(parse_value("f64:4607182418800017408", &value) && value.type == VALTYPE_F64 && value.val.f64 == 1.0);
+    assert(!parse_value("i32", &value));
+    assert(!parse_value("i16:1", &value));
+    assert(!parse_value("i322:1", &value));
+}
+
+void test_line_parser() {
+    // comments, empty lines, surrounding whitespace and %XX escapes in tokens
+    int failed = check_batch("# comment\n"
+                             "\n"
+                             "   \t\n"
+                             "  module \t trap.wasm  \n"
+                             "invoke %63ount\n"
+                             "assert_return count = i32:2\n"
+                             "assert_return\tcount\t=\ti32:3",
+                             "4: ok\n"
+                             "5: i32:1\n"
+                             "6: ok\n"
+                             "7: ok\n"
+                             "passed 4 failed 0\n");
+    assert(failed == 0);
+}
+
+void test_malformed_lines() {
+    char too_many[2048] = "invoke count";
+    for (int i = 0; i < 256; i++) {
+        strcat(too_many, " x");
+    }
+    strcat(too_many, "\n");
+    char script[4096];
+    snprintf(script, sizeof(script), "invoke count\n"
+                                     "module trap.wasm\n"
+                                     "module\n"
+                                     "invoke\n"
+                                     "assert_return count i32:1\n"
+                                     "assert_return count =\n"
+                                     "invoke count i33:1\n"
+                                     "frobnicate count\n"
+                                     "assert_invalid\n"
+                                     "%s"
+                                     "invoke count\n", too_many);
+    int failed = check_batch(script,
+                             "1: error no module\n"
+                             "2: ok\n"
+                             "3: error usage: module <path>\n"
+                             "4: error usage: invoke <name> [type:value]...\n"
+                             "5: error usage: assert_return <name> [type:value]... = <result>\n"
+                             "6: error usage: assert_return <name> [type:value]... = <result>\n"
+                             "7: error unknown parameter type i33:1\n"
+                             "8: error unknown command frobnicate\n"
+                             "9: error usage: assert_invalid <path>\n"
+                             "10: error more than 256 tokens\n"
+                             "11: i32:1\n"
+                             "passed 2 failed 9\n");
+    assert(failed == 9);
+}
+
+void test_modules() {
+    // a module which fails to load unloads the previous one, invalid modules are only parsed
+    int failed = check_batch("module trap.wasm\n"
+                             "assert_invalid trap.wat\n"
+                             "assert_malformed func1.wasm\n"
+                             "assert_invalid missing.wasm\n"
+                             "invoke count\n"
+                             "module missing.wasm\n"
+                             "invoke count\n"
+                             "module func1.wasm\n"
+                             "assert_return func = i32:35\n"
+                             "invoke count\n",
+                             "1: ok\n"
+                             "2: ok\n"
+                             "3: fail loaded\n"
+                             "4: error No such file or directory\n"
+                             "5: i32:1\n"
+                             "6: error No such file or directory\n"
+                             "7: error no module\n"
+                             "8: ok\n"
+                             "9: ok\n"
+                             "10: error interpreter not found\n"
+                             "passed 5 failed 5\n");
+    assert(failed == 5);
+}
+
+void test_calls() {
+    // traps and failed calls do not end the batch, the instance keeps its state
+    int failed = check_batch("module trap.wasm\n"
+                             "invoke count\n"
+                             "invoke nested i32:7\n"
+                             "invoke load\n"
+                             "invoke nested\n"
+                             "invoke nested i64:7\n"
+                             "invoke missing\n"
+                             "assert_return count = i32:3\n"
+                             "assert_return count = i32:3\n"
+                             "assert_return count = void\n",
+                             "1: ok\n"
+                             "2: i32:1\n"
+                             "3: error interpreter reached op unreachable in function 0 at pc 1\n"
+                             "4: error interpreter memory access out of bounds in function 2 at pc 1\n"
+                             "5: error interpreter invalid arguments\n"
+                             "6: error interpreter invalid arguments\n"
+                             "7: error interpreter not found\n"
+                             "8: fail i32:2\n"
+                             "9: ok\n"
+                             "10: fail i32:4\n"
+                             "passed 3 failed 7\n");
+    assert(failed == 7);
+}
+
+void test_call_indirect() {
+    // the table has two elements, only the first one is initialized
+    int failed = check_batch("module trap.wasm\n"
+                             "invoke indirect i32:0\n"
+                             "invoke indirect i32:1\n"
+                             "invoke indirect i32:2\n"
+                             "invoke indirect i32:4294967295\n"
+                             "assert_return count = i32:1\n",
+                             "1: ok\n"
+                             "2: error interpreter reached op unreachable in function 0 at pc 1\n"
+                             "3: error interpreter uninitialized table element in function 4 at pc 1\n"
+                             "4: error interpreter undefined table element in function 4 at pc 1\n"
+                             "5: error interpreter undefined table element in function 4 at pc 1\n"
+                             "6: ok\n"
+                             "passed 2 failed 4\n");
+    assert(failed == 4);
+}
+
+int main() {
+    if (chdir(WASM_EXAMPLES_DIR) != 0) {
+        perror(WASM_EXAMPLES_DIR);
+        return 1;
+    }
+    test_parse_value();
+    test_line_parser();
+    test_malformed_lines();
+    test_modules();
+    test_calls();
+    test_call_indirect();
+    return 0;
+}
@@ -0,0 +1,246 @@
+#ifndef WASM_INTERPRETER_TEST_COMPARE_H
+#define WASM_INTERPRETER_TEST_COMPARE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eval_types.h"
+#include "interpreter.h"
+#include "memory.h"
+#include "parser.h"
+
+/* Helpers of the tests which compare instances and modules, every mismatch is printed and ends the test. */
+
+#ifndef WASM_EXAMPLES_DIR
+#define WASM_EXAMPLES_DIR "examples"
+#endif
+
+#define CHECK(condition, ...) \
+do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        exit(1); \
+    } \
+} while (0)
+
+static SILENCE_UNUSED module_t *load_module(const char *path) {
+    FILE *input = fopen(path, "r");
+    CHECK(input != NULL, "cannot open %s", path);
+    module_t *module;
+    exception_t ex = parse(input, NULL, &module);
+    fclose(input);
+    CHECK(ex == NO_EXCEPTION, "parsing %s: %s", path, exception_code_to_string(ex));
+    return module;
+}
+
+static SILENCE_UNUSED module_t *load_example(const char *name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", WASM_EXAMPLES_DIR, name);
+    return load_module(path);
+}
+
+/* Compares globals, table and memory, the state a call can observe. */
+static SILENCE_UNUSED void check_instances_equal(const eval_state_t *a, const eval_state_t *b) {
+    CHECK(vec_global_entry_length(a->globals) == vec_global_entry_length(b->globals), "number of globals differs");
+    for (u32 i = 0; i < vec_global_entry_length(a->globals); i++) {
+        global_entry_t ga = vec_global_entry_get(a->globals, i);
+        global_entry_t gb = vec_global_entry_get(b->globals, i);
+        bool is_32 = ga.valtype == VALTYPE_I32 || ga.valtype == VALTYPE_F32;
+        CHECK(ga.valtype == gb.valtype && (is_32 ? ga.val.i32 == gb.val.i32 : ga.val.i64 == gb.val.i64),
+              "global %u differs", i);
+    }
+    CHECK(vec_table_entry_length(a->table) == vec_table_entry_length(b->table), "table size differs");
+    for (u32 i = 0; i < vec_table_entry_length(a->table); i++) {
+        table_entry_t ta = vec_table_entry_get(a->table, i);
+        table_entry_t tb = vec_table_entry_get(b->table, i);
+        CHECK(ta.initialized == tb.initialized && (!ta.initialized || ta.funcidx == tb.funcidx),
+              "table entry %u differs", i);
+    }
+    CHECK((a->memory == NULL) == (b->memory == NULL), "only one instance has a memory");
+    if (a->memory != NULL) {
+        CHECK(a->memory->size == b->memory->size, "memory size %u != %u", a->memory->size, b->memory->size);
+        CHECK(a->memory->max_size == b->memory->max_size, "maximum memory size differs");
+        CHECK(a->memory_bytes == b->memory_bytes && a->memory_bytes == (u64) a->memory->size * PAGE_SIZE,
+              "cached memory size differs");
+        CHECK(memcmp(a->memory->data, b->memory->data, (size_t) a->memory->size * PAGE_SIZE) == 0,
+              "memory contents differ");
+    }
+}
+
+#define VEC_LENGTH(type, vec) ((vec) != NULL ? vec_##type##_length(vec) : 0)
+
+static SILENCE_UNUSED bool spans_equal(span_t a, span_t b) {
+    return a.length == b.length && (a.length == 0 || memcmp(a.bytes, b.bytes, a.length) == 0);
+}
+
+/* Compares the immediates the opcode uses, the rest of the union is undefined. */
+static SILENCE_UNUSED bool instructions_equal(const instruction_t *a, const instruction_t *b) {
+    if (a->opcode != b->opcode) {
+        return false;
+    }
+    switch (a->opcode) {
+        case OP_BR:
+        case OP_BR_IF:
+        case OP_RETURN:
+            return a->branch.target == b->branch.target && a->branch.height == b->branch.height
+                   && a->branch.arity == b->branch.arity;
+        case OP_BR_TABLE:
+            return a->br_table_length == b->br_table_length;
+        case OP_IF:
+        case OP_ELSE:
+            return a->target == b->target;
+        case OP_CALL:
+            return a->funcidx == b->funcidx;
+        case OP_CALL_INDIRECT:
+            return a->typeidx == b->typeidx;
+        case OP_LOCAL_GET:
+        case OP_LOCAL_SET:
+        case OP_LOCAL_TEE:
+            return a->localidx == b->localidx;
+        case OP_GLOBAL_GET:
+        case OP_GLOBAL_SET:
+            return a->globalidx == b->globalidx;
+        case OP_I32_CONST:
+        case OP_F32_CONST:
+            return a->const_i32 == b->const_i32;
+        case OP_I64_CONST:
+        case OP_F64_CONST:
+            return a->const_i64 == b->const_i64;
+        default:
+            if (a->opcode >= OP_I32_LOAD && a->opcode <= OP_I64_STORE32) {
+                return a->memarg.align == b->memarg.align && a->memarg.offset == b->memarg.offset;
+            }
+            return true;
+    }
+}
+
+/* Compares flat instruction sequences: lowered code and constant expressions. */
+static SILENCE_UNUSED void check_code_equal(const vec_instruction_t *a, const vec_instruction_t *b, const char *what,
+                                            u32 idx) {
+    CHECK(VEC_LENGTH(instruction, a) == VEC_LENGTH(instruction, b), "length of %s %u differs", what, idx);
+    for (u32 i = 0; i < VEC_LENGTH(instruction, a); i++) {
+        CHECK(instructions_equal(vec_instruction_getp((vec_instruction_t *) a, i),
+                                 vec_instruction_getp((vec_instruction_t *) b, i)),
+              "instruction %u of %s %u differs", i, what, idx);
+    }
+}
+
+static SILENCE_UNUSED void check_valtypes_equal(const vec_valtype_t *a, const vec_valtype_t *b, u32 type) {
+    CHECK(VEC_LENGTH(valtype, a) == VEC_LENGTH(valtype, b), "type %u differs", type);
+    for (u32 i = 0; i < VEC_LENGTH(valtype, a); i++) {
+        CHECK(vec_valtype_get((vec_valtype_t *) a, i) == vec_valtype_get((vec_valtype_t *) b, i),
+              "type %u differs", type);
+    }
+}
+
+/*
+ * Compares everything an instance uses: types, imports, lowered function bodies, tables, memories, globals, element
+ * and data segments, exports and the start function. Lazily parsed bodies are decoded first, the nested instruction
+ * trees and the binary are not compared (modules loaded from a module cache have neither).
+ */
+static SILENCE_UNUSED void check_modules_equal(const module_t *a, const module_t *b) {
+    decode_lazy_funcs(a);
+    decode_lazy_funcs(b);
+
+    CHECK(VEC_LENGTH(functype, a->types) == VEC_LENGTH(functype, b->types), "number of types differs");
+    for (u32 i = 0; i < VEC_LENGTH(functype, a->types); i++) {
+        check_valtypes_equal(vec_functype_getp(a->types, i)->t1, vec_functype_getp(b->types, i)->t1, i);
+        check_valtypes_equal(vec_functype_getp(a->types, i)->t2, vec_functype_getp(b->types, i)->t2, i);
+    }
+
+    CHECK(a->imported_funcs == b->imported_funcs, "number of imported functions differs");
+    CHECK(VEC_LENGTH(import, a->imports) == VEC_LENGTH(import, b->imports), "number of imports differs");
+    for (u32 i = 0; i < VEC_LENGTH(import, a->imports); i++) {
+        import_t *ia = vec_import_getp(a->imports, i);
+        import_t *ib = vec_import_getp(b->imports, i);
+        CHECK(spans_equal(ia->module, ib->module) && spans_equal(ia->name, ib->name) && ia->desc == ib->desc,
+              "import %u differs", i);
+        CHECK(ia->desc != IMPORTDESC_FUNC || ia->func == ib->func, "type of import %u differs", i);
+    }
+
+    CHECK(VEC_LENGTH(func, a->funcs) == VEC_LENGTH(func, b->funcs), "number of functions differs");
+    for (u32 i = 0; i < VEC_LENGTH(func, a->funcs); i++) {
+        func_t *fa = vec_func_getp(a->funcs, i);
+        func_t *fb = vec_func_getp(b->funcs, i);
+        CHECK(fa->type == fb->type, "type of function %u differs", i);
+        CHECK(fa->num_locals == fb->num_locals && fa->max_stack_height == fb->max_stack_height,
+              "locals or stack height of function %u differ", i);
+        CHECK(VEC_LENGTH(locals, fa->locals) == VEC_LENGTH(locals, fb->locals), "locals of function %u differ", i);
+        for (u32 j = 0; j < VEC_LENGTH(locals, fa->locals); j++) {
+            locals_t la = vec_locals_get(fa->locals, j);
+            locals_t lb = vec_locals_get(fb->locals, j);
+            CHECK(la.n == lb.n && la.t == lb.t, "locals of function %u differ", i);
+        }
+        check_code_equal(fa->code, fb->code, "function", i);
+    }
+
+    CHECK(VEC_LENGTH(tabletype, a->tables) == VEC_LENGTH(tabletype, b->tables), "number of tables differs");
+    for (u32 i = 0; i < VEC_LENGTH(tabletype, a->tables); i++) {
+        limits_t la = vec_tabletype_get(a->tables, i).lim;
+        limits_t lb = vec_tabletype_get(b->tables, i).lim;
+        CHECK(la.min == lb.min && la.has_max == lb.has_max && (!la.has_max || la.max == lb.max),
+              "table %u differs", i);
+    }
+    CHECK(VEC_LENGTH(memtype, a->mems) == VEC_LENGTH(memtype, b->mems), "number of memories differs");
+    for (u32 i = 0; i < VEC_LENGTH(memtype, a->mems); i++) {
+        limits_t la = vec_memtype_get(a->mems, i).lim;
+        limits_t lb = vec_memtype_get(b->mems, i).lim;
+        CHECK(la.min == lb.min && la.has_max == lb.has_max && (!la.has_max || la.max == lb.max),
+              "memory %u differs", i);
+    }
+
+    CHECK(VEC_LENGTH(global, a->globals) == VEC_LENGTH(global, b->globals), "number of globals differs");
+    for (u32 i = 0; i < VEC_LENGTH(global, a->globals); i++) {
+        global_t *ga = vec_global_getp(a->globals, i);
+        global_t *gb = vec_global_getp(b->globals, i);
+        CHECK(ga->gt.t == gb->gt.t && ga->gt.m == gb->gt.m, "type of global %u differs", i);
+        check_code_equal(ga->e.instructions, gb->e.instructions, "global", i);
+    }
+
+    CHECK(VEC_LENGTH(element, a->elem) == VEC_LENGTH(element, b->elem), "number of element segments differs");
+    for (u32 i = 0; i < VEC_LENGTH(element, a->elem); i++) {
+        element_t *ea = vec_element_getp(a->elem, i);
+        element_t *eb = vec_element_getp(b->elem, i);
+        CHECK(ea->table == eb->table, "table of element segment %u differs", i);
+        check_code_equal(ea->offset.instructions, eb->offset.instructions, "element segment", i);
+        CHECK(VEC_LENGTH(funcidx, ea->init) == VEC_LENGTH(funcidx, eb->init), "element segment %u differs", i);
+        for (u32 j = 0; j < VEC_LENGTH(funcidx, ea->init); j++) {
+            CHECK(vec_funcidx_get(ea->init, j) == vec_funcidx_get(eb->init, j), "element segment %u differs", i);
+        }
+    }
+
+    CHECK(VEC_LENGTH(data, a->data) == VEC_LENGTH(data, b->data), "number of data segments differs");
+    for (u32 i = 0; i < VEC_LENGTH(data, a->data); i++) {
+        data_t *da = vec_data_getp(a->data, i);
+        data_t *db = vec_data_getp(b->data, i);
+        CHECK(da->memidx == db->memidx && spans_equal(da->init, db->init), "data segment %u differs", i);
+        check_code_equal(da->expression.instructions, db->expression.instructions, "data segment", i);
+    }
+
+    CHECK(VEC_LENGTH(export, a->exports) == VEC_LENGTH(export, b->exports), "number of exports differs");
+    for (u32 i = 0; i < VEC_LENGTH(export, a->exports); i++) {
+        export_t *ea = vec_export_getp(a->exports, i);
+        export_t *eb = vec_export_getp(b->exports, i);
+        CHECK(spans_equal(ea->name, eb->name) && ea->desc == eb->desc && ea->func == eb->func, "export %u differs", i);
+    }
+
+    CHECK(a->has_start == b->has_start && (!a->has_start || a->start == b->start), "start function differs");
+}
+
+/* Calls an export with i32 arguments and returns its i32 result (0 for void). */
+static SILENCE_UNUSED u32 call_i32(eval_state_t *instance, char *name, int arg_count, u32 arg) {
+    vec_parameter_value_t *parameters = vec_parameter_value_create();
+    for (int i = 0; i < arg_count; i++) {
+        vec_parameter_value_add(parameters, (parameter_value_t) {.type = VALTYPE_I32, .val.i32 = arg});
+    }
+    return_value_t ret;
+    exception_t ex = interpret_function(instance, name, parameters, &ret);
+    vec_parameter_value_free(parameters);
+    CHECK(ex == NO_EXCEPTION, "calling %s: %s", name, exception_code_to_string(ex));
+    return ret.is_void ? 0 : ret.val.i32;
+}
+
+#endif // WASM_INTERPRETER_TEST_COMPARE_H
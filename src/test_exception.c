@@ -26,5 +26,17 @@ int main() {
      }, {
          printf("%s exception at %s:%d in %s\n", exception_code_to_string(exception), file, line, function);
      })
+    TRY_CATCH
+    ({
+         TRY_CATCH
+         ({
+              smaller_or_equal_to_ten(15);
+          }, {
+              printf("inner: %s\n", message);
+          })
+         THROW_EXCEPTION(EXCEPTION_PARSER_LEB_OVERFLOW);
+     }, {
+         printf("outer: %s\n", message);
+     })
     return 0;
 }
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test_compare.h"
+#include "module_cache.h"
+
+#ifndef WASM_BENCH_DIR
+#define WASM_BENCH_DIR "bench"
+#endif
+
+#define MODULE_KEY 0xcace
+
+static char dir[] = "/tmp/wasm_module_cache_XXXXXX";
+static char cache_path[4096];
+
+/* Calls an export with one i32 argument on instances of both modules, both must return the same value or trap. */
+void check_same_result(const module_t *a, const module_t *b, char *name, u32 arg) {
+    eval_state_t *instance_a, *instance_b;
+    CHECK(instantiate(a, &instance_a) == NO_EXCEPTION, "instantiate failed");
+    CHECK(instantiate(b, &instance_b) == NO_EXCEPTION, "instantiate failed");
+    return_value_t ret_a, ret_b;
+    vec_parameter_value_t *parameters = vec_parameter_value_create();
+    vec_parameter_value_add(parameters, (parameter_value_t) {.type = VALTYPE_I32, .val.i32 = arg});
+    exception_t ex_a = interpret_function(instance_a, name, parameters, &ret_a);
+    exception_t ex_b = interpret_function(instance_b, name, parameters, &ret_b);
+    vec_parameter_value_free(parameters);
+    CHECK(ex_a == ex_b, "calling %s: %s != %s", name, exception_code_to_string(ex_a), exception_code_to_string(ex_b));
+    if (ex_a == NO_EXCEPTION) {
+        CHECK(ret_a.is_void == ret_b.is_void && (ret_a.is_void || ret_a.type == ret_b.type),
+              "%s returns another type", name);
+        bool is_32 = ret_a.type == VALTYPE_I32 || ret_a.type == VALTYPE_F32;
+        CHECK(ret_a.is_void || (is_32 ? ret_a.val.i32 == ret_b.val.i32 : ret_a.val.i64 == ret_b.val.i64),
+              "%s returns another value", name);
+    }
+    check_instances_equal(instance_a, instance_b);
+    free_interpreter(instance_a);
+    free_interpreter(instance_b);
+}
+
+/* Writes and loads the cache of a module, the loaded module must equal the parsed one. */
+module_t *round_trip(const module_t *module) {
+    CHECK(write_module_cache(module, MODULE_KEY, cache_path) == NO_EXCEPTION, "write_module_cache failed");
+    module_t *cached;
+    CHECK(load_module_cache(MODULE_KEY, cache_path, &cached) == NO_EXCEPTION, "load_module_cache failed");
+    check_modules_equal(cached, module);
+    return cached;
+}
+
+void test_example(const char *name) {
+    module_t *module = load_example(name);
+    module_t *cached = round_trip(module);
+    if (strcmp(name, "state.wasm") == 0) {
+        check_same_result(module, cached, "get", 0);
+        check_same_result(module, cached, "write", 3);
+    } else if (strcmp(name, "trap.wasm") == 0) {
+        check_same_result(module, cached, "nested", 1);
+        check_same_result(module, cached, "count", 0);
+    }
+    free_module(cached);
+    free_module(module);
+}
+
+void test_bench(const char *name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", WASM_BENCH_DIR, name);
+    module_t *module = load_module(path);
+    module_t *cached = round_trip(module);
+    check_same_result(module, cached, "run", 10);
+    free_module(cached);
+    free_module(module);
+}
+
+/* A lazily parsed module is cached with all bodies decoded. */
+void test_lazy() {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", WASM_BENCH_DIR, "call_indirect.wasm");
+    FILE *input = fopen(path, "r");
+    CHECK(input != NULL, "cannot open %s", path);
+    module_t *module;
+    CHECK(parse(input, &(parse_options_t) {.lazy = true}, &module) == NO_EXCEPTION, "parsing %s failed", path);
+    fclose(input);
+    CHECK(write_module_cache(module, MODULE_KEY, cache_path) == NO_EXCEPTION, "write_module_cache failed");
+    module_t *cached;
+    CHECK(load_module_cache(MODULE_KEY, cache_path, &cached) == NO_EXCEPTION, "load_module_cache failed");
+    for (u32 i = 0; i < vec_func_length(cached->funcs); i++) {
+        CHECK(vec_func_getp(cached->funcs, i)->code != NULL, "function %u was cached without code", i);
+    }
+    check_modules_equal(cached, module);
+    check_same_result(module, cached, "run", 10);
+    free_module(cached);
+    free_module(module);
+}
+
+void check_rejected(u64 key, const char *path) {
+    module_t *module = (module_t *) 1;
+    CHECK(load_module_cache(key, path, &module) == EXCEPTION_PARSER_INVALID_MODULE_CACHE, "%s was not rejected", path);
+    CHECK(module == NULL, "no module expected for %s", path);
+}
+
+void test_invalid() {
+    module_t *module = load_example("state.wasm");
+    CHECK(write_module_cache(module, MODULE_KEY, cache_path) == NO_EXCEPTION, "write_module_cache failed");
+    free_module(module);
+    check_rejected(MODULE_KEY + 1, cache_path);
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/missing", dir);
+    check_rejected(MODULE_KEY, path);
+
+    // cut off in the header, the fix-up region and the data region
+    FILE *input = fopen(cache_path, "r");
+    CHECK(input != NULL, "cannot open %s", cache_path);
+    fseek(input, 0, SEEK_END);
+    long size = ftell(input);
+    rewind(input);
+    char *data = malloc(size);
+    CHECK(fread(data, 1, size, input) == (size_t) size, "cannot read %s", cache_path);
+    fclose(input);
+    snprintf(path, sizeof(path), "%s/truncated", dir);
+    long lengths[] = {0, 8, 100, size / 2, size - 1};
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        FILE *output = fopen(path, "w");
+        CHECK(output != NULL && fwrite(data, 1, lengths[i], output) == (size_t) lengths[i], "cannot write %s", path);
+        fclose(output);
+        check_rejected(MODULE_KEY, path);
+    }
+    free(data);
+    unlink(path);
+}
+
+int main() {
+    CHECK(mkdtemp(dir) != NULL, "cannot create a temporary directory");
+    snprintf(cache_path, sizeof(cache_path), "%s/module", dir);
+
+    const char *examples[] = {"control.wasm", "func1.wasm", "image.wasm", "imports.wasm", "increment_f32.wasm",
+                              "memory.wasm", "parametric.wasm", "state.wasm", "test.wasm", "trap.wasm"};
+    for (size_t i = 0; i < sizeof(examples) / sizeof(examples[0]); i++) {
+        test_example(examples[i]);
+    }
+    const char *benchmarks[] = {"br_table.wasm", "call_indirect.wasm", "crc32.wasm", "fib.wasm", "matmul.wasm",
+                                "memcpy.wasm", "sieve.wasm"};
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        test_bench(benchmarks[i]);
+    }
+    test_lazy();
+    test_invalid();
+
+    unlink(cache_path);
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "test_compare.h"
+#include "pool.h"
+
+void test_reset(const module_t *module) {
+    eval_state_t *fresh;
+    CHECK(instantiate(module, &fresh) == NO_EXCEPTION, "instantiate failed");
+    instance_pool_t *pool;
+    CHECK(create_instance_pool(module, &pool) == NO_EXCEPTION, "create_instance_pool failed");
+    CHECK(pool->writes_globals && pool->writes_memory, "writes of state.wasm not found");
+
+    // the first instance is the one the pool initialized, the second one is created from the snapshot
+    eval_state_t *first, *second;
+    CHECK(acquire_instance(pool, &first) == NO_EXCEPTION, "acquire failed");
+    CHECK(acquire_instance(pool, &second) == NO_EXCEPTION, "acquire failed");
+    CHECK(first != second, "an instance was handed out twice");
+    check_instances_equal(first, fresh);
+    check_instances_equal(second, fresh);
+    CHECK(call_i32(second, "get", 0, 0) == 142, "start function did not run before the snapshot");
+
+    // globals, memory contents and memory size are reset
+    call_i32(first, "write", 1, 7);
+    CHECK(call_i32(first, "grow", 0, 0) == 1, "grow failed");
+    CHECK(call_i32(first, "get", 0, 0) == 49, "write failed");
+    CHECK(first->memory->size == 2, "memory did not grow");
+    CHECK(reset_pooled_instance(pool, first) == NO_EXCEPTION, "reset failed");
+    check_instances_equal(first, fresh);
+    CHECK(call_i32(first, "get", 0, 0) == 142, "reset instance computes another result");
+    check_instances_equal(second, fresh);
+
+    // a released instance comes back reset, however it was left
+    call_i32(second, "write", 1, 9);
+    call_i32(second, "grow", 0, 0);
+    call_i32(second, "grow", 0, 0);
+    release_instance(pool, second);
+    eval_state_t *reused;
+    CHECK(acquire_instance(pool, &reused) == NO_EXCEPTION, "acquire failed");
+    CHECK(reused == second, "the released instance was not reused");
+    check_instances_equal(reused, fresh);
+
+    release_instance(pool, first);
+    release_instance(pool, reused);
+    free_instance_pool(pool);
+    free_interpreter(fresh);
+}
+
+/* Instances of modules which cannot write their state are never remapped, they still match a fresh instance. */
+void test_read_only(const char *name, bool writes_globals, bool writes_memory) {
+    module_t *module = load_example(name);
+    instance_pool_t *pool;
+    CHECK(create_instance_pool(module, &pool) == NO_EXCEPTION, "create_instance_pool failed");
+    CHECK(pool->writes_globals == writes_globals && pool->writes_memory == writes_memory, "wrong writes for %s", name);
+    CHECK(pool_writes_state(pool) == (writes_globals || writes_memory), "wrong pool_writes_state for %s", name);
+
+    eval_state_t *fresh, *instance;
+    CHECK(instantiate(module, &fresh) == NO_EXCEPTION, "instantiate failed");
+    CHECK(acquire_instance(pool, &instance) == NO_EXCEPTION, "acquire failed");
+    CHECK(reset_pooled_instance(pool, instance) == NO_EXCEPTION, "reset failed");
+    check_instances_equal(instance, fresh);
+
+    release_instance(pool, instance);
+    free_interpreter(fresh);
+    free_instance_pool(pool);
+    free_module(module);
+}
+
+int main() {
+    module_t *module = load_example("state.wasm");
+    test_reset(module);
+    free_module(module);
+
+    test_read_only("func1.wasm", false, false);
+    test_read_only("trap.wasm", true, false);
+    return 0;
+}
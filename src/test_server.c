@@ -0,0 +1,196 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "parser.h"
+
+#ifndef WASM_EXAMPLES_DIR
+#define WASM_EXAMPLES_DIR "examples"
+#endif
+
+#define CONCURRENT_CONNECTIONS 8
+#define CALLS_PER_CONNECTION 100
+
+static char socket_path[256];
+
+typedef struct server_args {
+    const module_t *module;
+    const char *path;
+} server_args_t;
+
+static void *serve(void *arg) {
+    server_args_t *args = arg;
+    exception_t ex = run_server(args->module, args->path);
+    fprintf(stderr, "run_server returned %s\n", exception_code_to_string(ex));
+    exit(1);
+}
+
+/* Connects to the server, which may still be starting up. */
+int connect_test_server() {
+    int fd;
+    for (int i = 0; i < 1000; i++) {
+        if (connect_server(socket_path, &fd) == NO_EXCEPTION) {
+            return fd;
+        }
+        usleep(10000);
+    }
+    fprintf(stderr, "could not connect to %s\n", socket_path);
+    exit(1);
+}
+
+/* Calls an export without arguments. */
+exception_t call(int fd, const char *name, return_value_t *ret) {
+    vec_parameter_value_t *parameters = vec_parameter_value_create();
+    exception_t ex = server_call(fd, name, parameters, ret);
+    vec_parameter_value_free(parameters);
+    return ex;
+}
+
+void check_count(int fd, u32 expected) {
+    return_value_t ret;
+    exception_t ex = call(fd, "count", &ret);
+    if (ex != NO_EXCEPTION || ret.is_void || ret.type != VALTYPE_I32 || ret.val.i32 != expected) {
+        fprintf(stderr, "count: expected i32:%u, got %s i32:%u\n", expected, exception_code_to_string(ex),
+                ret.val.i32);
+        exit(1);
+    }
+}
+
+/* The server closes the connection without answering. */
+void check_closed(int fd) {
+    server_response_t response;
+    assert(read(fd, &response, sizeof(response)) == 0);
+    close(fd);
+}
+
+void test_round_trip() {
+    int fd = connect_test_server();
+    check_count(fd, 1);
+    check_count(fd, 2);
+
+    // traps and failed calls are answered with their exception, the instance of the connection keeps its state
+    return_value_t ret;
+    vec_parameter_value_t *parameters = vec_parameter_value_create();
+    vec_parameter_value_add(parameters, (parameter_value_t) {.type = VALTYPE_I32, .val.i32 = 7});
+    assert(server_call(fd, "nested", parameters, &ret) == EXCEPTION_INTERPRETER_REACHED_OP_UNREACHABLE);
+    vec_parameter_value_set(parameters, 0, (parameter_value_t) {.type = VALTYPE_I64, .val.i64 = 7});
+    assert(server_call(fd, "nested", parameters, &ret) == EXCEPTION_INTERPRETER_INVALID_ARGUMENTS);
+    vec_parameter_value_free(parameters);
+    assert(call(fd, "load", &ret) == EXCEPTION_INTERPRETER_MEMORY_ACCESS_OUT_OF_BOUNDS);
+    assert(call(fd, "missing", &ret) == EXCEPTION_INTERPRETER_NOT_FOUND);
+    assert(call(fd, "", &ret) == EXCEPTION_INTERPRETER_NOT_FOUND);
+    check_count(fd, 3);
+    close(fd);
+
+    // a new connection starts from the initialized state
+    fd = connect_test_server();
+    check_count(fd, 1);
+    close(fd);
+}
+
+void test_framing_errors() {
+    int fd = connect_test_server();
+    server_request_t request = {.name_length = SERVER_MAX_NAME_LENGTH + 1, .arg_count = 0};
+    assert(write(fd, &request, sizeof(request)) == sizeof(request));
+    check_closed(fd);
+
+    fd = connect_test_server();
+    request = (server_request_t) {.name_length = 5, .arg_count = SERVER_MAX_ARGS + 1};
+    assert(write(fd, &request, sizeof(request)) == sizeof(request));
+    check_closed(fd);
+
+    // the request ends in the middle of the name or the arguments
+    fd = connect_test_server();
+    request = (server_request_t) {.name_length = 5, .arg_count = 0};
+    assert(write(fd, &request, sizeof(request)) == sizeof(request));
+    assert(write(fd, "cou", 3) == 3);
+    shutdown(fd, SHUT_WR);
+    check_closed(fd);
+
+    fd = connect_test_server();
+    request = (server_request_t) {.name_length = 6, .arg_count = 1};
+    assert(write(fd, &request, sizeof(request)) == sizeof(request));
+    assert(write(fd, "nested", 6) == 6);
+    shutdown(fd, SHUT_WR);
+    check_closed(fd);
+
+    // a complete request before the malformed one is still answered
+    fd = connect_test_server();
+    check_count(fd, 1);
+    request = (server_request_t) {.name_length = UINT32_MAX, .arg_count = 0};
+    assert(write(fd, &request, sizeof(request)) == sizeof(request));
+    check_closed(fd);
+}
+
+void test_disconnects() {
+    // the client goes away in the middle of a request
+    int fd = connect_test_server();
+    server_request_t request = {.name_length = 5, .arg_count = 0};
+    assert(write(fd, &request, sizeof(request)) == sizeof(request));
+    assert(write(fd, "co", 2) == 2);
+    close(fd);
+
+    // and before reading the response, writing it must not kill the server with SIGPIPE
+    for (int i = 0; i < 10; i++) {
+        fd = connect_test_server();
+        assert(write(fd, &request, sizeof(request)) == sizeof(request));
+        assert(write(fd, "count", 5) == 5);
+        close(fd);
+    }
+
+    fd = connect_test_server();
+    check_count(fd, 1);
+    close(fd);
+}
+
+static void *run_connection(void *arg) {
+    (void) arg;
+    int fd = connect_test_server();
+    for (u32 i = 1; i <= CALLS_PER_CONNECTION; i++) {
+        check_count(fd, i);
+    }
+    close(fd);
+    return NULL;
+}
+
+void test_concurrent_connections() {
+    // every connection has its own instance, so each one counts from 1
+    pthread_t threads[CONCURRENT_CONNECTIONS];
+    for (int i = 0; i < CONCURRENT_CONNECTIONS; i++) {
+        assert(pthread_create(&threads[i], NULL, run_connection, NULL) == 0);
+    }
+    for (int i = 0; i < CONCURRENT_CONNECTIONS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+int main() {
+    FILE *input = fopen(WASM_EXAMPLES_DIR "/trap.wasm", "r");
+    assert(input != NULL);
+    module_t *module;
+    assert(parse(input, NULL, &module) == NO_EXCEPTION);
+    fclose(input);
+
+    char dir[] = "/tmp/test_server.XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    snprintf(socket_path, sizeof(socket_path), "%s/wasm.sock", dir);
+
+    // the server never returns, the process ends with it
+    pthread_t server;
+    server_args_t args = {.module = module, .path = socket_path};
+    assert(pthread_create(&server, NULL, serve, &args) == 0);
+    pthread_detach(server);
+
+    test_round_trip();
+    test_framing_errors();
+    test_disconnects();
+    test_concurrent_connections();
+
+    unlink(socket_path);
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test_compare.h"
+#include "snapshot.h"
+
+#define MODULE_KEY 0x5eed
+
+/* Offsets of the u32 fields of snapshot_header_t in snapshot.c. */
+#define HEADER_TABLE_LENGTH 28
+#define HEADER_MEMORY_SIZE 36
+#define HEADER_MEMORY_MAX_SIZE 40
+
+typedef struct patch {
+    size_t offset;
+    u32 value;
+} patch_t;
+
+static char dir[] = "/tmp/wasm_snapshot_XXXXXX";
+
+static void snapshot_path(char *path, size_t size, const char *name) {
+    snprintf(path, size, "%s/%s", dir, name);
+}
+
+/* Writes a snapshot of the instance and checks that an instance created from it has the same state and results. */
+void check_round_trip(const module_t *module, eval_state_t *instance, const char *name) {
+    char path[4096];
+    snapshot_path(path, sizeof(path), name);
+    CHECK(write_snapshot(instance, MODULE_KEY, path) == NO_EXCEPTION, "write_snapshot failed");
+
+    eval_state_t *restored;
+    CHECK(instantiate_snapshot(module, MODULE_KEY, path, &restored) == NO_EXCEPTION, "instantiate_snapshot failed");
+    check_instances_equal(restored, instance);
+    CHECK(call_i32(restored, "get", 0, 0) == call_i32(instance, "get", 0, 0), "restored instance computes another result");
+    free_interpreter(restored);
+}
+
+void test_round_trip(const module_t *module) {
+    eval_state_t *instance;
+    CHECK(instantiate(module, &instance) == NO_EXCEPTION, "instantiate failed");
+    check_round_trip(module, instance, "fresh");
+
+    // modified globals, memory contents and a grown memory survive the round trip
+    call_i32(instance, "write", 1, 9);
+    CHECK(call_i32(instance, "grow", 0, 0) == 1, "grow failed");
+    check_round_trip(module, instance, "modified");
+    free_interpreter(instance);
+}
+
+/* Two instances of one snapshot share the file but not their state. */
+void test_independent(const module_t *module) {
+    char path[4096];
+    snapshot_path(path, sizeof(path), "fresh");
+    eval_state_t *a, *b;
+    CHECK(instantiate_snapshot(module, MODULE_KEY, path, &a) == NO_EXCEPTION, "instantiate_snapshot failed");
+    CHECK(instantiate_snapshot(module, MODULE_KEY, path, &b) == NO_EXCEPTION, "instantiate_snapshot failed");
+    call_i32(a, "write", 1, 7);
+    call_i32(a, "grow", 0, 0);
+    CHECK(call_i32(a, "get", 0, 0) == 49, "write failed");
+    CHECK(call_i32(b, "get", 0, 0) == 142, "write to one instance changed the other");
+    CHECK(b->memory->size == 1, "grow of one instance changed the other");
+
+    eval_state_t *again;
+    CHECK(instantiate_snapshot(module, MODULE_KEY, path, &again) == NO_EXCEPTION, "instantiate_snapshot failed");
+    check_instances_equal(again, b);
+    free_interpreter(again);
+    free_interpreter(a);
+    free_interpreter(b);
+}
+
+void check_rejected(const module_t *module, u64 module_key, const char *path) {
+    eval_state_t *instance = (eval_state_t *) 1;
+    CHECK(instantiate_snapshot(module, module_key, path, &instance) == EXCEPTION_INTERPRETER_INVALID_SNAPSHOT,
+          "%s was not rejected", path);
+    CHECK(instance == NULL, "no instance expected for %s", path);
+}
+
+void test_invalid(const module_t *module) {
+    char path[4096], truncated[4096];
+    snapshot_path(path, sizeof(path), "modified");
+    check_rejected(module, MODULE_KEY + 1, path);
+
+    snapshot_path(truncated, sizeof(truncated), "missing");
+    check_rejected(module, MODULE_KEY, truncated);
+
+    // cut off in the header and in the memory contents
+    FILE *input = fopen(path, "r");
+    CHECK(input != NULL, "cannot open %s", path);
+    fseek(input, 0, SEEK_END);
+    long size = ftell(input);
+    rewind(input);
+    char *data = malloc(size);
+    CHECK(fread(data, 1, size, input) == (size_t) size, "cannot read %s", path);
+    fclose(input);
+    snapshot_path(truncated, sizeof(truncated), "truncated");
+    long lengths[] = {0, 8, size - PAGE_SIZE, size - 1};
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        FILE *output = fopen(truncated, "w");
+        CHECK(output != NULL && fwrite(data, 1, lengths[i], output) == (size_t) lengths[i], "cannot write %s", truncated);
+        fclose(output);
+        check_rejected(module, MODULE_KEY, truncated);
+    }
+
+    // sizes in the header which do not fit the module, the first patch is valid and shows the offsets are right
+    snapshot_path(truncated, sizeof(truncated), "patched");
+    patch_t patches[] = {
+            {HEADER_MEMORY_SIZE, 1},
+            {HEADER_MEMORY_SIZE, 5},
+            {HEADER_MEMORY_SIZE, 0},
+            {HEADER_MEMORY_MAX_SIZE, 5},
+            {HEADER_MEMORY_MAX_SIZE, MAX_MEMORY_PAGES},
+            {HEADER_TABLE_LENGTH, 3},
+            {HEADER_TABLE_LENGTH, 0},
+    };
+    for (size_t i = 0; i < sizeof(patches) / sizeof(patches[0]); i++) {
+        char *patched = malloc(size);
+        memcpy(patched, data, size);
+        memcpy(patched + patches[i].offset, &patches[i].value, sizeof(u32));
+        FILE *output = fopen(truncated, "w");
+        CHECK(output != NULL && fwrite(patched, 1, size, output) == (size_t) size, "cannot write %s", truncated);
+        fclose(output);
+        free(patched);
+        if (i == 0) {
+            eval_state_t *instance;
+            CHECK(instantiate_snapshot(module, MODULE_KEY, truncated, &instance) == NO_EXCEPTION,
+                  "instantiate_snapshot failed");
+            CHECK(instance->memory->size == 1, "memory size was not patched");
+            free_interpreter(instance);
+        } else {
+            check_rejected(module, MODULE_KEY, truncated);
+        }
+    }
+    free(data);
+
+    // a snapshot of another module
+    module_t *other = load_example("func1.wasm");
+    eval_state_t *instance;
+    CHECK(instantiate(other, &instance) == NO_EXCEPTION, "instantiate failed");
+    snapshot_path(path, sizeof(path), "other");
+    CHECK(write_snapshot(instance, MODULE_KEY, path) == NO_EXCEPTION, "write_snapshot failed");
+    check_rejected(module, MODULE_KEY, path);
+    free_interpreter(instance);
+    free_module(other);
+}
+
+static void remove_dir() {
+    const char *names[] = {"fresh", "modified", "truncated", "patched", "other"};
+    char path[4096];
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        snapshot_path(path, sizeof(path), names[i]);
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+int main() {
+    CHECK(mkdtemp(dir) != NULL, "cannot create a temporary directory");
+    module_t *module = load_example("state.wasm");
+    test_round_trip(module);
+    test_independent(module);
+    test_invalid(module);
+    free_module(module);
+    remove_dir();
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test_compare.h"
+
+#ifndef WASM_BENCH_DIR
+#define WASM_BENCH_DIR "bench"
+#endif
+
+static byte *read_file(const char *path, size_t *length) {
+    FILE *input = fopen(path, "r");
+    CHECK(input != NULL, "cannot open %s", path);
+    fseek(input, 0, SEEK_END);
+    *length = ftell(input);
+    rewind(input);
+    byte *bytes = malloc(*length);
+    CHECK(fread(bytes, 1, *length, input) == *length, "cannot read %s", path);
+    fclose(input);
+    return bytes;
+}
+
+/* Feeds the bytes in chunks of chunk_size, the last one may be shorter. */
+static exception_t stream_parse(const byte *bytes, size_t length, size_t chunk_size, bool lazy, module_t **module) {
+    stream_parser_t *parser;
+    CHECK(create_stream_parser(&(parse_options_t) {.lazy = lazy}, &parser) == NO_EXCEPTION, "create failed");
+    exception_t ex = NO_EXCEPTION;
+    for (size_t pos = 0; pos < length && ex == NO_EXCEPTION; pos += chunk_size) {
+        ex = stream_parser_feed(parser, bytes + pos, length - pos < chunk_size ? length - pos : chunk_size);
+    }
+    exception_t finish_ex = stream_parser_finish(parser, module);
+    CHECK(ex == NO_EXCEPTION || finish_ex == ex, "finish did not return the error of feed");
+    free_stream_parser(parser);
+    return finish_ex;
+}
+
+/* The module must be the same however it is split, and the same as parse_fd makes of the file. */
+void test_module(const char *path) {
+    int fd = open(path, O_RDONLY);
+    CHECK(fd >= 0, "cannot open %s", path);
+    module_t *expected;
+    CHECK(parse_fd(fd, NULL, &expected) == NO_EXCEPTION, "parse_fd of %s failed", path);
+    close(fd);
+
+    size_t length;
+    byte *bytes = read_file(path, &length);
+    size_t chunk_sizes[] = {1, 2, 3, 7, 64, 4096};
+    for (size_t i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++) {
+        for (int lazy = 0; lazy <= 1; lazy++) {
+            module_t *module;
+            exception_t ex = stream_parse(bytes, length, chunk_sizes[i], lazy, &module);
+            CHECK(ex == NO_EXCEPTION, "%s in chunks of %zu: %s", path, chunk_sizes[i], exception_code_to_string(ex));
+            CHECK(module->binary_size == length && memcmp(module->binary, bytes, length) == 0,
+                  "the module does not own the received bytes");
+            check_modules_equal(module, expected);
+            free_module(module);
+        }
+    }
+
+    // cut off within the last section and within the first one after the header
+    size_t lengths[] = {length - 1, 9};
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        module_t *module = (module_t *) 1;
+        CHECK(stream_parse(bytes, lengths[i], 1, false, &module) != NO_EXCEPTION,
+              "%s cut off after %zu bytes was accepted", path, lengths[i]);
+        CHECK(module == NULL, "no module expected");
+    }
+    free(bytes);
+    free_module(expected);
+}
+
+void test_invalid() {
+    module_t *module;
+    stream_parser_t *parser;
+    byte bad_magic[] = {0x00, 0x61, 0x73, 0x6e, 0x01, 0x00, 0x00, 0x00};
+    CHECK(create_stream_parser(NULL, &parser) == NO_EXCEPTION, "create failed");
+    exception_t ex = stream_parser_feed(parser, bad_magic, sizeof(bad_magic));
+    CHECK(ex != NO_EXCEPTION, "bad magic was accepted");
+    CHECK(stream_parser_feed(parser, bad_magic, sizeof(bad_magic)) == ex, "feed after an error did not fail");
+    CHECK(stream_parser_finish(parser, &module) == ex && module == NULL, "finish after an error did not fail");
+    free_stream_parser(parser);
+
+    byte bad_version[] = {0x00, 0x61, 0x73, 0x6d, 0x02, 0x00, 0x00, 0x00};
+    CHECK(stream_parse(bad_version, sizeof(bad_version), 1, false, &module) != NO_EXCEPTION, "bad version accepted");
+
+    // too short for the header
+    CHECK(stream_parse(bad_version, 0, 1, false, &module) != NO_EXCEPTION, "empty module accepted");
+    CHECK(stream_parse(bad_version, 4, 1, false, &module) != NO_EXCEPTION, "header without version accepted");
+}
+
+int main() {
+    const char *examples[] = {"control.wasm", "func1.wasm", "image.wasm", "imports.wasm", "increment_f32.wasm",
+                              "memory.wasm", "parametric.wasm", "state.wasm", "test.wasm", "trap.wasm"};
+    char path[4096];
+    for (size_t i = 0; i < sizeof(examples) / sizeof(examples[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", WASM_EXAMPLES_DIR, examples[i]);
+        test_module(path);
+    }
+    const char *benchmarks[] = {"br_table.wasm", "call_indirect.wasm", "crc32.wasm", "fib.wasm", "matmul.wasm",
+                                "memcpy.wasm", "sieve.wasm"};
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", WASM_BENCH_DIR, benchmarks[i]);
+        test_module(path);
+    }
+    test_invalid();
+    return 0;
+}
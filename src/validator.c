@@ -0,0 +1,628 @@
+#include <string.h>
+
+#include "validator.h"
+#include "exception.h"
+#include "memory.h"
+#include "strings.h"
+
+typedef struct ctrl_frame {
+    bool is_loop;
+    blocktype_t resulttype;
+    u32 height; /* Operand stack height at the start of the block */
+    bool unreachable; /* The rest of the block is unreachable, the operand stack is polymorphic */
+} ctrl_frame_t;
+
+CREATE_VEC(ctrl_frame_t, ctrl_frame)
+
+typedef struct validator_state {
+    module_t *module;
+    vec_valtype_t *locals;
+    vec_valtype_t *opds;
+    vec_ctrl_frame_t *ctrls;
+    u32 max_height;
+} validator_state_t;
+
+/* Operand types of numeric instructions, all operands of an instruction have the same type. */
+typedef struct signature {
+    u32 params;
+    valtype_t param;
+    valtype_t result;
+} signature_t;
+
+/* Indexed by opcode - OP_I32_WRAP_I64. */
+static const signature_t conversions[] = {
+        {1, VALTYPE_I64, VALTYPE_I32}, {1, VALTYPE_F32, VALTYPE_I32}, {1, VALTYPE_F32, VALTYPE_I32},
+        {1, VALTYPE_F64, VALTYPE_I32}, {1, VALTYPE_F64, VALTYPE_I32}, {1, VALTYPE_I32, VALTYPE_I64},
+        {1, VALTYPE_I32, VALTYPE_I64}, {1, VALTYPE_F32, VALTYPE_I64}, {1, VALTYPE_F32, VALTYPE_I64},
+        {1, VALTYPE_F64, VALTYPE_I64}, {1, VALTYPE_F64, VALTYPE_I64}, {1, VALTYPE_I32, VALTYPE_F32},
+        {1, VALTYPE_I32, VALTYPE_F32}, {1, VALTYPE_I64, VALTYPE_F32}, {1, VALTYPE_I64, VALTYPE_F32},
+        {1, VALTYPE_F64, VALTYPE_F32}, {1, VALTYPE_I32, VALTYPE_F64}, {1, VALTYPE_I32, VALTYPE_F64},
+        {1, VALTYPE_I64, VALTYPE_F64}, {1, VALTYPE_I64, VALTYPE_F64}, {1, VALTYPE_F32, VALTYPE_F64},
+        {1, VALTYPE_F32, VALTYPE_I32}, {1, VALTYPE_F64, VALTYPE_I64}, {1, VALTYPE_I32, VALTYPE_F32},
+        {1, VALTYPE_I64, VALTYPE_F64},
+};
+
+/* Value type and log2 of the natural alignment of loads and stores, indexed by opcode - OP_I32_LOAD. */
+static const struct {
+    valtype_t type;
+    u32 align;
+} memory_accesses[] = {
+        {VALTYPE_I32, 2}, {VALTYPE_I64, 3}, {VALTYPE_F32, 2}, {VALTYPE_F64, 3},
+        {VALTYPE_I32, 0}, {VALTYPE_I32, 0}, {VALTYPE_I32, 1}, {VALTYPE_I32, 1},
+        {VALTYPE_I64, 0}, {VALTYPE_I64, 0}, {VALTYPE_I64, 1}, {VALTYPE_I64, 1}, {VALTYPE_I64, 2}, {VALTYPE_I64, 2},
+        {VALTYPE_I32, 2}, {VALTYPE_I64, 3}, {VALTYPE_F32, 2}, {VALTYPE_F64, 3},
+        {VALTYPE_I32, 0}, {VALTYPE_I32, 1}, {VALTYPE_I64, 0}, {VALTYPE_I64, 1}, {VALTYPE_I64, 2},
+};
+
+static bool numeric_signature(opcode_t op, signature_t *sig) {
+    if (op == OP_I32_EQZ) {
+        *sig = (signature_t) {1, VALTYPE_I32, VALTYPE_I32};
+    } else if (op >= OP_I32_EQ && op <= OP_I32_GE_U) {
+        *sig = (signature_t) {2, VALTYPE_I32, VALTYPE_I32};
+    } else if (op == OP_I64_EQZ) {
+        *sig = (signature_t) {1, VALTYPE_I64, VALTYPE_I32};
+    } else if (op >= OP_I64_EQ && op <= OP_I64_GE_U) {
+        *sig = (signature_t) {2, VALTYPE_I64, VALTYPE_I32};
+    } else if (op >= OP_F32_EQ && op <= OP_F32_GE) {
+        *sig = (signature_t) {2, VALTYPE_F32, VALTYPE_I32};
+    } else if (op >= OP_F64_EQ && op <= OP_F64_GE) {
+        *sig = (signature_t) {2, VALTYPE_F64, VALTYPE_I32};
+    } else if (op >= OP_I32_CLZ && op <= OP_I32_POPCNT) {
+        *sig = (signature_t) {1, VALTYPE_I32, VALTYPE_I32};
+    } else if (op >= OP_I32_ADD && op <= OP_I32_ROTR) {
+        *sig = (signature_t) {2, VALTYPE_I32, VALTYPE_I32};
+    } else if (op >= OP_I64_CLZ && op <= OP_I64_POPCNT) {
+        *sig = (signature_t) {1, VALTYPE_I64, VALTYPE_I64};
+    } else if (op >= OP_I64_ADD && op <= OP_I64_ROTR) {
+        *sig = (signature_t) {2, VALTYPE_I64, VALTYPE_I64};
+    } else if (op >= OP_F32_ABS && op <= OP_F32_SQRT) {
+        *sig = (signature_t) {1, VALTYPE_F32, VALTYPE_F32};
+    } else if (op >= OP_F32_ADD && op <= OP_F32_COPYSIGN) {
+        *sig = (signature_t) {2, VALTYPE_F32, VALTYPE_F32};
+    } else if (op >= OP_F64_ABS && op <= OP_F64_SQRT) {
+        *sig = (signature_t) {1, VALTYPE_F64, VALTYPE_F64};
+    } else if (op >= OP_F64_ADD && op <= OP_F64_COPYSIGN) {
+        *sig = (signature_t) {2, VALTYPE_F64, VALTYPE_F64};
+    } else if (op >= OP_I32_WRAP_I64 && op <= OP_F64_REINTERPRET_I64) {
+        *sig = conversions[op - OP_I32_WRAP_I64];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static u32 count_imports(module_t *module, importdesc_t desc) {
+    u32 count = 0;
+    if (module->imports != NULL) {
+        vec_import_iterator_t it = vec_import_iterator(module->imports, IT_FORWARDS);
+        while (vec_import_has_next(&it)) {
+            if (vec_import_nextp(&it)->desc == desc) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+static import_t *find_import(module_t *module, importdesc_t desc, u32 idx) {
+    vec_import_iterator_t it = vec_import_iterator(module->imports, IT_FORWARDS);
+    while (vec_import_has_next(&it)) {
+        import_t *import = vec_import_nextp(&it);
+        if (import->desc == desc && idx-- == 0) {
+            return import;
+        }
+    }
+    return NULL;
+}
+
+static functype_t *get_type(module_t *module, typeidx idx) {
+    if (module->types == NULL || idx >= vec_functype_length(module->types)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_UNKNOWN_TYPE, "unknown type %u", idx);
+    }
+    return vec_functype_getp(module->types, idx);
+}
+
+static functype_t *get_func_type(module_t *module, funcidx idx) {
+    u32 imported = count_imports(module, IMPORTDESC_FUNC);
+    if (idx < imported) {
+        return get_type(module, find_import(module, IMPORTDESC_FUNC, idx)->func);
+    }
+    if (module->funcs == NULL || idx - imported >= vec_func_length(module->funcs)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_UNKNOWN_FUNCTION, "unknown function %u", idx);
+    }
+    return get_type(module, vec_func_getp(module->funcs, idx - imported)->type);
+}
+
+static globaltype_t get_global_type(module_t *module, globalidx idx) {
+    u32 imported = count_imports(module, IMPORTDESC_GLOBAL);
+    if (idx < imported) {
+        return find_import(module, IMPORTDESC_GLOBAL, idx)->global;
+    }
+    if (module->globals == NULL || idx - imported >= vec_global_length(module->globals)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_UNKNOWN_GLOBAL, "unknown global %u", idx);
+    }
+    return vec_global_getp(module->globals, idx - imported)->gt;
+}
+
+static u32 count_tables(module_t *module) {
+    return count_imports(module, IMPORTDESC_TABLE) + (module->tables ? vec_tabletype_length(module->tables) : 0);
+}
+
+static u32 count_memories(module_t *module) {
+    return count_imports(module, IMPORTDESC_MEM) + (module->mems ? vec_memtype_length(module->mems) : 0);
+}
+
+static void check_table(module_t *module, tableidx idx) {
+    if (idx >= count_tables(module)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_UNKNOWN_TABLE, "unknown table %u", idx);
+    }
+}
+
+static void check_memory(module_t *module, memidx idx) {
+    if (idx >= count_memories(module)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_UNKNOWN_MEMORY, "unknown memory %u", idx);
+    }
+}
+
+static void push_opd(validator_state_t *state, valtype_t type) {
+    vec_valtype_add(state->opds, type);
+    if (vec_valtype_length(state->opds) > state->max_height) {
+        state->max_height = vec_valtype_length(state->opds);
+    }
+}
+
+/* Returns VALTYPE_UNKNOWN for values popped from the polymorphic stack of unreachable code. */
+static valtype_t pop_opd(validator_state_t *state) {
+    ctrl_frame_t *frame = vec_ctrl_frame_peekp(state->ctrls);
+    if (vec_valtype_length(state->opds) == frame->height) {
+        if (frame->unreachable) {
+            return VALTYPE_UNKNOWN;
+        }
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_TYPE_MISMATCH, "type mismatch: operand stack underflow");
+    }
+    return vec_valtype_pop(state->opds);
+}
+
+static valtype_t pop_expect(validator_state_t *state, valtype_t expected) {
+    valtype_t actual = pop_opd(state);
+    if (actual == VALTYPE_UNKNOWN) {
+        return expected;
+    }
+    if (expected != VALTYPE_UNKNOWN && actual != expected) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_TYPE_MISMATCH, "type mismatch: expected %s, got %s",
+                                 valtype2str(expected), valtype2str(actual));
+    }
+    return actual;
+}
+
+static void push_result(validator_state_t *state, blocktype_t resulttype) {
+    if (!resulttype.empty) {
+        push_opd(state, resulttype.type);
+    }
+}
+
+static void pop_result(validator_state_t *state, blocktype_t resulttype) {
+    if (!resulttype.empty) {
+        pop_expect(state, resulttype.type);
+    }
+}
+
+static void push_ctrl(validator_state_t *state, bool is_loop, blocktype_t resulttype) {
+    vec_ctrl_frame_push(state->ctrls, (ctrl_frame_t) {
+            .is_loop = is_loop,
+            .resulttype = resulttype,
+            .height = vec_valtype_length(state->opds),
+            .unreachable = false,
+    });
+}
+
+static blocktype_t pop_ctrl(validator_state_t *state) {
+    ctrl_frame_t *frame = vec_ctrl_frame_peekp(state->ctrls);
+    pop_result(state, frame->resulttype);
+    if (vec_valtype_length(state->opds) != frame->height) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_TYPE_MISMATCH, "type mismatch: %u values remaining at end of block",
+                                 vec_valtype_length(state->opds) - frame->height);
+    }
+    return vec_ctrl_frame_pop(state->ctrls).resulttype;
+}
+
+static void set_unreachable(validator_state_t *state) {
+    ctrl_frame_t *frame = vec_ctrl_frame_peekp(state->ctrls);
+    vec_valtype_resize(state->opds, frame->height);
+    frame->unreachable = true;
+}
+
+/* Types of the values a branch to the given label carries. */
+static blocktype_t label_type(validator_state_t *state, labelidx labelidx) {
+    if (labelidx >= vec_ctrl_frame_length(state->ctrls)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_UNKNOWN_LABEL, "unknown label %u", labelidx);
+    }
+    ctrl_frame_t *frame = vec_ctrl_frame_getp(state->ctrls, vec_ctrl_frame_length(state->ctrls) - labelidx - 1);
+    return frame->is_loop ? (blocktype_t) {.empty = true, .type = VALTYPE_UNKNOWN} : frame->resulttype;
+}
+
+static void pop_params(validator_state_t *state, functype_t *ft) {
+    vec_valtype_iterator_t it = vec_valtype_iterator(ft->t1, IT_BACKWARDS);
+    while (vec_valtype_has_next(&it)) {
+        pop_expect(state, vec_valtype_next(&it));
+    }
+}
+
+static void push_results(validator_state_t *state, functype_t *ft) {
+    vec_valtype_iterator_t it = vec_valtype_iterator(ft->t2, IT_FORWARDS);
+    while (vec_valtype_has_next(&it)) {
+        push_opd(state, vec_valtype_next(&it));
+    }
+}
+
+static valtype_t get_local_type(validator_state_t *state, localidx idx) {
+    if (idx >= vec_valtype_length(state->locals)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_UNKNOWN_LOCAL, "unknown local %u", idx);
+    }
+    return vec_valtype_get(state->locals, idx);
+}
+
+static void validate_instrs(validator_state_t *state, vec_instruction_t *instrs);
+
+static void validate_instr(validator_state_t *state, instruction_t *instr) {
+    module_t *module = state->module;
+    opcode_t op = instr->opcode;
+    signature_t sig;
+
+    switch (op) {
+        case OP_UNREACHABLE:
+            set_unreachable(state);
+            break;
+        case OP_NOP:
+            break;
+        case OP_BLOCK:
+        case OP_LOOP:
+            push_ctrl(state, op == OP_LOOP, instr->block.resulttype);
+            validate_instrs(state, instr->block.instructions);
+            push_result(state, pop_ctrl(state));
+            break;
+        case OP_IF:
+            pop_expect(state, VALTYPE_I32);
+            push_ctrl(state, false, instr->if_block.resulttype);
+            validate_instrs(state, instr->if_block.ifpath);
+            if (instr->if_block.elsepath != NULL) {
+                push_ctrl(state, false, pop_ctrl(state));
+                validate_instrs(state, instr->if_block.elsepath);
+            } else if (!instr->if_block.resulttype.empty) {
+                THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_TYPE_MISMATCH, "type mismatch: if without else has a result");
+            }
+            push_result(state, pop_ctrl(state));
+            break;
+        case OP_BR:
+            pop_result(state, label_type(state, instr->labelidx));
+            set_unreachable(state);
+            break;
+        case OP_BR_IF: {
+            blocktype_t resulttype = label_type(state, instr->labelidx);
+            pop_expect(state, VALTYPE_I32);
+            pop_result(state, resulttype);
+            push_result(state, resulttype);
+            break;
+        }
+        case OP_BR_TABLE: {
+            blocktype_t resulttype = label_type(state, instr->table.default_label);
+            vec_labelidx_iterator_t it = vec_labelidx_iterator(instr->table.labels, IT_FORWARDS);
+            while (vec_labelidx_has_next(&it)) {
+                blocktype_t other = label_type(state, vec_labelidx_next(&it));
+                if (other.empty != resulttype.empty || (!other.empty && other.type != resulttype.type)) {
+                    THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_TYPE_MISMATCH,
+                                             "type mismatch: br_table labels have inconsistent types");
+                }
+            }
+            pop_expect(state, VALTYPE_I32);
+            pop_result(state, resulttype);
+            set_unreachable(state);
+            break;
+        }
+        case OP_RETURN:
+            pop_result(state, vec_ctrl_frame_getp(state->ctrls, 0)->resulttype);
+            set_unreachable(state);
+            break;
+        case OP_CALL: {
+            functype_t *ft = get_func_type(module, instr->funcidx);
+            pop_params(state, ft);
+            push_results(state, ft);
+            break;
+        }
+        case OP_CALL_INDIRECT: {
+            check_table(module, 0);
+            functype_t *ft = get_type(module, instr->typeidx);
+            pop_expect(state, VALTYPE_I32);
+            pop_params(state, ft);
+            push_results(state, ft);
+            break;
+        }
+        case OP_DROP:
+            pop_opd(state);
+            break;
+        case OP_SELECT: {
+            pop_expect(state, VALTYPE_I32);
+            valtype_t type = pop_opd(state);
+            push_opd(state, pop_expect(state, type));
+            break;
+        }
+        case OP_LOCAL_GET:
+            push_opd(state, get_local_type(state, instr->localidx));
+            break;
+        case OP_LOCAL_SET:
+            pop_expect(state, get_local_type(state, instr->localidx));
+            break;
+        case OP_LOCAL_TEE:
+            push_opd(state, pop_expect(state, get_local_type(state, instr->localidx)));
+            break;
+        case OP_GLOBAL_GET:
+            push_opd(state, get_global_type(module, instr->globalidx).t);
+            break;
+        case OP_GLOBAL_SET: {
+            globaltype_t gt = get_global_type(module, instr->globalidx);
+            if (gt.m != MUTABILITY_VAR) {
+                THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_IMMUTABLE_GLOBAL, "global %u is immutable",
+                                         instr->globalidx);
+            }
+            pop_expect(state, gt.t);
+            break;
+        }
+        case OP_MEMORY_SIZE:
+            check_memory(module, 0);
+            push_opd(state, VALTYPE_I32);
+            break;
+        case OP_MEMORY_GROW:
+            check_memory(module, 0);
+            pop_expect(state, VALTYPE_I32);
+            push_opd(state, VALTYPE_I32);
+            break;
+        case OP_I32_CONST:
+            push_opd(state, VALTYPE_I32);
+            break;
+        case OP_I64_CONST:
+            push_opd(state, VALTYPE_I64);
+            break;
+        case OP_F32_CONST:
+            push_opd(state, VALTYPE_F32);
+            break;
+        case OP_F64_CONST:
+            push_opd(state, VALTYPE_F64);
+            break;
+        default:
+            if (op >= OP_I32_LOAD && op <= OP_I64_STORE32) {
+                check_memory(module, 0);
+                valtype_t type = memory_accesses[op - OP_I32_LOAD].type;
+                if (instr->memarg.align > memory_accesses[op - OP_I32_LOAD].align) {
+                    THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_INVALID_ALIGNMENT,
+                                             "alignment 2**%u of %s larger than natural", instr->memarg.align,
+                                             opcode2str(op));
+                }
+                if (op >= OP_I32_STORE) {
+                    pop_expect(state, type);
+                    pop_expect(state, VALTYPE_I32);
+                } else {
+                    pop_expect(state, VALTYPE_I32);
+                    push_opd(state, type);
+                }
+            } else if (numeric_signature(op, &sig)) {
+                for (u32 i = 0; i < sig.params; i++) {
+                    pop_expect(state, sig.param);
+                }
+                push_opd(state, sig.result);
+            } else {
+                THROW_EXCEPTION_WITH_MSG(EXCEPTION_PARSER_UNEXPECTED_OPCODE, "unexpected opcode 0x%02X", op);
+            }
+    }
+}
+
+static void validate_instrs(validator_state_t *state, vec_instruction_t *instrs) {
+    vec_instruction_iterator_t it = vec_instruction_iterator(instrs, IT_FORWARDS);
+    while (vec_instruction_has_next(&it)) {
+        validate_instr(state, vec_instruction_nextp(&it));
+    }
+}
+
+void validate_func(module_t *module, func_t *func) {
+    functype_t *ft = get_type(module, func->type);
+
+    validator_state_t state = {
+            .module = module,
+            .locals = vec_valtype_create(),
+            .opds = vec_valtype_create(),
+            .ctrls = vec_ctrl_frame_create(),
+            .max_height = 0,
+    };
+
+    vec_valtype_iterator_t param_it = vec_valtype_iterator(ft->t1, IT_FORWARDS);
+    while (vec_valtype_has_next(&param_it)) {
+        vec_valtype_add(state.locals, vec_valtype_next(&param_it));
+    }
+    vec_locals_iterator_t locals_it = vec_locals_iterator(func->locals, IT_FORWARDS);
+    while (vec_locals_has_next(&locals_it)) {
+        locals_t locals = vec_locals_next(&locals_it);
+        for (u32 i = 0; i < locals.n; i++) {
+            vec_valtype_add(state.locals, locals.t);
+        }
+    }
+
+    push_ctrl(&state, false, (blocktype_t) {
+            .empty = vec_valtype_length(ft->t2) == 0,
+            .type = vec_valtype_get_or(ft->t2, 0, VALTYPE_UNKNOWN),
+    });
+    validate_instrs(&state, func->expression.instructions);
+    pop_ctrl(&state);
+
+    func->num_locals = vec_valtype_length(state.locals) - vec_valtype_length(ft->t1);
+    func->max_stack_height = state.max_height;
+
+    vec_valtype_free(state.locals);
+    vec_valtype_free(state.opds);
+    vec_ctrl_frame_free(state.ctrls);
+}
+
+/* Constant expressions consist of constants and reads of immutable imported globals. */
+static void validate_const_expr(module_t *module, expression_t *expr, valtype_t expected) {
+    u32 count = 0;
+    valtype_t type = VALTYPE_UNKNOWN;
+
+    vec_instruction_iterator_t it = vec_instruction_iterator(expr->instructions, IT_FORWARDS);
+    while (vec_instruction_has_next(&it)) {
+        instruction_t *instr = vec_instruction_nextp(&it);
+        switch (instr->opcode) {
+            case OP_I32_CONST:
+                type = VALTYPE_I32;
+                break;
+            case OP_I64_CONST:
+                type = VALTYPE_I64;
+                break;
+            case OP_F32_CONST:
+                type = VALTYPE_F32;
+                break;
+            case OP_F64_CONST:
+                type = VALTYPE_F64;
+                break;
+            case OP_GLOBAL_GET: {
+                globaltype_t gt = get_global_type(module, instr->globalidx);
+                if (instr->globalidx >= count_imports(module, IMPORTDESC_GLOBAL)) {
+                    THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_UNKNOWN_GLOBAL, "unknown global %u",
+                                             instr->globalidx);
+                }
+                if (gt.m != MUTABILITY_CONST) {
+                    THROW_EXCEPTION(EXCEPTION_VALIDATOR_CONSTANT_EXPRESSION_REQUIRED);
+                }
+                type = gt.t;
+                break;
+            }
+            default:
+                THROW_EXCEPTION(EXCEPTION_VALIDATOR_CONSTANT_EXPRESSION_REQUIRED);
+        }
+        count++;
+    }
+
+    if (count != 1 || type != expected) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_TYPE_MISMATCH, "type mismatch: constant expression of type %s expected",
+                                 valtype2str(expected));
+    }
+}
+
+static void validate_limits(limits_t lim, u64 max) {
+    if (lim.min > max || (lim.has_max && lim.max > max)) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_INVALID_LIMITS, "size must be at most %lu", (unsigned long) max);
+    }
+    if (lim.has_max && lim.min > lim.max) {
+        THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_INVALID_LIMITS, "size minimum must not be greater than maximum");
+    }
+}
+
+static void validate_export(module_t *module, u32 idx) {
+    export_t *export = vec_export_getp(module->exports, idx);
+    switch (export->desc) {
+        case EXPORTDESC_FUNC:
+            get_func_type(module, export->func);
+            break;
+        case EXPORTDESC_TABLE:
+            check_table(module, export->table);
+            break;
+        case EXPORTDESC_MEM:
+            check_memory(module, export->mem);
+            break;
+        case EXPORTDESC_GLOBAL:
+            get_global_type(module, export->global);
+            break;
+    }
+
+    for (u32 i = 0; i < idx; i++) {
+        if (names_equal(vec_export_getp(module->exports, i)->name, export->name)) {
+            THROW_EXCEPTION_WITH_MSG(EXCEPTION_VALIDATOR_DUPLICATE_EXPORT_NAME, "duplicate export name %.*s",
+                                     (int) export->name.length, export->name.bytes);
+        }
+    }
+}
+
+void validate_module(module_t *module) {
+    if (module->types != NULL) {
+        vec_functype_iterator_t it = vec_functype_iterator(module->types, IT_FORWARDS);
+        while (vec_functype_has_next(&it)) {
+            if (vec_valtype_length(vec_functype_nextp(&it)->t2) > 1) {
+                THROW_EXCEPTION(EXCEPTION_VALIDATOR_INVALID_RESULT_ARITY);
+            }
+        }
+    }
+
+    if (module->imports != NULL) {
+        vec_import_iterator_t it = vec_import_iterator(module->imports, IT_FORWARDS);
+        while (vec_import_has_next(&it)) {
+            import_t *import = vec_import_nextp(&it);
+            if (import->desc == IMPORTDESC_FUNC) {
+                get_type(module, import->func);
+            } else if (import->desc == IMPORTDESC_TABLE) {
+                validate_limits(import->table.lim, UINT32_MAX);
+            } else if (import->desc == IMPORTDESC_MEM) {
+                validate_limits(import->mem.lim, MAX_MEMORY_PAGES);
+            }
+        }
+    }
+
+    if (count_tables(module) > 1) {
+        THROW_EXCEPTION(EXCEPTION_VALIDATOR_MULTIPLE_TABLES);
+    }
+    if (module->tables != NULL) {
+        vec_tabletype_iterator_t it = vec_tabletype_iterator(module->tables, IT_FORWARDS);
+        while (vec_tabletype_has_next(&it)) {
+            validate_limits(vec_tabletype_nextp(&it)->lim, UINT32_MAX);
+        }
+    }
+
+    if (count_memories(module) > 1) {
+        THROW_EXCEPTION(EXCEPTION_VALIDATOR_MULTIPLE_MEMORIES);
+    }
+    if (module->mems != NULL) {
+        vec_memtype_iterator_t it = vec_memtype_iterator(module->mems, IT_FORWARDS);
+        while (vec_memtype_has_next(&it)) {
+            validate_limits(vec_memtype_nextp(&it)->lim, MAX_MEMORY_PAGES);
+        }
+    }
+
+    if (module->globals != NULL) {
+        vec_global_iterator_t it = vec_global_iterator(module->globals, IT_FORWARDS);
+        while (vec_global_has_next(&it)) {
+            global_t *global = vec_global_nextp(&it);
+            validate_const_expr(module, &global->e, global->gt.t);
+        }
+    }
+
+    if (module->elem != NULL) {
+        vec_element_iterator_t it = vec_element_iterator(module->elem, IT_FORWARDS);
+        while (vec_element_has_next(&it)) {
+            element_t *elem = vec_element_nextp(&it);
+            check_table(module, elem->table);
+            validate_const_expr(module, &elem->offset, VALTYPE_I32);
+            vec_funcidx_iterator_t init_it = vec_funcidx_iterator(elem->init, IT_FORWARDS);
+            while (vec_funcidx_has_next(&init_it)) {
+                get_func_type(module, vec_funcidx_next(&init_it));
+            }
+        }
+    }
+
+    if (module->data != NULL) {
+        vec_data_iterator_t it = vec_data_iterator(module->data, IT_FORWARDS);
+        while (vec_data_has_next(&it)) {
+            data_t *data = vec_data_nextp(&it);
+            check_memory(module, data->memidx);
+            validate_const_expr(module, &data->expression, VALTYPE_I32);
+        }
+    }
+
+    if (module->has_start) {
+        functype_t *ft = get_func_type(module, module->start);
+        if (vec_valtype_length(ft->t1) != 0 || vec_valtype_length(ft->t2) != 0) {
+            THROW_EXCEPTION(EXCEPTION_VALIDATOR_INVALID_START_FUNCTION);
+        }
+    }
+
+    if (module->exports != NULL) {
+        for (u32 i = 0; i < vec_export_length(module->exports); i++) {
+            validate_export(module, i);
+        }
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef WASM_INTERPRETER_VALIDATOR_H
+#define WASM_INTERPRETER_VALIDATOR_H
+
+#include "module.h"
+
+/*
+ * Validation follows the algorithm of the WebAssembly specification (MVP) and throws EXCEPTION_VALIDATOR_* for
+ * invalid modules. validate_module checks everything but the function bodies, which are type-checked by validate_func
+ * in a single pass that also computes func->max_stack_height. validate_func only reads the rest of the module, so
+ * bodies can be validated concurrently.
+ * The interpreter relies on validated modules: operand stack slots are not type-checked at runtime.
+ */
+void validate_func(module_t *module, func_t *func);
+
+void validate_module(module_t *module);
+
+#endif // WASM_INTERPRETER_VALIDATOR_H
@@ -22,7 +22,14 @@ typedef u64 i64;
 typedef float f32;
 typedef double f64;
 
-typedef char *name;
+/* A range of bytes within the module binary, names and data segments reference the binary instead of copying it. */
+typedef struct span {
+    const byte *bytes;
+    u32 length;
+} span_t;
+
+/* Not NUL-terminated, print with "%.*s", (int) name.length, name.bytes. */
+typedef span_t name;
 
 typedef u32 typeidx;
 typedef u32 funcidx;
@@ -3,22 +3,17 @@
 
 #include "handler.h"
 
+// Locals are operand stack slots below the stack base of the frame, the validator guarantees matching types.
 OP_HANDLER(OP_LOCAL_GET) {
-    frame_t *frame = peek_func_frame(eval_state->frames);
-    local_entry_t *local = vec_local_entry_getp(frame->locals, instr->localidx);
-    push_generic(eval_state->opd_stack, local->valtype, local->val);
+    *push_entry(eval_state->opd_stack) = eval_state->locals[instr->localidx];
 }
 
 OP_HANDLER(OP_LOCAL_SET) {
-    frame_t *frame = peek_func_frame(eval_state->frames);
-    local_entry_t *local = vec_local_entry_getp(frame->locals, instr->localidx);
-    pop_generic_assert_type(eval_state->opd_stack, local->valtype, &local->val);
+    eval_state->locals[instr->localidx] = *pop_entry(eval_state->opd_stack);
 }
 
 OP_HANDLER(OP_LOCAL_TEE) {
-    frame_t *frame = peek_func_frame(eval_state->frames);
-    local_entry_t *local = vec_local_entry_getp(frame->locals, instr->localidx);
-    peek_generic_assert_type(eval_state->opd_stack, local->valtype, &local->val);
+    eval_state->locals[instr->localidx] = *peek_entry(eval_state->opd_stack);
 }
 
 OP_HANDLER(OP_GLOBAL_GET) {
@@ -10,6 +10,7 @@
 #include "util.h"
 #include "value.h"
 #include "exception.h"
+#include "arena.h"
 
 typedef enum direction {
     IT_FORWARDS,
@@ -18,6 +19,10 @@ typedef enum direction {
 
 #define VEC_ERROR(...) THROW_EXCEPTION_WITH_MSG(EXCEPTION_VECTOR_EXCEPTION, __VA_ARGS__)
 
+/*
+ * Vecs created with _create_in or _create_from live in an arena (see arena.h): their length is fixed, they must neither
+ * grow nor be freed individually.
+ */
 #define CREATE_VEC_(type, name, fn_prefix, vec_type, it_type) \
 typedef struct CAT(vec_, name) { \
     u32 _length; \
@@ -43,6 +48,28 @@ static SILENCE_UNUSED void CAT(fn_prefix, _free)(vec_type* vec) { \
     free(vec->_elements); \
     free(vec); \
 } \
+static SILENCE_UNUSED vec_type* CAT(fn_prefix, _create_in)(arena_t* arena, u32 length) { \
+    vec_type* vec = arena_alloc(arena, sizeof(vec_type)); \
+    vec->_length = length; \
+    vec->_capacity = length; \
+    vec->_elements = NULL; \
+    if (length > 0) { \
+        vec->_elements = arena_alloc(arena, sizeof(type) * length); \
+        memset(vec->_elements, 0, sizeof(type) * length); \
+    } \
+    return vec; \
+} \
+static SILENCE_UNUSED vec_type* CAT(fn_prefix, _create_from)(arena_t* arena, const type* elements, u32 length) { \
+    vec_type* vec = arena_alloc(arena, sizeof(vec_type)); \
+    vec->_length = length; \
+    vec->_capacity = length; \
+    vec->_elements = NULL; \
+    if (length > 0) { \
+        vec->_elements = arena_alloc(arena, sizeof(type) * length); \
+        memcpy(vec->_elements, elements, sizeof(type) * length); \
+    } \
+    return vec; \
+} \
 static SILENCE_UNUSED u32 CAT(fn_prefix, _length)(const vec_type* vec) { \
     if (vec == NULL) VEC_ERROR("vec must not be NULL"); \
     return vec->_length; \